@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_BUFFEREDSOAMAP_IMPL_H
+#define CCPPBRASIL_BUFFEREDSOAMAP_IMPL_H
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// buffered_soa_iterator
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::buffered_soa_iterator( map_type& obj, size_t mainPos, size_t deltaPos, size_t tombstonePos ) :
+    soa_map_( &obj ), main_pos_( mainPos ), delta_pos_( deltaPos ), tombstone_pos_( tombstonePos )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key_reference buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key() const
+{
+    return in_delta() ? soa_map_->delta_.keyAtIndex( delta_pos_ ) : soa_map_->main_.keyAtIndex( main_pos_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value_reference buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value() const
+{
+    return in_delta() ? soa_map_->delta_.atIndex( delta_pos_ ) : soa_map_->main_.atIndex( main_pos_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+// The delta and the main map never share a key: inserts of a key still in the main map reuse its
+// slot there.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::in_delta() const
+{
+    const auto& delta = soa_map_->delta_;
+    const auto& main = soa_map_->main_;
+    return delta_pos_ != delta.size() &&
+           ( main_pos_ == main.size() || KeyCompare()( delta.keyAtIndex( delta_pos_ ), main.keyAtIndex( main_pos_ ) ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::ref_type buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::dereference() const
+{
+    return ref_type( key(), value() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::equal( const buffered_soa_iterator& other ) const
+{
+    return main_pos_ == other.main_pos_ && delta_pos_ == other.delta_pos_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void buffered_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::increment()
+{
+    if( in_delta() )
+    {
+        ++delta_pos_;
+    }
+    else
+    {
+        *this = soa_map_->make_iterator( main_pos_ + 1, delta_pos_, tombstone_pos_ );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// buffered_soa_map
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::buffered_soa_map( size_t mergeThreshold ) :
+    merge_threshold_( mergeThreshold )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::set_merge_threshold( size_t mergeThreshold )
+{
+    merge_threshold_ = mergeThreshold;
+    flush_if_needed();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::merge_threshold() const
+{
+    return merge_threshold_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reserve( size_t capacity )
+{
+    main_.reserve( capacity );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::size() const
+{
+    return main_.size() - tombstones_.size() + delta_.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::empty() const
+{
+    return size() == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::clear()
+{
+    main_.clear();
+    delta_.clear();
+    tombstones_.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::insert( const std::pair< KeyType, ValueType > &keyValuePair )
+{
+    auto pos = main_.find( keyValuePair.first );
+    if( main_.end() != pos )
+    {
+        // A key erased since the last merge is still in main_, reuse its slot.
+        auto tombstone = find_tombstone( keyValuePair.first );
+        if( tombstones_.end() == tombstone )
+        {
+            return false;
+        }
+        tombstones_.erase( tombstone );
+        pos.value() = keyValuePair.second;
+        return true;
+    }
+
+    if( !delta_.insert( keyValuePair ) )
+    {
+        return false;
+    }
+    flush_if_needed();
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::emplace( KeyType && refKey, ValueType && value )
+{
+    KeyType key( std::forward<KeyType>( refKey ) );
+    auto pos = main_.find( key );
+    if( main_.end() != pos )
+    {
+        auto tombstone = find_tombstone( key );
+        if( tombstones_.end() == tombstone )
+        {
+            return false;
+        }
+        tombstones_.erase( tombstone );
+        pos.value() = std::forward<ValueType>( value );
+        return true;
+    }
+
+    if( !delta_.emplace( std::move( key ), std::forward<ValueType>( value ) ) )
+    {
+        return false;
+    }
+    flush_if_needed();
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::erase( const KeyType &key )
+{
+    if( delta_.end() != delta_.find( key ) )
+    {
+        delta_.erase( key );
+        return true;
+    }
+
+    if( main_.end() == main_.find( key ) )
+    {
+        return false;
+    }
+
+    auto tombstone = std::lower_bound( tombstones_.begin(), tombstones_.end(), key, KeyCompare() );
+    if( tombstones_.end() != tombstone && !KeyCompare()( key, *tombstone ) )
+    {
+        return false;
+    }
+    tombstones_.insert( tombstone, key );
+    flush_if_needed();
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::swap( buffered_soa_map &other )
+{
+    std::swap( merge_threshold_, other.merge_threshold_ );
+    main_.swap( other.main_ );
+    delta_.swap( other.delta_ );
+    tombstones_.swap( other.tombstones_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::begin()
+{
+    return make_iterator( 0, 0, 0 );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::begin() const
+{
+    return const_cast< buffered_soa_map* >( this )->begin();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::end()
+{
+    return iterator( *this, main_.size(), delta_.size(), tombstones_.size() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::end() const
+{
+    return const_cast< buffered_soa_map* >( this )->end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::lower_bound( const KeyType &key )
+{
+    return make_iterator( main_.lower_bound( key ).base(), delta_.lower_bound( key ).base(), tombstone_lower_bound( key ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::lower_bound( const KeyType &key ) const
+{
+    return const_cast< buffered_soa_map* >( this )->lower_bound( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::upper_bound( const KeyType &key )
+{
+    size_t tombstonePos = std::upper_bound( tombstones_.begin(), tombstones_.end(), key, KeyCompare() ) - tombstones_.begin();
+    return make_iterator( main_.upper_bound( key ).base(), delta_.upper_bound( key ).base(), tombstonePos );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::upper_bound( const KeyType &key ) const
+{
+    return const_cast< buffered_soa_map* >( this )->upper_bound( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::find( const KeyType &key )
+{
+    iterator pos = lower_bound( key );
+    return ( end() != pos && !KeyCompare()( key, pos.key() ) ) ? pos : end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::find( const KeyType &key ) const
+{
+    return const_cast< buffered_soa_map* >( this )->find( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::count( const KeyType &key ) const
+{
+    return ( end() != find( key ) ) ? 1 : 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+ValueType& buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::at( const KeyType & key )
+{
+    iterator pos = find( key );
+    if( end() == pos )
+    {
+        throw std::out_of_range( "" );
+    }
+    return pos.value();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+const ValueType& buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::at( const KeyType & key ) const
+{
+    const_iterator pos = find( key );
+    if( end() == pos )
+    {
+        throw std::out_of_range( "" );
+    }
+    return pos.value();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+ValueType& buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::operator[]( const KeyType &key )
+{
+    iterator pos = find( key );
+    if( end() != pos )
+    {
+        return pos.value();
+    }
+
+    insert( { key, ValueType() } );
+    return find( key ).value();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::flush()
+{
+    if( !tombstones_.empty() )
+    {
+        main_.erase_sorted( tombstones_.begin(), tombstones_.end() );
+        tombstones_.clear();
+    }
+
+    if( !delta_.empty() )
+    {
+        std::vector< std::pair< KeyType, ValueType > > batch;
+        batch.reserve( delta_.size() );
+        for( size_t i = 0; i < delta_.size(); ++i )
+        {
+            batch.push_back( std::make_pair( delta_.keyAtIndex( i ), std::move( delta_.atIndex( i ) ) ) );
+        }
+        main_.insert( batch.begin(), batch.end() );
+        delta_.clear();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::map_type&
+buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::merged()
+{
+    flush();
+    return main_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::tombstone_container_type::iterator
+buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::find_tombstone( const KeyType &key )
+{
+    auto pos = std::lower_bound( tombstones_.begin(), tombstones_.end(), key, KeyCompare() );
+    if( tombstones_.end() != pos && !KeyCompare()( key, *pos ) )
+    {
+        return pos;
+    }
+    return tombstones_.end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::tombstone_lower_bound( const KeyType &key ) const
+{
+    return std::lower_bound( tombstones_.begin(), tombstones_.end(), key, KeyCompare() ) - tombstones_.begin();
+}
+
+//-------------------------------------------------------------------------------------------------
+// Moves a main map position past the tombstones at and after it; tombstones are main map keys.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::make_iterator( size_t mainPos, size_t deltaPos, size_t tombstonePos )
+{
+    KeyCompare comp;
+    while( mainPos != main_.size() && tombstonePos != tombstones_.size() )
+    {
+        const KeyType& key = main_.keyAtIndex( mainPos );
+        if( comp( tombstones_[ tombstonePos ], key ) )
+        {
+            ++tombstonePos;
+        }
+        else if( comp( key, tombstones_[ tombstonePos ] ) )
+        {
+            break;
+        }
+        else
+        {
+            ++mainPos;
+            ++tombstonePos;
+        }
+    }
+    return iterator( *this, mainPos, deltaPos, tombstonePos );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void buffered_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::flush_if_needed()
+{
+    if( delta_.size() + tombstones_.size() > merge_threshold_ )
+    {
+        flush();
+    }
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_BUFFEREDSOAMAP_IMPL_H
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_BUFFEREDSOAMAP_H
+#define CCPPBRASIL_BUFFEREDSOAMAP_H
+
+#include <utility>
+#include <vector>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include "soa_map.h"
+
+namespace ccppbrasil {
+
+template< class KeyType,
+          class ValueType,
+          class KeyCompare = std::less< KeyType >,
+          class KeyAllocator = std::allocator< KeyType >,
+          class ValueAllocator = std::allocator< ValueType > >
+class buffered_soa_map;
+
+// Cursor over a buffered_soa_map: walks the main map and the delta side by side in key order,
+// skipping the tombstones, so the pending writes show without a flush.
+template< class KeyType,
+          class ValueType,
+          class KeyCompare,
+          class KeyAllocator,
+          class ValueAllocator >
+class buffered_soa_iterator : public boost::iterator_facade< buffered_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >,
+                                                             std::pair< const KeyType, ValueType >,
+                                                             boost::forward_traversal_tag,
+                                                             std::pair< typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key_reference,
+                                                                        typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value_reference > >
+{
+public:
+    typedef buffered_soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > map_type;
+    typedef typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key_reference key_reference;
+    typedef typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value_reference value_reference;
+    typedef std::pair< key_reference, value_reference > ref_type;
+
+    // Positions in the main map, the delta and the tombstones.
+    buffered_soa_iterator( map_type& obj, size_t mainPos, size_t deltaPos, size_t tombstonePos );
+
+    key_reference key() const;
+    value_reference value() const;
+
+    // Whether the current element is a pending insert, still in the delta.
+    bool in_delta() const;
+
+private:
+    friend class boost::iterator_core_access;
+
+    ref_type dereference() const;
+    bool equal( const buffered_soa_iterator& other ) const;
+    void increment();
+
+    map_type* soa_map_;
+    size_t main_pos_;
+    size_t delta_pos_;
+    size_t tombstone_pos_;
+};
+
+// soa_map with a write buffer in front of it, for write-heavy maps.
+//
+// Inserts of new keys go to a small sorted delta map, erases of keys in the main map are recorded
+// as sorted tombstones. Point lookups check the delta, the tombstones and the main map. Once the
+// delta and the tombstones together pass the merge threshold t, they are applied to the main map
+// in one erase_sorted and one bulk insert pass, and the main map keeps its contiguous columns for
+// scans. A write costs an O(log n) search and up to t moves within the delta, plus its share of
+// the merges, which rewrite the main map: O(n / t) moves amortized, not O(log n). With the
+// default threshold that is about 6K moves a write on a 100M key map; the merges are cheapest
+// with t near sqrt( n ), so raise the threshold as the map grows.
+//
+// Iterators merge the delta and the main map on the fly; any write may invalidate them. merged()
+// flushes first, for scans over the plain columns.
+template< class KeyType,
+          class ValueType,
+          class KeyCompare,
+          class KeyAllocator,
+          class ValueAllocator >
+class buffered_soa_map
+{
+public:
+    typedef buffered_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >        iterator;
+    typedef const buffered_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >  const_iterator;
+    typedef soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > map_type;
+    typedef typename map_type::value_reference value_reference;
+
+    static const size_t default_merge_threshold = 16 * 1024;
+
+    explicit buffered_soa_map( size_t mergeThreshold = default_merge_threshold );
+
+    void set_merge_threshold( size_t mergeThreshold );
+    size_t merge_threshold() const;
+
+    void reserve( size_t capacity );
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    bool insert( const std::pair< KeyType, ValueType > &keyValuePair );
+    bool emplace( KeyType && moveKey, ValueType && value );
+
+    // Returns whether the key was in the map.
+    bool erase( const KeyType &key );
+
+    void swap( buffered_soa_map &other );
+
+    iterator begin();
+    const_iterator begin() const;
+
+    iterator end();
+    const_iterator end() const;
+
+    iterator lower_bound( const KeyType &key );
+    const_iterator lower_bound( const KeyType &key ) const;
+
+    iterator upper_bound( const KeyType &key );
+    const_iterator upper_bound( const KeyType &key ) const;
+
+    iterator find( const KeyType &key );
+    const_iterator find( const KeyType &key ) const;
+    size_t count( const KeyType &key ) const;
+
+    ValueType& at( const KeyType & key );
+    const ValueType& at( const KeyType & key ) const;
+
+    ValueType& operator[]( const KeyType &key );
+
+    // Applies the pending writes to the main map.
+    void flush();
+
+    // Flushes and returns the main map, for iteration, range queries and scans.
+    map_type& merged();
+
+private:
+    typedef std::vector< KeyType, KeyAllocator > tombstone_container_type;
+
+    friend class buffered_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >;
+
+    typename tombstone_container_type::iterator find_tombstone( const KeyType &key );
+    void flush_if_needed();
+    size_t tombstone_lower_bound( const KeyType &key ) const;
+    iterator make_iterator( size_t mainPos, size_t deltaPos, size_t tombstonePos );
+
+    size_t merge_threshold_;
+    map_type main_;
+    map_type delta_;
+    tombstone_container_type tombstones_;
+};
+
+}
+
+#include "buffered_soa_map-impl.h"
+
+#endif // CCPPBRASIL_BUFFEREDSOAMAP_H
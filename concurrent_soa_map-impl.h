@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_CONCURRENTSOAMAP_IMPL_H
+#define CCPPBRASIL_CONCURRENTSOAMAP_IMPL_H
+
+#include <limits>
+#include <stdexcept>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// concurrent_soa_map::snapshot
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::snapshot::snapshot( detail::reader_slot* slot, const map_type* map ) :
+    slot_( slot ), map_( map )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::snapshot::snapshot( snapshot&& other ) :
+    slot_( other.slot_ ), map_( other.map_ )
+{
+    other.slot_ = nullptr;
+    other.map_ = nullptr;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::snapshot::~snapshot()
+{
+    if( slot_ != nullptr )
+    {
+        slot_->epoch.store( 0, std::memory_order_release );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+const typename concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::map_type& concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::snapshot::operator*() const
+{
+    return *map_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+const typename concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::map_type* concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::snapshot::operator->() const
+{
+    return map_;
+}
+
+//-------------------------------------------------------------------------------------------------
+// concurrent_soa_map::reader
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reader::reader( const concurrent_soa_map* owner, detail::reader_slot* slot ) :
+    owner_( owner ), slot_( slot )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reader::reader( reader&& other ) :
+    owner_( other.owner_ ), slot_( other.slot_ )
+{
+    other.owner_ = nullptr;
+    other.slot_ = nullptr;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reader::~reader()
+{
+    if( slot_ != nullptr )
+    {
+        slot_->taken.store( false, std::memory_order_release );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// The epoch is published before the pointer is loaded, both sequentially consistent. A writer
+// that reads this slot as free or newer than a retired version swapped the pointer before this
+// load, so the load returns a version that is not being deleted.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::snapshot concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reader::read() const
+{
+    slot_->epoch.store( owner_->epoch_.load() );
+    return snapshot( slot_, owner_->current_.load() );
+}
+
+//-------------------------------------------------------------------------------------------------
+// concurrent_soa_map
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::concurrent_soa_map( size_t maxReaders ) :
+    concurrent_soa_map( map_type(), maxReaders )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::concurrent_soa_map( map_type initial, size_t maxReaders ) :
+    slots_( new detail::reader_slot[ maxReaders ] ), max_readers_( maxReaders ),
+    current_( new map_type( std::move( initial ) ) ), epoch_( 1 )
+{
+    for( size_t i = 0; i < max_readers_; ++i )
+    {
+        slots_[ i ].epoch.store( 0 );
+        slots_[ i ].taken.store( false );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::~concurrent_soa_map()
+{
+    delete current_.load();
+    for( size_t i = 0; i < retired_.size(); ++i )
+    {
+        delete retired_[ i ].first;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reader concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::make_reader() const
+{
+    for( size_t i = 0; i < max_readers_; ++i )
+    {
+        bool expected = false;
+        if( slots_[ i ].taken.compare_exchange_strong( expected, true ) )
+        {
+            return reader( this, &slots_[ i ] );
+        }
+    }
+    throw std::length_error( "concurrent_soa_map: no free reader slot" );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+template< class InputIterator >
+void concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::insert( InputIterator first, InputIterator last )
+{
+    update( [ & ]( map_type& next ) { next.insert( first, last ); } );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+template< class InputIterator >
+size_t concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::erase_sorted( InputIterator first, InputIterator last )
+{
+    size_t erased = 0;
+    update( [ & ]( map_type& next ) { erased = next.erase_sorted( first, last ); } );
+    return erased;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+template< class Function >
+void concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::update( Function function )
+{
+    std::lock_guard< std::mutex > lock( writer_mutex_ );
+    std::unique_ptr< map_type > next( new map_type( *current_.load() ) );
+    function( *next );
+    install( next.release() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::publish( map_type next )
+{
+    std::lock_guard< std::mutex > lock( writer_mutex_ );
+    install( new map_type( std::move( next ) ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reclaim()
+{
+    std::lock_guard< std::mutex > lock( writer_mutex_ );
+    reclaim_retired();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::retired() const
+{
+    std::lock_guard< std::mutex > lock( writer_mutex_ );
+    return retired_.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+// Swaps next in and retires the old version with the epoch readers could have loaded it under;
+// readers that load the epoch after the increment see next. Called with the writer lock held.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::install( map_type* next )
+{
+    const map_type* old = current_.exchange( next );
+    retired_.push_back( retired_version( old, epoch_.fetch_add( 1 ) ) );
+    reclaim_retired();
+}
+
+//-------------------------------------------------------------------------------------------------
+// A version retired at epoch e is unreachable once every reader holding a snapshot holds one
+// taken at a later epoch. Called with the writer lock held.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void concurrent_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reclaim_retired()
+{
+    uint64_t oldest = std::numeric_limits< uint64_t >::max();
+    for( size_t i = 0; i < max_readers_; ++i )
+    {
+        uint64_t epoch = slots_[ i ].epoch.load();
+        if( epoch != 0 && epoch < oldest )
+        {
+            oldest = epoch;
+        }
+    }
+
+    size_t kept = 0;
+    for( size_t i = 0; i < retired_.size(); ++i )
+    {
+        if( retired_[ i ].second < oldest )
+        {
+            delete retired_[ i ].first;
+        }
+        else
+        {
+            retired_[ kept++ ] = retired_[ i ];
+        }
+    }
+    retired_.resize( kept );
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_CONCURRENTSOAMAP_IMPL_H
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_CONCURRENTSOAMAP_H
+#define CCPPBRASIL_CONCURRENTSOAMAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "soa_map.h"
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Epoch of one reader, 0 while it holds no snapshot. Slots are two cache lines long, so the epochs
+// of two readers never share a line whatever the alignment of the array.
+//-------------------------------------------------------------------------------------------------
+struct reader_slot
+{
+    std::atomic< uint64_t > epoch;
+    std::atomic< bool > taken;
+    char padding[ 2 * cache_line_size - sizeof( std::atomic< uint64_t > ) - sizeof( std::atomic< bool > ) ];
+};
+
+} // namespace detail
+
+// soa_map for many reader threads and one writer at a time, with read-copy-update publishing.
+//
+// Readers look up an immutable version of the map. Taking a snapshot of it is an epoch store and
+// a pointer load: no lock, no retry, and the only shared line a reader writes is its own slot.
+// An update copies the current version, applies the change (a bulk merge for insert), and
+// swaps the pointer to the new version in one atomic exchange, so readers see either version
+// whole. The old version is retired with the epoch of the swap and deleted once no reader slot
+// holds that epoch or an older one. Updates are serialized with a mutex and cost a copy of the
+// map, so batch them.
+template< class KeyType,
+          class ValueType,
+          class KeyCompare = std::less< KeyType >,
+          class KeyAllocator = std::allocator< KeyType >,
+          class ValueAllocator = std::allocator< ValueType > >
+class concurrent_soa_map
+{
+public:
+    typedef soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > map_type;
+
+    static const size_t default_max_readers = 64;
+
+    // Pins one version of the map until it is destroyed.
+    class snapshot
+    {
+    public:
+        snapshot( snapshot&& other );
+        ~snapshot();
+
+        const map_type& operator*() const;
+        const map_type* operator->() const;
+
+    private:
+        friend class concurrent_soa_map;
+
+        snapshot( detail::reader_slot* slot, const map_type* map );
+        snapshot( const snapshot& ) = delete;
+        snapshot& operator=( const snapshot& ) = delete;
+
+        detail::reader_slot* slot_;
+        const map_type* map_;
+    };
+
+    // A reader slot, to be used by one thread. It may hold one snapshot at a time.
+    class reader
+    {
+    public:
+        reader( reader&& other );
+        ~reader();
+
+        snapshot read() const;
+
+    private:
+        friend class concurrent_soa_map;
+
+        reader( const concurrent_soa_map* owner, detail::reader_slot* slot );
+        reader( const reader& ) = delete;
+        reader& operator=( const reader& ) = delete;
+
+        const concurrent_soa_map* owner_;
+        detail::reader_slot* slot_;
+    };
+
+    explicit concurrent_soa_map( size_t maxReaders = default_max_readers );
+    explicit concurrent_soa_map( map_type initial, size_t maxReaders = default_max_readers );
+
+    // Every reader must be gone.
+    ~concurrent_soa_map();
+
+    // Claims a free reader slot. Throws std::length_error when all maxReaders slots are taken.
+    reader make_reader() const;
+
+    template< class InputIterator >
+    void insert( InputIterator first, InputIterator last );
+
+    template< class InputIterator >
+    size_t erase_sorted( InputIterator first, InputIterator last );
+
+    // Calls function( map_type& ) on a copy of the current version and publishes the copy.
+    template< class Function >
+    void update( Function function );
+
+    // Publishes next as the new version.
+    void publish( map_type next );
+
+    // Deletes the retired versions no reader can reach any more. Updates do it as well.
+    void reclaim();
+
+    // Retired versions not deleted yet.
+    size_t retired() const;
+
+private:
+    typedef std::pair< const map_type*, uint64_t > retired_version;
+
+    concurrent_soa_map( const concurrent_soa_map& ) = delete;
+    concurrent_soa_map& operator=( const concurrent_soa_map& ) = delete;
+
+    void install( map_type* next );
+    void reclaim_retired();
+
+    std::unique_ptr< detail::reader_slot[] > slots_;
+    size_t max_readers_;
+    std::atomic< const map_type* > current_;
+    std::atomic< uint64_t > epoch_;
+
+    mutable std::mutex writer_mutex_;
+    std::vector< retired_version > retired_;
+};
+
+}
+
+#include "concurrent_soa_map-impl.h"
+
+#endif // CCPPBRASIL_CONCURRENTSOAMAP_H
@@ -20,13 +20,37 @@
 * THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <map>
+#include <mutex>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
-#include <boost/timer/timer.hpp>
 #include <boost/container/flat_map.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
 
 #include "soa_map.h"
+#include "soa_arena.h"
+#include "buffered_soa_map.h"
+#include "concurrent_soa_map.h"
+#include "sharded_soa_map.h"
+#include "soa_benchmark.h"
+#include "soa_btree_map.h"
+#include "soa_kernels.h"
+#include "soa_map_builder.h"
+#include "soa_search.h"
+#include "soa_unordered_map.h"
+#include "soa_vector.h"
+#include "soa_workload.h"
 
 template< class MapType >
 void forwardFill( MapType& ret_map, size_t size )
@@ -46,6 +70,34 @@ void reverseFill( MapType& ret_map, size_t size )
     }
 }
 
+std::vector< std::pair< size_t, size_t > > forwardPairs( size_t size )
+{
+    std::vector< std::pair< size_t, size_t > > pairs;
+    pairs.reserve( size );
+    for( size_t i = 0; i < size; ++i )
+    {
+        pairs.push_back( std::make_pair( i, i ) );
+    }
+    return pairs;
+}
+
+std::vector< std::pair< size_t, size_t > > reversePairs( size_t size )
+{
+    std::vector< std::pair< size_t, size_t > > pairs;
+    pairs.reserve( size );
+    for( size_t i = 0; i < size; ++i )
+    {
+        pairs.push_back( std::make_pair( size - i, i ) );
+    }
+    return pairs;
+}
+
+template< class MapType >
+void bulkFill( MapType& ret_map, const std::vector< std::pair< size_t, size_t > >& pairs )
+{
+    ret_map.insert( pairs.begin(), pairs.end() );
+}
+
 template< class MapType >
 void forwardFind( MapType& ret_map, size_t size )
 {
@@ -60,6 +112,56 @@ void forwardFind( MapType& ret_map, size_t size )
     }
 }
 
+template< class MapType >
+void forwardFindBatch( MapType& ret_map, size_t size )
+{
+    const size_t batchSize = 256;
+    std::vector< size_t > keys( batchSize );
+    std::vector< size_t > indices( batchSize );
+    for( size_t i = 0; i < size; i += batchSize )
+    {
+        size_t count = std::min( batchSize, size - i );
+        for( size_t j = 0; j < count; ++j )
+        {
+            keys[ j ] = i + j;
+        }
+        ret_map.lower_bound_batch( keys.begin(), keys.begin() + count, indices.begin() );
+        for( size_t j = 0; j < count; ++j )
+        {
+            if( ret_map.size() == indices[ j ] )
+            {
+                std::cout << "ffb Oops! " << i + j << std::endl;
+            }
+        }
+    }
+}
+
+struct missCounter
+{
+    size_t end;
+    size_t* misses;
+    void operator()( size_t idx ) const
+    {
+        if( end == idx )
+        {
+            ++*misses;
+        }
+    }
+};
+
+template< class MapType >
+void forwardFindSorted( MapType& ret_map, size_t size )
+{
+    size_t misses = 0;
+    missCounter counter = { ret_map.size(), &misses };
+    ret_map.lower_bound_sorted( boost::counting_iterator< size_t >( 0 ), boost::counting_iterator< size_t >( size ),
+                                boost::make_function_output_iterator( counter ) );
+    if( misses != 0 )
+    {
+        std::cout << "ffs Oops! " << misses << std::endl;
+    }
+}
+
 template< class MapType >
 void reverseFind( MapType& ret_map, size_t size )
 {
@@ -74,50 +176,805 @@ void reverseFind( MapType& ret_map, size_t size )
     }
 }
 
-template< class T_XY >
-void least_square( const std::string& name )
+// Exact match lookups, for the unordered maps and the point lookup comparison.
+template< class MapType >
+void forwardFindKey( MapType& ret_map, size_t size )
 {
-    T_XY xy;
+    auto itEnd = ret_map.end();
+    for( size_t i = 0; i < size; ++i )
+    {
+        auto it = ret_map.find( i );
+        if( itEnd == it )
+        {
+            std::cout << "ffk Oops! " << i << std::endl;
+        }
+    }
+}
+
+template< class MapType >
+void reverseFindKey( MapType& ret_map, size_t size )
+{
+    auto itEnd = ret_map.end();
+    for( size_t i = 0; i < size; ++i )
+    {
+        auto it = ret_map.find( size - i );
+        if( itEnd == it )
+        {
+            std::cout << "rewk Oops! " << i << std::endl;
+        }
+    }
+}
+
+// Sorted unique keys: "sequential" 0 to size - 1, "uniform" random 64 bit keys, "skewed" a
+// lognormal distribution, dense near zero with a long tail.
+std::vector< size_t > distributionKeys( const std::string& distribution, size_t size )
+{
+    std::mt19937_64 rng( 1 );
+    std::lognormal_distribution< double > skewed( 0., 2. );
+    std::vector< size_t > keys( size );
+    for( size_t i = 0; i < size; ++i )
+    {
+        keys[ i ] = ( distribution == "sequential" ) ? i :
+                    ( distribution == "uniform" ) ? static_cast< size_t >( rng() ) :
+                    static_cast< size_t >( skewed( rng ) * 1e9 );
+    }
+    std::sort( keys.begin(), keys.end() );
+    keys.erase( std::unique( keys.begin(), keys.end() ), keys.end() );
+    return keys;
+}
+
+template< class MapType >
+void keysFind( MapType& ret_map, const std::vector< size_t >& keys )
+{
+    auto itEnd = ret_map.end();
+    for( size_t i = 0; i < keys.size(); ++i )
+    {
+        auto it = ret_map.find( keys[ i ] );
+        if( itEnd == it )
+        {
+            std::cout << "kf Oops! " << keys[ i ] << std::endl;
+        }
+    }
+}
+
+// Maps without reserve() just skip it; buffered maps apply their pending inserts in finishFill().
+template< class MapType >
+void reserveMap( MapType& ret_map, size_t size )
+{
+    ret_map.reserve( size );
+}
+
+void reserveMap( std::map< size_t, size_t >&, size_t )
+{
+}
+
+template< class MapType >
+void finishFill( MapType& )
+{
+}
+
+void finishFill( ccppbrasil::buffered_soa_map< size_t, size_t >& ret_map )
+{
+    ret_map.flush();
+}
+
+// soa_map counting its operations, run next to the plain one to weigh the cost of soa_stats.
+typedef ccppbrasil::soa_map< size_t, size_t, std::less< size_t >, std::allocator< size_t >, std::allocator< size_t >,
+                             ccppbrasil::soa_stats > stats_soa_map;
+
+// Only maps with soa_stats report anything: what the timed region did, as counters of the case.
+template< class MapType >
+void resetStats( MapType& )
+{
+}
+
+void resetStats( stats_soa_map& ret_map )
+{
+    ret_map.stats().reset();
+}
+
+template< class MapType >
+void reportStats( ccppbrasil::benchmark_state&, MapType& )
+{
+}
+
+void reportStats( ccppbrasil::benchmark_state& state, stats_soa_map& ret_map )
+{
+    ccppbrasil::soa_stats_snapshot stats = ret_map.stats().take();
+    state.counter( "finds", static_cast< double >( stats.finds ) );
+    state.counter( "find_misses", static_cast< double >( stats.find_misses ) );
+    state.counter( "inserts", static_cast< double >( stats.inserts ) );
+    state.counter( "shifted", static_cast< double >( stats.shifted ) );
+    state.counter( "reallocations", static_cast< double >( stats.reallocations ) );
+    if( stats.finds )
+    {
+        state.counter( "find_p50_ns", static_cast< double >( stats.find_latency.value_at_percentile( 50. ) ) );
+        state.counter( "find_p99_ns", static_cast< double >( stats.find_latency.value_at_percentile( 99. ) ) );
+    }
+    if( stats.inserts )
+    {
+        state.counter( "insert_p99_ns", static_cast< double >( stats.insert_latency.value_at_percentile( 99. ) ) );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Container cases
+//-------------------------------------------------------------------------------------------------
+template< class MapType >
+void fillCase( ccppbrasil::benchmark_state& state, size_t size, bool reverse )
+{
+    state.set_items( size );
+    while( state.next_repetition() )
+    {
+        MapType ret_map;
+        reserveMap( ret_map, size );
+        resetStats( ret_map );
+        state.measure( [ & ]()
+        {
+            if( reverse )
+            {
+                reverseFill( ret_map, size );
+            }
+            else
+            {
+                forwardFill( ret_map, size );
+            }
+            finishFill( ret_map );
+        } );
+        reportStats( state, ret_map );
+    }
+}
+
+// find is one of the forward or reverse lookups above, over a map filled the same way.
+template< class MapType >
+void findCase( ccppbrasil::benchmark_state& state, size_t size, bool reverse, void ( *find )( MapType&, size_t ) )
+{
+    MapType ret_map;
+    reserveMap( ret_map, size );
+    if( reverse )
+    {
+        reverseFill( ret_map, size );
+    }
+    else
+    {
+        forwardFill( ret_map, size );
+    }
+    resetStats( ret_map );
+
+    state.set_items( size );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]() { find( ret_map, size ); } );
+        reportStats( state, ret_map );
+    }
+}
+
+template< class MapType >
+void addMapCases( ccppbrasil::benchmark_suite& suite, const std::string& container, size_t ffsize, size_t rewsize,
+                  void ( *ffind )( MapType&, size_t ), void ( *rewfind )( MapType&, size_t ) )
+{
+    std::string ff = "/forward/" + std::to_string( ffsize );
+    std::string rew = "/reverse/" + std::to_string( rewsize );
+    suite.add( "fill/" + container + ff, [ = ]( ccppbrasil::benchmark_state& state ) { fillCase< MapType >( state, ffsize, false ); } );
+    suite.add( "find/" + container + ff, [ = ]( ccppbrasil::benchmark_state& state ) { findCase( state, ffsize, false, ffind ); } );
+    suite.add( "fill/" + container + rew, [ = ]( ccppbrasil::benchmark_state& state ) { fillCase< MapType >( state, rewsize, true ); } );
+    suite.add( "find/" + container + rew, [ = ]( ccppbrasil::benchmark_state& state ) { findCase( state, rewsize, true, rewfind ); } );
+}
+
+//-------------------------------------------------------------------------------------------------
+const char* layoutName( ccppbrasil::soa_layout layout )
+{
+    const char* names[] = { "sorted", "eytzinger", "compressed", "learned" };
+    return names[ static_cast< int >( layout ) ];
+}
+
+// Forward lookups of 0 to size - 1 on a frozen search layout.
+void layoutFindCase( ccppbrasil::benchmark_state& state, size_t size, ccppbrasil::soa_layout layout )
+{
+    ccppbrasil::soa_map<size_t, size_t> soa_map1;
+    soa_map1.reserve( size );
+    forwardFill( soa_map1, size );
+    soa_map1.freeze( layout );
+
+    state.set_items( size );
+    state.counter( "layout_bytes", static_cast< double >( soa_map1.layout_bytes() ) );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]() { forwardFind( soa_map1, size ); } );
+    }
+}
+
+// Keys of a distribution, looked up in random order.
+void layoutDistributionCase( ccppbrasil::benchmark_state& state, const std::string& distribution, size_t size,
+                             ccppbrasil::soa_layout layout )
+{
+    std::vector< size_t > keys = distributionKeys( distribution, size );
+    std::vector< std::pair< size_t, size_t > > pairs;
+    pairs.reserve( keys.size() );
+    for( size_t i = 0; i < keys.size(); ++i )
+    {
+        pairs.push_back( std::make_pair( keys[ i ], i ) );
+    }
+    ccppbrasil::soa_map<size_t, size_t> soa_map1;
+    bulkFill( soa_map1, pairs );
+    if( layout != ccppbrasil::soa_layout::sorted )
+    {
+        soa_map1.freeze( layout );
+    }
+    std::shuffle( keys.begin(), keys.end(), std::mt19937_64( 2 ) );
+
+    state.set_items( keys.size() );
+    state.counter( "layout_bytes", static_cast< double >( soa_map1.layout_bytes() ) );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]() { keysFind( soa_map1, keys ); } );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+void findBatchCase( ccppbrasil::benchmark_state& state, size_t size, bool sorted )
+{
+    ccppbrasil::soa_map<size_t, size_t> soa_map1;
+    soa_map1.reserve( size );
+    forwardFill( soa_map1, size );
+
+    state.set_items( size );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]()
+        {
+            if( sorted )
+            {
+                forwardFindSorted( soa_map1, size );
+            }
+            else
+            {
+                forwardFindBatch( soa_map1, size );
+            }
+        } );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Readers scaling while a writer publishes batches of 1000 keys every 10ms.
+void concurrentFindCase( ccppbrasil::benchmark_state& state, size_t size, size_t threads )
+{
+    ccppbrasil::concurrent_soa_map<size_t, size_t> concurrent_map;
+    auto rpairs = forwardPairs( size );
+    concurrent_map.insert( rpairs.begin(), rpairs.end() );
+    size_t next = size;
+
+    state.set_items( threads * size );
+    while( state.next_repetition() )
+    {
+        std::atomic< bool > done( false );
+        std::thread writer( [ & ]()
+        {
+            while( !done )
+            {
+                auto batch = forwardPairs( 1000 );
+                for( auto& pair : batch )
+                {
+                    pair.first = pair.second = next++;
+                }
+                concurrent_map.insert( batch.begin(), batch.end() );
+                std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            }
+        } );
+
+        state.measure( [ & ]()
+        {
+            std::vector< std::thread > readers;
+            for( size_t t = 0; t < threads; ++t )
+            {
+                readers.emplace_back( [ & ]()
+                {
+                    auto reader = concurrent_map.make_reader();
+                    for( size_t i = 0; i < size; ++i )
+                    {
+                        auto snapshot = reader.read();
+                        if( snapshot->end() == snapshot->find( i ) )
+                        {
+                            std::cout << "cf Oops! " << i << std::endl;
+                        }
+                    }
+                } );
+            }
+            for( auto& reader : readers )
+            {
+                reader.join();
+            }
+        } );
+        done = true;
+        writer.join();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// One writer thread per key range, on a sharded_soa_map or on a soa_map behind one mutex.
+void parallelFillCase( ccppbrasil::benchmark_state& state, size_t size, size_t threads, bool sharded )
+{
+    size_t perThread = size / threads;
+    std::vector< size_t > splits;
+    for( size_t t = 1; t < threads; ++t )
+    {
+        splits.push_back( t * perThread );
+    }
+
+    state.set_items( threads * perThread );
+    while( state.next_repetition() )
+    {
+        ccppbrasil::sharded_soa_map<size_t, size_t> sharded_map( splits );
+        ccppbrasil::soa_map<size_t, size_t> locked_map;
+        std::mutex locked_map_mutex;
+        state.measure( [ & ]()
+        {
+            std::vector< std::thread > writers;
+            for( size_t t = 0; t < threads; ++t )
+            {
+                writers.emplace_back( [ &, t ]()
+                {
+                    for( size_t j = 0; j < perThread; ++j )
+                    {
+                        if( sharded )
+                        {
+                            sharded_map.insert( std::make_pair( t * perThread + j, j ) );
+                        }
+                        else
+                        {
+                            std::lock_guard< std::mutex > lock( locked_map_mutex );
+                            locked_map.insert( std::make_pair( t * perThread + j, j ) );
+                        }
+                    }
+                } );
+            }
+            for( auto& writer : writers )
+            {
+                writer.join();
+            }
+        } );
+    }
+}
+
+// Each repetition piles every key into the last shard of a 4 shard map, untimed, then times
+// rebalance() and a scan across the shards.
+void rebalanceCase( ccppbrasil::benchmark_state& state, size_t size )
+{
+    const size_t shards = 4;
+    std::vector< size_t > splits;
+    for( size_t s = 1; s < shards; ++s )
+    {
+        splits.push_back( s );
+    }
+    ccppbrasil::sharded_soa_map<size_t, size_t> sharded_map( splits );
+    std::vector< std::pair< size_t, size_t > > pairs;
+    pairs.reserve( size );
+    for( size_t i = 0; i < size; ++i )
+    {
+        pairs.push_back( std::make_pair( shards + i, i ) );
+    }
+    sharded_map.insert( pairs.begin(), pairs.end() );
+
+    state.set_items( size );
+    while( state.next_repetition() )
+    {
+        sharded_map.rebalance( splits );
+        state.measure( [ & ]()
+        {
+            sharded_map.rebalance();
+            size_t sum = 0;
+            for( auto it = sharded_map.begin(); it != sharded_map.end(); ++it )
+            {
+                sum += it.value();
+            }
+            if( sum != size * ( size - 1 ) / 2 )
+            {
+                std::cout << "rebalance Oops! " << sum << std::endl;
+            }
+            state.keep( static_cast< double >( sum ) );
+        } );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Workloads
+//-------------------------------------------------------------------------------------------------
+template< class Iterator >
+auto iteratorKey( const Iterator& it, int ) -> decltype( it.key() )
+{
+    return it.key();
+}
+
+template< class Iterator >
+auto iteratorKey( const Iterator& it, long ) -> decltype( it->first )
+{
+    return it->first;
+}
 
+// Sum of the keys of up to length rows from lower_bound( key ).
+template< class MapType >
+size_t scanRange( MapType& ret_map, size_t key, size_t length )
+{
+    size_t sum = 0;
+    auto itEnd = ret_map.end();
+    auto it = ret_map.lower_bound( key );
+    for( size_t i = 0; i < length && it != itEnd; ++i, ++it )
+    {
+        sum += iteratorKey( it, 0 );
+    }
+    return sum;
+}
+
+// Hash maps have no order to scan, the scan workloads are not registered for them.
+size_t scanRange( ccppbrasil::soa_unordered_map< size_t, size_t >&, size_t, size_t )
+{
+    throw std::logic_error( "scanRange: soa_unordered_map has no key order" );
+}
+
+// Loads the workload keys untimed, in key order so the sorted maps just append, then replays
+// its operations.
+template< class MapType >
+void workloadCase( ccppbrasil::benchmark_state& state, char ycsb, ccppbrasil::key_distribution distribution,
+                   size_t records, size_t operations, uint64_t seed )
+{
+    const ccppbrasil::workload work =
+        ccppbrasil::make_workload( distribution, ccppbrasil::workload_mix::ycsb( ycsb ), records, operations, seed );
+    std::vector< std::pair< size_t, size_t > > loadPairs;
+    loadPairs.reserve( work.load_keys.size() );
+    for( size_t i = 0; i < work.load_keys.size(); ++i )
+    {
+        loadPairs.push_back( std::make_pair( work.load_keys[ i ], i ) );
+    }
+    std::sort( loadPairs.begin(), loadPairs.end() );
+
+    state.set_items( work.steps.size() );
+    while( state.next_repetition() )
+    {
+        MapType ret_map;
+        reserveMap( ret_map, loadPairs.size() + operations );
+        for( const auto& pair : loadPairs )
+        {
+            ret_map.insert( pair );
+        }
+        resetStats( ret_map );
+
+        size_t checksum = 0;
+        state.measure( [ & ]()
+        {
+            for( size_t i = 0; i < work.steps.size(); ++i )
+            {
+                const ccppbrasil::workload_step& step = work.steps[ i ];
+                switch( step.op )
+                {
+                case ccppbrasil::workload_op::find:
+                    if( ret_map.end() == ret_map.find( step.key ) )
+                    {
+                        std::cout << "wf Oops! " << step.key << std::endl;
+                    }
+                    break;
+                case ccppbrasil::workload_op::update:
+                    ret_map.at( step.key ) = i;
+                    break;
+                case ccppbrasil::workload_op::insert:
+                    ret_map.insert( std::make_pair( step.key, i ) );
+                    break;
+                case ccppbrasil::workload_op::scan:
+                    checksum += scanRange( ret_map, step.key, step.length );
+                    break;
+                }
+            }
+        } );
+        state.keep( static_cast< double >( checksum ) );
+        reportStats( state, ret_map );
+    }
+}
+
+// YCSB mixes, each on the distribution it is usually run with: 'd' reads the latest inserts of
+// a time series. Case names are ycsb_<mix>/container/distribution/records.
+template< class MapType >
+void addWorkloadCases( ccppbrasil::benchmark_suite& suite, const std::string& container, size_t records, size_t operations,
+                       uint64_t seed, bool ordered )
+{
+    struct
+    {
+        char ycsb;
+        ccppbrasil::key_distribution distribution;
+    } workloads[] = {
+        { 'a', ccppbrasil::key_distribution::zipfian },
+        { 'b', ccppbrasil::key_distribution::zipfian },
+        { 'c', ccppbrasil::key_distribution::uniform },
+        { 'c', ccppbrasil::key_distribution::zipfian },
+        { 'c', ccppbrasil::key_distribution::clustered },
+        { 'd', ccppbrasil::key_distribution::time_series },
+        { 'e', ccppbrasil::key_distribution::zipfian },
+        { 'e', ccppbrasil::key_distribution::clustered } };
+
+    for( const auto& w : workloads )
+    {
+        if( w.ycsb == 'e' && !ordered )
+        {
+            continue;
+        }
+        char ycsb = w.ycsb;
+        ccppbrasil::key_distribution distribution = w.distribution;
+        suite.add( std::string( "ycsb_" ) + ycsb + "/" + container + "/" + ccppbrasil::distribution_name( distribution ) + "/" +
+                   std::to_string( records ),
+                   [ = ]( ccppbrasil::benchmark_state& state )
+                   { workloadCase< MapType >( state, ycsb, distribution, records, operations, seed ); } );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Bulk loads
+//-------------------------------------------------------------------------------------------------
+void bulkFillCase( ccppbrasil::benchmark_state& state, size_t size, bool reverse, bool parallel )
+{
+    auto pairs = reverse ? reversePairs( size ) : forwardPairs( size );
+    ccppbrasil::thread_pool& pool = ccppbrasil::default_thread_pool();
+
+    state.set_items( size );
+    state.counter( "threads", static_cast< double >( parallel ? pool.concurrency() : 1 ) );
+    while( state.next_repetition() )
+    {
+        ccppbrasil::soa_map<size_t, size_t> soa_map3;
+        state.measure( [ & ]()
+        {
+            if( parallel )
+            {
+                soa_map3.insert( pairs.begin(), pairs.end(), pool );
+            }
+            else
+            {
+                bulkFill( soa_map3, pairs );
+            }
+        } );
+    }
+}
+
+void sortedUniqueLoadCase( ccppbrasil::benchmark_state& state, size_t size )
+{
+    state.set_items( size );
+    while( state.next_repetition() )
+    {
+        std::vector< size_t > keys;
+        std::vector< size_t > values;
+        keys.reserve( size );
+        values.reserve( size );
+        for( size_t j = 0; j < size; ++j )
+        {
+            keys.push_back( j );
+            values.push_back( j );
+        }
+        ccppbrasil::soa_map<size_t, size_t> soa_map5;
+        state.measure( [ & ]()
+        {
+            soa_map5 = ccppbrasil::soa_map<size_t, size_t>::from_sorted_unique( std::move( keys ), std::move( values ) );
+        } );
+    }
+}
+
+// Maps the snapshot and looks up every 1000th key in place.
+void snapshotOpenCase( ccppbrasil::benchmark_state& state, size_t size )
+{
+    {
+        ccppbrasil::soa_map<size_t, size_t> soa_map6;
+        bulkFill( soa_map6, forwardPairs( size ) );
+        soa_map6.save( "soa_map.snapshot" );
+    }
+
+    state.set_items( ( size + 999 ) / 1000 );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]()
+        {
+            const auto mapped = ccppbrasil::soa_map<size_t, size_t>::open_mapped( "soa_map.snapshot" );
+            size_t hits = 0;
+            for( size_t j = 0; j < size; j += 1000 )
+            {
+                hits += mapped.at( j ) == j ? 1 : 0;
+            }
+            state.keep( static_cast< double >( hits ) );
+        } );
+    }
+    std::remove( "soa_map.snapshot" );
+}
+
+void externalBuildCase( ccppbrasil::benchmark_state& state, size_t size )
+{
+    auto rewpairs = reversePairs( size );
+    state.set_items( size );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]()
+        {
+            ccppbrasil::soa_map_builder<size_t, size_t> builder( "soa_map.snapshot", 64 * 1024 * 1024 );
+            builder.insert( rewpairs.begin(), rewpairs.end() );
+            state.keep( static_cast< double >( builder.finish() ) );
+        } );
+        std::remove( "soa_map.snapshot" );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Allocators
+//-------------------------------------------------------------------------------------------------
+typedef ccppbrasil::soa_map< size_t, size_t, std::less< size_t >, ccppbrasil::arena_allocator< size_t >,
+                             ccppbrasil::arena_allocator< size_t > > arena_soa_map;
+typedef ccppbrasil::soa_map< size_t, size_t, std::less< size_t >, ccppbrasil::pool_allocator< size_t >,
+                             ccppbrasil::pool_allocator< size_t > > pool_soa_map;
+typedef std::map< size_t, size_t, std::less< size_t >, ccppbrasil::pool_allocator< std::pair< const size_t, size_t > > > pool_std_map;
+
+void releaseNothing()
+{
+}
+
+// Frees the thread's default arena in one go, once the map using it is gone.
+void releaseArena()
+{
+    ccppbrasil::soa_arena::current().release();
+}
+
+// Creates, fills and destroys a small map maps times, calling release() after each one: the
+// short-lived map pattern where malloc and free dominate.
+template< class MapType >
+void churnCase( ccppbrasil::benchmark_state& state, size_t maps, size_t size, void ( *release )() )
+{
+    state.set_items( maps * size );
+    while( state.next_repetition() )
+    {
+        size_t checksum = 0;
+        state.measure( [ & ]()
+        {
+            for( size_t m = 0; m < maps; ++m )
+            {
+                {
+                    MapType ret_map;
+                    forwardFill( ret_map, size );
+                    checksum += ret_map.size();
+                }
+                release();
+            }
+        } );
+        state.keep( static_cast< double >( checksum ) );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Column layouts
+//-------------------------------------------------------------------------------------------------
+template< class T_XY >
+void fillXY( T_XY& xy, size_t size )
+{
     srand( 1 );
 
-    size_t size = 512 * 1024 * 1024;
     xy.reserve( size );
     for( size_t i = 0; i < size; ++i )
     {
-        xy.push_back( i + ( 2.f * rand() - RAND_MAX / 2.f ) / RAND_MAX,
+        xy.emplace_back( i + ( 2.f * rand() - RAND_MAX / 2.f ) / RAND_MAX,
             i + ( 4.f * rand() - RAND_MAX / 2.f ) / RAND_MAX );
     }
+}
 
-    boost::timer::cpu_timer timer;
+template< class T_XY >
+void least_square( ccppbrasil::benchmark_state& state, size_t size )
+{
+    T_XY xy;
+    fillXY( xy, size );
 
-    timer.start();
-    float meanx = 0;
-    float meany = 0;
-    for( size_t i = 0; i < size; ++i )
+    state.set_items( size );
+    while( state.next_repetition() )
     {
-        meanx += xy.get_x( i );
-        meany += xy.get_y( i );
+        state.measure( [ & ]()
+        {
+            float meanx = 0;
+            float meany = 0;
+            for( size_t i = 0; i < size; ++i )
+            {
+                const auto& row = xy[ i ];
+                meanx += std::get< 0 >( row );
+                meany += std::get< 1 >( row );
+            }
+
+            meanx /= size;
+            meany /= size;
+
+            float numerator = 0;
+            float denominator = 0;
+            for( size_t i = 0; i < size; ++i )
+            {
+                const auto& row = xy[ i ];
+                float diffx = ( std::get< 0 >( row ) - meanx );
+                numerator += diffx * ( std::get< 1 >( row ) - meany );
+                denominator += diffx * diffx;
+            }
+
+            float b = numerator / denominator;
+            float a = meany - b * meanx;
+            state.keep( a + b );
+            state.counter( "a", a );
+            state.counter( "b", b );
+        } );
     }
+}
 
-    meanx /= size;
-    meany /= size;
+// Same regression as least_square on soa_vector, each pass a parallel reduction over the columns.
+void least_square_parallel( ccppbrasil::benchmark_state& state, size_t size )
+{
+    ccppbrasil::soa_vector< float, float > xy;
+    fillXY( xy, size );
 
-    float numerator = 0;
-    float denominator = 0;
-    for( size_t i = 0; i < size; ++i )
+    ccppbrasil::thread_pool& pool = ccppbrasil::default_thread_pool();
+    state.set_items( size );
+    state.counter( "threads", static_cast< double >( pool.concurrency() ) );
+    while( state.next_repetition() )
     {
-        float diffx = ( xy.get_x( i ) - meanx );
-        numerator += diffx * ( xy.get_y( i ) - meany );
-        denominator += diffx * diffx;
+        state.measure( [ & ]()
+        {
+            auto sum = []( float a, float b ) { return a + b; };
+            float meanx = ccppbrasil::parallel_reduce( xy.column< 0 >(), 0.f, sum, pool ) / size;
+            float meany = ccppbrasil::parallel_reduce( xy.column< 1 >(), 0.f, sum, pool ) / size;
+
+            const float* x = xy.data< 0 >();
+            const float* y = xy.data< 1 >();
+            auto sums = ccppbrasil::parallel_reduce_rows( size, 64 * 1024, std::make_pair( 0.f, 0.f ),
+                [ x, y, meanx, meany ]( size_t first, size_t last )
+                {
+                    float numerator = 0;
+                    float denominator = 0;
+                    for( size_t i = first; i < last; ++i )
+                    {
+                        float diffx = ( x[ i ] - meanx );
+                        numerator += diffx * ( y[ i ] - meany );
+                        denominator += diffx * diffx;
+                    }
+                    return std::make_pair( numerator, denominator );
+                },
+                []( const std::pair< float, float >& a, const std::pair< float, float >& b )
+                {
+                    return std::make_pair( a.first + b.first, a.second + b.second );
+                },
+                pool );
+
+            float b = sums.first / sums.second;
+            float a = meany - b * meanx;
+            state.keep( a + b );
+            state.counter( "a", a );
+            state.counter( "b", b );
+        } );
     }
+}
+
+// least_square on soa_vector with the column kernels: the means are vector sums, the columns are
+// centered in place and the slope is a ratio of dot products. The columns are restored untimed.
+void least_square_kernels( ccppbrasil::benchmark_state& state, size_t size )
+{
+    ccppbrasil::soa_vector< float, float > xy;
+    fillXY( xy, size );
 
-    float b = numerator / denominator;
-    float a = meany - b * meanx;
-    timer.stop();
+    state.set_items( size );
+    while( state.next_repetition() )
+    {
+        float meanx = 0;
+        float meany = 0;
+        state.measure( [ & ]()
+        {
+            meanx = ccppbrasil::column_sum( xy.column< 0 >() ) / size;
+            meany = ccppbrasil::column_sum( xy.column< 1 >() ) / size;
 
-    std::cout << "Least Square linear regression " << name << ": y = " << a << " + " << b << "x + e : "
-        << timer.format();
+            ccppbrasil::column_transform( xy.column< 0 >(), meanx, xy.column< 0 >(), std::minus< float >() );
+            ccppbrasil::column_transform( xy.column< 1 >(), meany, xy.column< 1 >(), std::minus< float >() );
+            float numerator = ccppbrasil::column_dot( xy.column< 0 >(), xy.column< 1 >() );
+            float denominator = ccppbrasil::column_dot( xy.column< 0 >(), xy.column< 0 >() );
+
+            float b = numerator / denominator;
+            float a = meany - b * meanx;
+            state.keep( a + b );
+            state.counter( "a", a );
+            state.counter( "b", b );
+        } );
+        ccppbrasil::column_transform( xy.column< 0 >(), meanx, xy.column< 0 >(), std::plus< float >() );
+        ccppbrasil::column_transform( xy.column< 1 >(), meany, xy.column< 1 >(), std::plus< float >() );
+    }
 }
 
 struct XYZ
@@ -126,15 +983,14 @@ struct XYZ
     float y;
     XYZ( float x_, float y_ ) : x( x_ ), y( y_ ) {}
 };
-void scale_aos()
+
+// Each repetition adds the two point sets 20000 times.
+void scale_aos( ccppbrasil::benchmark_state& state, size_t size )
 {
     std::vector< XYZ > xyz_a;
     std::vector< XYZ > xyz_b;
     std::vector< XYZ > ret_xyz;
 
-    srand( 1 );
-
-    size_t size = 512 * 1024;
     xyz_a.reserve( size );
     xyz_b.reserve( size );
     for( size_t i = 0; i < size; ++i )
@@ -144,281 +1000,567 @@ void scale_aos()
     }
     ret_xyz.resize( size, { 0.f, 0.f } );
 
-    boost::timer::cpu_timer timer;
-
     XYZ* pxyza = xyz_a.data();
     XYZ* pxyzb = xyz_b.data();
     XYZ* prxyz = ret_xyz.data();
+
+    state.set_items( 20000 * static_cast< uint64_t >( size ) );
+    while( state.next_repetition() )
     {
-        XYZ* mypxyza = pxyza;
-        XYZ* mypxyzb = pxyzb;
-        XYZ* myprxyz = prxyz;
-        for( size_t i = 0; i < size; ++i )
+        state.measure( [ & ]()
         {
-            myprxyz->x = mypxyza->x + mypxyzb->x;
-            myprxyz->y = mypxyza->y + mypxyzb->y;
-            ++mypxyza; ++mypxyzb; ++myprxyz;
-        }
+            for( size_t j = 0; j < 20000; ++j )
+            {
+                XYZ* mypxyza = pxyza;
+                XYZ* mypxyzb = pxyzb;
+                XYZ* myprxyz = prxyz;
+                for( size_t i = 0; i < size; ++i )
+                {
+                    myprxyz->x = mypxyza->x + mypxyzb->x;
+                    myprxyz->y = mypxyza->y + mypxyzb->y;
+                    ++mypxyza; ++mypxyzb; ++myprxyz;
+                }
+            }
+        } );
     }
+    state.keep( prxyz[ size - 1 ].x );
+}
 
-    timer.start();
-    for( size_t j = 0; j < 20000; ++j )
+void fillScaleXY( ccppbrasil::soa_vector< float, float >& xy_a, ccppbrasil::soa_vector< float, float >& xy_b,
+                  ccppbrasil::soa_vector< float, float >& ret_xy, size_t size )
+{
+    xy_a.reserve( size );
+    xy_b.reserve( size );
+    for( size_t i = 0; i < size; ++i )
     {
-        XYZ* mypxyza = pxyza;
-        XYZ* mypxyzb = pxyzb;
-        XYZ* myprxyz = prxyz;
-        for( size_t i = 0; i < size; ++i )
+        xy_a.emplace_back(  static_cast<float>( i ),  static_cast<float>( i ) );
+        xy_b.emplace_back( -static_cast<float>( i ), -static_cast<float>( i ) );
+    }
+    ret_xy.resize( size );
+}
+
+void scale_soa( ccppbrasil::benchmark_state& state, size_t size )
+{
+    ccppbrasil::soa_vector< float, float > xy_a;
+    ccppbrasil::soa_vector< float, float > xy_b;
+    ccppbrasil::soa_vector< float, float > ret_xy;
+    fillScaleXY( xy_a, xy_b, ret_xy, size );
+
+    const float *pxa = xy_a.data< 0 >();
+    const float *pya = xy_a.data< 1 >();
+    const float *pxb = xy_b.data< 0 >();
+    const float *pyb = xy_b.data< 1 >();
+    float *prx = ret_xy.data< 0 >();
+    float *pry = ret_xy.data< 1 >();
+
+    state.set_items( 20000 * static_cast< uint64_t >( size ) );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]()
         {
-            myprxyz->x = mypxyza->x + mypxyzb->x;
-            myprxyz->y = mypxyza->y + mypxyzb->y;
-            ++mypxyza; ++mypxyzb; ++myprxyz;
-        }
+            for( size_t j = 0; j < 20000; ++j )
+            {
+                const float *mypxa = pxa;
+                const float *mypya = pya;
+                const float *mypxb = pxb;
+                const float *mypyb = pyb;
+                float *myprx = prx;
+                float *mypry = pry;
+                for( size_t i = 0; i < size; ++i )
+                {
+                    *myprx = *mypxa + *mypxb;
+                    *mypry = *mypya + *mypyb;
+                    ++mypxa; ++mypxb; ++myprx;
+                    ++mypya; ++mypyb; ++mypry;
+                }
+            }
+        } );
     }
-    timer.stop();
+    state.keep( prx[ size - 1 ] + pry[ size - 1 ] );
+}
 
-    std::cout << "scale " << size << " points aos: " << timer.format();
+void scale_soa_kernels( ccppbrasil::benchmark_state& state, size_t size )
+{
+    ccppbrasil::soa_vector< float, float > xy_a;
+    ccppbrasil::soa_vector< float, float > xy_b;
+    ccppbrasil::soa_vector< float, float > ret_xy;
+    fillScaleXY( xy_a, xy_b, ret_xy, size );
+
+    state.set_items( 20000 * static_cast< uint64_t >( size ) );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]()
+        {
+            for( size_t j = 0; j < 20000; ++j )
+            {
+                ccppbrasil::column_transform( xy_a.column< 0 >(), xy_b.column< 0 >(), ret_xy.column< 0 >(), std::plus< float >() );
+                ccppbrasil::column_transform( xy_a.column< 1 >(), xy_b.column< 1 >(), ret_xy.column< 1 >(), std::plus< float >() );
+            }
+        } );
+    }
+    state.keep( ret_xy.data< 0 >()[ size - 1 ] + ret_xy.data< 1 >()[ size - 1 ] );
 }
 
-void scale_soa()
+struct Record
 {
-    std::vector< float > x_a;
-    std::vector< float > y_a;
-    std::vector< float > x_b;
-    std::vector< float > y_b;
-    std::vector< float > ret_x;
-    std::vector< float > ret_y;
+    float a;
+    float b;
+    float c;
+    float d;
+    float e;
+    float f;
+};
 
-    srand( 1 );
+// Each repetition sums field a of every record 20 times.
+void column_scan_aos( ccppbrasil::benchmark_state& state, size_t size )
+{
+    boost::container::flat_map< size_t, Record > records;
 
-    size_t size = 512 * 1024;
-    x_a.reserve( size );
-    y_a.reserve( size );
-    x_b.reserve( size );
-    y_b.reserve( size );
+    records.reserve( size );
     for( size_t i = 0; i < size; ++i )
     {
-        x_a.push_back(  static_cast<float>( i ) );
-        y_a.push_back(  static_cast<float>( i ) );
-        x_b.push_back( -static_cast<float>( i ) );
-        y_b.push_back( -static_cast<float>( i ) );
-    }
-    ret_x.resize( size, 0.f );
-    ret_y.resize( size, 0. );
-
-    boost::timer::cpu_timer timer;
-
-    float *pxa = x_a.data();
-    float *pya = y_a.data();
-    float *pxb = x_b.data();
-    float *pyb = y_b.data();
-    float *prx = ret_x.data();
-    float *pry = ret_y.data();
-    {
-        float *mypxa = pxa;
-        float *mypya = pya;
-        float *mypxb = pxb;
-        float *mypyb = pyb;
-        float *myprx = prx;
-        float *mypry = pry;
-        for( size_t i = 0; i < size; ++i )
-        {
-            *myprx = *mypxa + *mypxb;
-            *mypry = *mypya + *mypyb;
-            ++mypxa; ++mypxb; ++myprx;
-            ++mypya; ++mypyb; ++mypry;
-        }
+        Record record = { static_cast<float>( i ), 0.f, 0.f, 0.f, 0.f, 0.f };
+        records.emplace_hint( records.end(), i, record );
     }
-    timer.start();
-    for( size_t j = 0; j < 20000; ++j )
-    {
-        float *mypxa = pxa;
-        float *mypya = pya;
-        float *mypxb = pxb;
-        float *mypyb = pyb;
-        float *myprx = prx;
-        float *mypry = pry;
-        for( size_t i = 0; i < size; ++i )
-        {
-            *myprx = *mypxa + *mypxb;
-            *mypry = *mypya + *mypyb;
-            ++mypxa; ++mypxb; ++myprx;
-            ++mypya; ++mypyb; ++mypry;
-        }
-    }
-    timer.stop();
 
-    std::cout << "scale " << size << " points soa: " << timer.format();
+    state.set_items( 20 * static_cast< uint64_t >( size ) );
+    while( state.next_repetition() )
+    {
+        state.measure( [ & ]()
+        {
+            float sum = 0;
+            for( size_t j = 0; j < 20; ++j )
+            {
+                for( const auto& record : records )
+                {
+                    sum += record.second.a;
+                }
+            }
+            state.keep( sum );
+        } );
+    }
 }
 
-namespace ccppbrasil {
+typedef ccppbrasil::soa_columns< float, float, float, float, float, float > record_columns;
 
-class XY_aos
+void fillRecords( ccppbrasil::soa_map< size_t, record_columns >& records, size_t size )
 {
-public:
-    void reserve( size_t size )
+    records.reserve( size );
+    for( size_t i = 0; i < size; ++i )
     {
-        xy_.reserve( size );
+        records.emplace( size_t( i ), record_columns( static_cast<float>( i ), 0.f, 0.f, 0.f, 0.f, 0.f ) );
     }
+}
+
+void column_scan_soa( ccppbrasil::benchmark_state& state, size_t size )
+{
+    ccppbrasil::soa_map< size_t, record_columns > records;
+    fillRecords( records, size );
+    const auto& column = static_cast< const ccppbrasil::soa_map< size_t, record_columns >& >( records ).column< 0 >();
 
-    void push_back( float x, float y )
+    state.set_items( 20 * static_cast< uint64_t >( size ) );
+    while( state.next_repetition() )
     {
-        xy_.push_back( std::make_pair( x, y ) );
+        state.measure( [ & ]()
+        {
+            float sum = 0;
+            for( size_t j = 0; j < 20; ++j )
+            {
+                for( float a : column )
+                {
+                    sum += a;
+                }
+            }
+            state.keep( sum );
+        } );
     }
+}
+
+void column_scan_soa_kernels( ccppbrasil::benchmark_state& state, size_t size )
+{
+    ccppbrasil::soa_map< size_t, record_columns > records;
+    fillRecords( records, size );
+    const auto& column = static_cast< const ccppbrasil::soa_map< size_t, record_columns >& >( records ).column< 0 >();
 
-    float get_x( size_t idx )
+    state.set_items( 20 * static_cast< uint64_t >( size ) );
+    while( state.next_repetition() )
     {
-        return xy_[ idx ].first;
+        state.measure( [ & ]()
+        {
+            float sum = 0;
+            for( size_t j = 0; j < 20; ++j )
+            {
+                sum += ccppbrasil::column_sum( column );
+            }
+            state.keep( sum );
+        } );
     }
+}
 
-    float get_y( size_t idx )
+// Each repetition selects the records with a < size / 2, 20 times.
+void column_filter_soa( ccppbrasil::benchmark_state& state, size_t size )
+{
+    ccppbrasil::soa_map< size_t, record_columns > records;
+    fillRecords( records, size );
+
+    std::vector< size_t > selected;
+    selected.reserve( size );
+    state.set_items( 20 * static_cast< uint64_t >( size ) );
+    while( state.next_repetition() )
     {
-        return xy_[ idx ].second;
+        state.measure( [ & ]()
+        {
+            for( size_t j = 0; j < 20; ++j )
+            {
+                selected.clear();
+                ccppbrasil::column_filter( records.column< 0 >(), ccppbrasil::compare_op::less, size / 2.f,
+                                           std::back_inserter( selected ) );
+            }
+        } );
     }
+    state.counter( "selected", static_cast< double >( selected.size() ) );
+}
 
-private:
-    std::vector< std::pair< float, float > > xy_;
-};
+// Runs a case with the kernels of one instruction set.
+ccppbrasil::benchmark_suite::case_function onIsa( ccppbrasil::soa_isa isa, ccppbrasil::benchmark_suite::case_function function )
+{
+    return [ = ]( ccppbrasil::benchmark_state& state )
+    {
+        ccppbrasil::soa_isa active = ccppbrasil::active_isa();
+        ccppbrasil::set_active_isa( isa );
+        function( state );
+        ccppbrasil::set_active_isa( active );
+    };
+}
 
-class XY_soa
+//-------------------------------------------------------------------------------------------------
+// --check: runs the column kernels and count_less on one instruction set and compares them with
+// plain loops. The values are small integers, so the floating point results are exact.
+template< class T >
+bool compareScalar( T a, T b, ccppbrasil::compare_op op )
 {
-public:
-    void reserve( size_t size )
+    switch( op )
     {
-        x_.reserve( size );
-        y_.reserve( size );
+    case ccppbrasil::compare_op::less:          return a < b;
+    case ccppbrasil::compare_op::less_equal:    return a <= b;
+    case ccppbrasil::compare_op::greater:       return a > b;
+    case ccppbrasil::compare_op::greater_equal: return a >= b;
+    case ccppbrasil::compare_op::equal:         return a == b;
+    default:                                    return a != b;
     }
+}
 
-    void push_back( float x, float y )
+template< class T, class BinaryOp >
+bool checkTransform( boost::iterator_range< T* > a, boost::iterator_range< T* > b, BinaryOp op )
+{
+    std::vector< T > out( a.size() );
+    std::vector< T > outScalar( a.size() );
+    auto outRange = boost::make_iterator_range( out.data(), out.data() + out.size() );
+    for( size_t i = 0; i < a.size(); ++i )
     {
-        x_.push_back( x );
-        y_.push_back( y );
+        outScalar[ i ] = op( a[ i ], b[ i ] );
     }
+    ccppbrasil::column_transform( a, b, outRange, op );
+    bool ok = ( out == outScalar );
 
-    float get_x( size_t idx )
+    for( size_t i = 0; i < a.size(); ++i )
     {
-        return x_[ idx ];
+        outScalar[ i ] = op( a[ i ], T( 3 ) );
     }
+    ccppbrasil::column_transform( a, T( 3 ), outRange, op );
+    return ok && out == outScalar;
+}
 
-    float get_y( size_t idx )
+template< class T >
+size_t checkColumnKernels( const char* type, ccppbrasil::soa_isa isa )
+{
+    const ccppbrasil::compare_op ops[] = { ccppbrasil::compare_op::less, ccppbrasil::compare_op::less_equal,
+                                           ccppbrasil::compare_op::greater, ccppbrasil::compare_op::greater_equal,
+                                           ccppbrasil::compare_op::equal, ccppbrasil::compare_op::not_equal };
+    size_t failures = 0;
+    for( size_t size = 0; size <= 1000; size += ( size < 67 ) ? 1 : 1000 - 67 )
     {
-        return y_[ idx ];
-    }
+        // Offset 1 starts the columns off the vector alignment.
+        for( size_t offset = 0; offset < 2; ++offset )
+        {
+            std::vector< T > a( size + offset );
+            std::vector< T > b( size + offset );
+            for( size_t i = 0; i < a.size(); ++i )
+            {
+                a[ i ] = static_cast< T >( static_cast< int >( i * 7 % 23 ) - 11 );
+                b[ i ] = static_cast< T >( static_cast< int >( i * 5 % 13 ) + 1 );
+            }
+            auto ar = boost::make_iterator_range( a.data() + offset, a.data() + a.size() );
+            auto br = boost::make_iterator_range( b.data() + offset, b.data() + b.size() );
 
-private:
-    std::vector< float > x_;
-    std::vector< float > y_;
-};
+            T sum = T();
+            T dot = T();
+            std::vector< T > axpy( br.begin(), br.end() );
+            for( size_t i = 0; i < size; ++i )
+            {
+                sum += ar[ i ];
+                dot += ar[ i ] * br[ i ];
+                axpy[ i ] = T( 2 ) * ar[ i ] + axpy[ i ];
+            }
+            std::vector< T > y( br.begin(), br.end() );
+            ccppbrasil::column_axpy( T( 2 ), ar, boost::make_iterator_range( y.data(), y.data() + y.size() ) );
 
+            std::vector< const char* > failed;
+            if( ccppbrasil::column_sum( ar ) != sum ) failed.push_back( "column_sum" );
+            if( ccppbrasil::column_sum_compensated( ar ) != sum ) failed.push_back( "column_sum_compensated" );
+            if( ccppbrasil::column_dot( ar, br ) != dot ) failed.push_back( "column_dot" );
+            if( y != axpy ) failed.push_back( "column_axpy" );
+            if( size != 0 && ccppbrasil::column_min_max( ar ) !=
+                std::make_pair( *std::min_element( ar.begin(), ar.end() ), *std::max_element( ar.begin(), ar.end() ) ) )
+            {
+                failed.push_back( "column_min_max" );
+            }
+            if( !checkTransform( ar, br, std::plus< T >() ) ) failed.push_back( "column_transform plus" );
+            if( !checkTransform( ar, br, std::minus< T >() ) ) failed.push_back( "column_transform minus" );
+            if( !checkTransform( ar, br, std::multiplies< T >() ) ) failed.push_back( "column_transform multiplies" );
+            if( !checkTransform( ar, br, std::divides< T >() ) ) failed.push_back( "column_transform divides" );
+            for( ccppbrasil::compare_op op : ops )
+            {
+                std::vector< size_t > selected;
+                std::vector< size_t > selectedScalar;
+                for( size_t i = 0; i < size; ++i )
+                {
+                    if( compareScalar( ar[ i ], T( 2 ), op ) )
+                    {
+                        selectedScalar.push_back( i );
+                    }
+                }
+                ccppbrasil::column_filter( ar, op, T( 2 ), std::back_inserter( selected ) );
+                if( selected != selectedScalar ) failed.push_back( "column_filter" );
+            }
+
+            for( const char* kernel : failed )
+            {
+                std::cerr << "check " << ccppbrasil::isa_name( isa ) << ": " << kernel << "<" << type << "> size "
+                          << size << " offset " << offset << " differs from the scalar loop" << std::endl;
+            }
+            failures += failed.size();
+        }
+    }
+    return failures;
 }
 
-int main( int argc, char* argv[] )
+template< class KeyType >
+size_t checkCountLess( const char* type, ccppbrasil::soa_isa isa )
 {
-    boost::timer::cpu_timer timer;
+    using ccppbrasil::detail::count_less;
+    using ccppbrasil::detail::count_less_scalar;
+    typedef ccppbrasil::detail::simd_key_for< KeyType, std::less< KeyType > > lanes;
 
-    size_t ffsize = 100000000;
-    size_t rewsize = 100000;
-
-
-    // std::map
-    for( int i = 0; i < 10; ++i )
+    size_t failures = 0;
+    for( size_t size = 0; size <= 1000; size += ( size < 67 ) ? 1 : 1000 - 67 )
     {
-        std::map<size_t, size_t> std_map1;
-        timer.start();
-        forwardFill( std_map1, ffsize );
-        timer.stop();
-        std::cout << "forward fill std::map: " << timer.format();
+        // Negative values wrap around on unsigned keys, which puts the high bit in the window.
+        std::vector< KeyType > keys( size + 1 );
+        for( size_t i = 0; i < keys.size(); ++i )
+        {
+            keys[ i ] = static_cast< KeyType >( static_cast< long long >( i * 3 ) - static_cast< long long >( size ) );
+        }
+        for( long long k = -static_cast< long long >( size ) - 1; k <= static_cast< long long >( 2 * size ) + 1; ++k )
+        {
+            KeyType key = static_cast< KeyType >( k );
+            for( size_t offset = 0; offset < 2; ++offset )
+            {
+                if( count_less( keys.data() + offset, size + 1 - offset, key, std::less< KeyType >(), lanes() ) !=
+                    count_less_scalar( keys.data() + offset, size + 1 - offset, key, std::less< KeyType >() ) )
+                {
+                    std::cerr << "check " << ccppbrasil::isa_name( isa ) << ": count_less<" << type << "> size "
+                              << size + 1 - offset << " key " << k << " differs from the scalar loop" << std::endl;
+                    ++failures;
+                }
+            }
+        }
+    }
+    return failures;
+}
 
-        timer.start();
-        forwardFind( std_map1, ffsize );
-        timer.stop();
-        std::cout << "forward find std::map: " << timer.format();
+// Checks every instruction set up to active_isa() and returns the number of mismatches.
+size_t checkKernels()
+{
+    const ccppbrasil::soa_isa active = ccppbrasil::active_isa();
+    size_t failures = 0;
+    for( int i = 0; i <= static_cast< int >( active ); ++i )
+    {
+        ccppbrasil::soa_isa isa = ccppbrasil::set_active_isa( static_cast< ccppbrasil::soa_isa >( i ) );
+        size_t isaFailures = checkColumnKernels< float >( "float", isa ) + checkColumnKernels< double >( "double", isa ) +
+                             checkColumnKernels< int >( "int", isa ) +
+                             checkCountLess< int32_t >( "int32_t", isa ) + checkCountLess< uint32_t >( "uint32_t", isa ) +
+                             checkCountLess< int64_t >( "int64_t", isa ) + checkCountLess< uint64_t >( "uint64_t", isa ) +
+                             checkCountLess< float >( "float", isa ) + checkCountLess< double >( "double", isa );
+        std::cerr << "check " << ccppbrasil::isa_name( isa ) << ": "
+                  << ( isaFailures == 0 ? std::string( "ok" ) : std::to_string( isaFailures ) + " mismatches" ) << std::endl;
+        failures += isaFailures;
     }
+    ccppbrasil::set_active_isa( active );
+    return failures;
+}
 
-    for( int i = 0; i < 10; ++i )
+//-------------------------------------------------------------------------------------------------
+// Case names are operation/container[:variant]/keys/size; run with --list to see them all.
+int main( int argc, char* argv[] )
+{
+    ccppbrasil::benchmark_options options;
+    try
     {
-        std::map<size_t, size_t> std_map2;
-        timer.start();
-		reverseFill( std_map2, rewsize );
-        timer.stop();
-        std::cout << "reverse fill std::map: " << timer.format();
+        options = ccppbrasil::benchmark_options::parse( argc, argv );
+    }
+    catch( const std::invalid_argument& e )
+    {
+        std::cerr << e.what() << std::endl
+                  << "usage: " << argv[ 0 ] << " [--filter=REGEX] [--list] [--warmup=N] [--repetitions=N] [--scale=F]"
+                  << " [--format=text|json|csv] [--out=PATH] [--compare=PATH] [--threshold=F] [--counters] [--seed=N]"
+                  << " [--check]" << std::endl;
+        return 2;
+    }
 
-        timer.start();
-		reverseFind( std_map2, rewsize );
-        timer.stop();
-        std::cout << "reserve find std::map: " << timer.format();
+    std::cerr << "kernels " << ccppbrasil::isa_name( ccppbrasil::active_isa() ) << ", cpu "
+              << ccppbrasil::isa_name( ccppbrasil::detect_isa() ) << std::endl;
+    if( options.check )
+    {
+        return checkKernels() == 0 ? 0 : 1;
     }
 
+    using ccppbrasil::benchmark_state;
+    using std::to_string;
+    ccppbrasil::benchmark_suite suite;
 
-    // boost::container::flat_map
-	for( int i = 0; i < 10; ++i )
-	{
-        boost::container::flat_map<size_t, size_t> flat_map1;
-        flat_map1.reserve( ffsize );
-        timer.start();
-        forwardFill( flat_map1, ffsize );
-        timer.stop();
-        std::cout << "forward fill boost::container::flat_map: " << timer.format();
+    size_t ffsize = options.scaled( 100000000 );
+    size_t rewsize = options.scaled( 100000 );
+    size_t distsize = options.scaled( 10000000 );
 
-        timer.start();
-        forwardFind( flat_map1, ffsize );
-        timer.stop();
-        std::cout << "forward find boost::container::flat_map: " << timer.format();
-    }
+    addMapCases< std::map<size_t, size_t> >( suite, "std::map", ffsize, rewsize, forwardFind, reverseFind );
+    addMapCases< boost::container::flat_map<size_t, size_t> >( suite, "boost::container::flat_map", ffsize, rewsize, forwardFind, reverseFind );
+    addMapCases< ccppbrasil::soa_map<size_t, size_t> >( suite, "ccppbrasil::soa_map", ffsize, rewsize, forwardFind, reverseFind );
+    addMapCases< stats_soa_map >( suite, "ccppbrasil::soa_map:stats", ffsize, rewsize, forwardFind, reverseFind );
+    addMapCases< ccppbrasil::soa_btree_map<size_t, size_t> >( suite, "ccppbrasil::soa_btree_map", ffsize, rewsize, forwardFind, reverseFind );
+    addMapCases< ccppbrasil::soa_unordered_map<size_t, size_t> >( suite, "ccppbrasil::soa_unordered_map", ffsize, rewsize, forwardFindKey, reverseFindKey );
+    suite.add( "fill/ccppbrasil::buffered_soa_map/reverse/" + to_string( rewsize ), [ = ]( benchmark_state& state )
+               { fillCase< ccppbrasil::buffered_soa_map<size_t, size_t> >( state, rewsize, true ); } );
+    suite.add( "find/ccppbrasil::buffered_soa_map/reverse/" + to_string( rewsize ), [ = ]( benchmark_state& state )
+               { findCase< ccppbrasil::buffered_soa_map<size_t, size_t> >( state, rewsize, true, forwardFind ); } );
 
-	for( int i = 0; i < 10; ++i )
-	{
-        boost::container::flat_map<size_t, size_t> flat_map2;
-        flat_map2.reserve( rewsize );
-        timer.start();
-        reverseFill( flat_map2, rewsize );
-        timer.stop();
-        std::cout << "reverse fill boost::container::flat_map: " << timer.format();
+    // Exact match find on the ordered maps
+    std::string ffkeys = "/forward/" + to_string( ffsize );
+    suite.add( "find_key/std::map" + ffkeys, [ = ]( benchmark_state& state )
+               { findCase< std::map<size_t, size_t> >( state, ffsize, false, forwardFindKey ); } );
+    suite.add( "find_key/boost::container::flat_map" + ffkeys, [ = ]( benchmark_state& state )
+               { findCase< boost::container::flat_map<size_t, size_t> >( state, ffsize, false, forwardFindKey ); } );
+    suite.add( "find_key/ccppbrasil::soa_map" + ffkeys, [ = ]( benchmark_state& state )
+               { findCase< ccppbrasil::soa_map<size_t, size_t> >( state, ffsize, false, forwardFindKey ); } );
 
-        timer.start();
-        reverseFind( flat_map2, rewsize );
-        timer.stop();
-        std::cout << "reverse find boost::container::flat_map: " << timer.format();
+    // Search layouts: forward lookups, and random lookups over key distributions. The plain
+    // find/ccppbrasil::soa_map cases above are the sorted baseline for the forward ones.
+    const ccppbrasil::soa_layout forwardLayouts[] = { ccppbrasil::soa_layout::eytzinger, ccppbrasil::soa_layout::compressed };
+    for( ccppbrasil::soa_layout layout : forwardLayouts )
+    {
+        suite.add( std::string( "find/ccppbrasil::soa_map:" ) + layoutName( layout ) + ffkeys, [ = ]( benchmark_state& state )
+                   { layoutFindCase( state, ffsize, layout ); } );
     }
+    const ccppbrasil::soa_layout distributionLayouts[] = { ccppbrasil::soa_layout::sorted, ccppbrasil::soa_layout::learned };
+    const char* distributions[] = { "sequential", "uniform", "skewed" };
+    for( const char* distribution : distributions )
+    {
+        for( ccppbrasil::soa_layout layout : distributionLayouts )
+        {
+            std::string d( distribution );
+            suite.add( std::string( "find_random/ccppbrasil::soa_map:" ) + layoutName( layout ) + "/" + d + "/" + to_string( distsize ),
+                       [ = ]( benchmark_state& state ) { layoutDistributionCase( state, d, distsize, layout ); } );
+        }
+    }
+    suite.add( "find_batch/ccppbrasil::soa_map" + ffkeys, [ = ]( benchmark_state& state ) { findBatchCase( state, ffsize, false ); } );
+    suite.add( "find_sorted/ccppbrasil::soa_map" + ffkeys, [ = ]( benchmark_state& state ) { findBatchCase( state, ffsize, true ); } );
 
-    // ccppbrasil::soa_map
-	for( int i = 0; i < 10; ++i )
-	{
-        ccppbrasil::soa_map<size_t, size_t> soa_map1;
-        soa_map1.reserve( ffsize );
-        timer.start();
-        forwardFill( soa_map1, ffsize );
-        timer.stop();
-        std::cout << "forward fill ccppbrasil::soa_map: " << timer.format();
-
-        timer.start();
-        forwardFind( soa_map1, ffsize );
-        timer.stop();
-        std::cout << "forward find ccppbrasil::soa_map: " << timer.format();
+    // Threads
+    size_t maxThreads = std::max( 1u, std::thread::hardware_concurrency() );
+    for( size_t threads = 1; threads <= maxThreads; threads *= 2 )
+    {
+        suite.add( "concurrent_find/ccppbrasil::concurrent_soa_map:" + to_string( threads ) + "threads/forward/" + to_string( distsize ),
+                   [ = ]( benchmark_state& state ) { concurrentFindCase( state, distsize, threads ); } );
     }
+    std::string parallel = ":" + to_string( maxThreads ) + "threads/forward/" + to_string( rewsize );
+    suite.add( "parallel_fill/ccppbrasil::sharded_soa_map" + parallel, [ = ]( benchmark_state& state )
+               { parallelFillCase( state, rewsize, maxThreads, true ); } );
+    suite.add( "parallel_fill/ccppbrasil::soa_map+mutex" + parallel, [ = ]( benchmark_state& state )
+               { parallelFillCase( state, rewsize, maxThreads, false ); } );
+    suite.add( "rebalance/ccppbrasil::sharded_soa_map/forward/" + to_string( rewsize ), [ = ]( benchmark_state& state )
+               { rebalanceCase( state, rewsize ); } );
+
+    // Mixed operation workloads
+    size_t records = options.scaled( 1000000 );
+    size_t operations = options.scaled( 100000 );
+    addWorkloadCases< std::map<size_t, size_t> >( suite, "std::map", records, operations, options.seed, true );
+    addWorkloadCases< boost::container::flat_map<size_t, size_t> >( suite, "boost::container::flat_map", records, operations, options.seed, true );
+    addWorkloadCases< ccppbrasil::soa_map<size_t, size_t> >( suite, "ccppbrasil::soa_map", records, operations, options.seed, true );
+    addWorkloadCases< stats_soa_map >( suite, "ccppbrasil::soa_map:stats", records, operations, options.seed, true );
+    addWorkloadCases< ccppbrasil::soa_btree_map<size_t, size_t> >( suite, "ccppbrasil::soa_btree_map", records, operations, options.seed, true );
+    addWorkloadCases< ccppbrasil::soa_unordered_map<size_t, size_t> >( suite, "ccppbrasil::soa_unordered_map", records, operations, options.seed, false );
+
+    // Bulk loads
+    suite.add( "bulk_fill/ccppbrasil::soa_map" + ffkeys, [ = ]( benchmark_state& state ) { bulkFillCase( state, ffsize, false, false ); } );
+    suite.add( "bulk_fill/ccppbrasil::soa_map/reverse/" + to_string( rewsize ), [ = ]( benchmark_state& state )
+               { bulkFillCase( state, rewsize, true, false ); } );
+    suite.add( "bulk_fill/ccppbrasil::soa_map:parallel/reverse/" + to_string( rewsize ), [ = ]( benchmark_state& state )
+               { bulkFillCase( state, rewsize, true, true ); } );
+    suite.add( "sorted_unique_load/ccppbrasil::soa_map" + ffkeys, [ = ]( benchmark_state& state ) { sortedUniqueLoadCase( state, ffsize ); } );
+    suite.add( "snapshot_open/ccppbrasil::soa_map" + ffkeys, [ = ]( benchmark_state& state ) { snapshotOpenCase( state, ffsize ); } );
+    suite.add( "external_build/ccppbrasil::soa_map/reverse/" + to_string( ffsize ), [ = ]( benchmark_state& state )
+               { externalBuildCase( state, ffsize ); } );
+
+    // Allocators: create-fill-destroy churn of small maps
+    size_t churnmaps = options.scaled( 100000 );
+    size_t churnsize = 64;
+    std::string churn = "/" + to_string( churnmaps ) + "x" + to_string( churnsize );
+    suite.add( "churn/std::map" + churn, [ = ]( benchmark_state& state )
+               { churnCase< std::map<size_t, size_t> >( state, churnmaps, churnsize, releaseNothing ); } );
+    suite.add( "churn/std::map:pool" + churn, [ = ]( benchmark_state& state )
+               { churnCase< pool_std_map >( state, churnmaps, churnsize, releaseNothing ); } );
+    suite.add( "churn/ccppbrasil::soa_map" + churn, [ = ]( benchmark_state& state )
+               { churnCase< ccppbrasil::soa_map<size_t, size_t> >( state, churnmaps, churnsize, releaseNothing ); } );
+    suite.add( "churn/ccppbrasil::soa_map:arena" + churn, [ = ]( benchmark_state& state )
+               { churnCase< arena_soa_map >( state, churnmaps, churnsize, releaseArena ); } );
+    suite.add( "churn/ccppbrasil::soa_map:pool" + churn, [ = ]( benchmark_state& state )
+               { churnCase< pool_soa_map >( state, churnmaps, churnsize, releaseNothing ); } );
 
-	for( int i = 0; i < 10; ++i )
-	{
-        ccppbrasil::soa_map<size_t, size_t> soa_map2;
-        soa_map2.reserve( rewsize );
-        timer.start();
-        reverseFill( soa_map2, rewsize );
-        timer.stop();
-        std::cout << "reverse fill ccppbrasil::soa_map: " << timer.format();
+    // Column layouts
+    size_t lssize = options.scaled( 512 * 1024 * 1024 );
+    size_t scalesize = options.scaled( 512 * 1024 );
+    size_t scansize = options.scaled( 16 * 1024 * 1024 );
+    suite.add( "least_square/aos/" + to_string( lssize ), [ = ]( benchmark_state& state )
+               { least_square< std::vector< std::pair< float, float > > >( state, lssize ); } );
+    suite.add( "least_square/soa/" + to_string( lssize ), [ = ]( benchmark_state& state )
+               { least_square< ccppbrasil::soa_vector< float, float > >( state, lssize ); } );
+    suite.add( "least_square/soa:parallel/" + to_string( lssize ), [ = ]( benchmark_state& state ) { least_square_parallel( state, lssize ); } );
+    suite.add( "least_square/soa:kernels/" + to_string( lssize ), [ = ]( benchmark_state& state ) { least_square_kernels( state, lssize ); } );
+    suite.add( "scale/aos/" + to_string( scalesize ), [ = ]( benchmark_state& state ) { scale_aos( state, scalesize ); } );
+    suite.add( "scale/soa/" + to_string( scalesize ), [ = ]( benchmark_state& state ) { scale_soa( state, scalesize ); } );
+    suite.add( "column_scan/aos/" + to_string( scansize ), [ = ]( benchmark_state& state ) { column_scan_aos( state, scansize ); } );
+    suite.add( "column_scan/soa/" + to_string( scansize ), [ = ]( benchmark_state& state ) { column_scan_soa( state, scansize ); } );
 
-        timer.start();
-        reverseFind( soa_map2, rewsize );
-        timer.stop();
-        std::cout << "reverse find ccppbrasil::soa_map: " << timer.format();
+    // Every kernel variant up to the active one, e.g. CCPPBRASIL_SOA_ISA=sse42 stops at sse42.
+    for( int i = 0; i <= static_cast< int >( ccppbrasil::active_isa() ); ++i )
+    {
+        ccppbrasil::soa_isa isa = static_cast< ccppbrasil::soa_isa >( i );
+        std::string variant = std::string( "/soa:kernels:" ) + ccppbrasil::isa_name( isa ) + "/";
+        suite.add( "scale" + variant + to_string( scalesize ),
+                   onIsa( isa, [ = ]( benchmark_state& state ) { scale_soa_kernels( state, scalesize ); } ) );
+        suite.add( "column_scan" + variant + to_string( scansize ),
+                   onIsa( isa, [ = ]( benchmark_state& state ) { column_scan_soa_kernels( state, scansize ); } ) );
+        suite.add( "column_filter" + variant + to_string( scansize ),
+                   onIsa( isa, [ = ]( benchmark_state& state ) { column_filter_soa( state, scansize ); } ) );
     }
 
-	for( int i = 0; i < 10; ++i )
-		least_square<ccppbrasil::XY_aos>( "aos" );
-	for( int i = 0; i < 10; ++i )
-		least_square<ccppbrasil::XY_soa>( "soa" );
-    for( int i = 0; i < 10; ++i )
-        scale_aos();
-    for( int i = 0; i < 10; ++i )
-        scale_soa();
-    return 0;
+    try
+    {
+        return suite.run( options );
+    }
+    catch( const std::exception& e )
+    {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
 }
-
@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SHARDEDSOAMAP_IMPL_H
+#define CCPPBRASIL_SHARDEDSOAMAP_IMPL_H
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// sharded_soa_iterator
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::sharded_soa_iterator( map_type& obj, size_t shard, size_t pos ) :
+    soa_map_( &obj ), shard_( shard ), pos_( pos )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key_reference sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key() const
+{
+    return soa_map_->shards_[ shard_ ]->map.keyAtIndex( pos_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value_reference sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value() const
+{
+    return soa_map_->shards_[ shard_ ]->map.atIndex( pos_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::shard() const
+{
+    return shard_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::pos() const
+{
+    return pos_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::ref_type sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::dereference() const
+{
+    return ref_type( key(), value() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::equal( const sharded_soa_iterator& other ) const
+{
+    return shard_ == other.shard_ && pos_ == other.pos_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void sharded_soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::increment()
+{
+    *this = soa_map_->make_iterator( shard_, pos_ + 1 );
+}
+
+//-------------------------------------------------------------------------------------------------
+// sharded_soa_map
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::sharded_soa_map( std::vector< KeyType > splits ) :
+    splits_( std::make_shared< const split_container_type >( std::move( splits ) ) )
+{
+    KeyCompare comp;
+    if( std::adjacent_find( splits_->begin(), splits_->end(),
+                            [&comp]( const KeyType& a, const KeyType& b ) { return !comp( a, b ); } ) != splits_->end() )
+    {
+        throw std::invalid_argument( "sharded_soa_map: split points not sorted and unique" );
+    }
+
+    for( size_t i = 0; i <= splits_->size(); ++i )
+    {
+        shards_.emplace_back( new shard );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::shard_count() const
+{
+    return shards_.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+std::vector< KeyType > sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::splits() const
+{
+    return *std::atomic_load( &splits_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::size() const
+{
+    size_t total = 0;
+    for( size_t i = 0; i < shards_.size(); ++i )
+    {
+        std::lock_guard< std::mutex > lock( shards_[ i ]->mutex );
+        total += shards_[ i ]->map.size();
+    }
+    return total;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::empty() const
+{
+    return size() == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::clear()
+{
+    for( size_t i = 0; i < shards_.size(); ++i )
+    {
+        std::lock_guard< std::mutex > lock( shards_[ i ]->mutex );
+        shards_[ i ]->map.clear();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::insert( const std::pair< KeyType, ValueType > &keyValuePair )
+{
+    size_t idx;
+    std::unique_lock< std::mutex > lock = lock_shard( keyValuePair.first, idx );
+    return shards_[ idx ]->map.insert( keyValuePair );
+}
+
+//-------------------------------------------------------------------------------------------------
+// A bucket locked after a rebalance swapped the split points may hold keys of other shards now:
+// it goes back to the pending pairs and is bucketed again.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+template< class InputIterator >
+void sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::insert( InputIterator first, InputIterator last )
+{
+    typedef std::pair< KeyType, ValueType > batch_value_type;
+    std::vector< batch_value_type > pending( first, last );
+    std::vector< std::vector< batch_value_type > > buckets( shards_.size() );
+
+    while( !pending.empty() )
+    {
+        std::shared_ptr< const split_container_type > splits = std::atomic_load( &splits_ );
+        for( size_t i = 0; i < pending.size(); ++i )
+        {
+            buckets[ shard_of( *splits, pending[ i ].first ) ].push_back( std::move( pending[ i ] ) );
+        }
+        pending.clear();
+
+        for( size_t s = 0; s < shards_.size(); ++s )
+        {
+            if( buckets[ s ].empty() )
+            {
+                continue;
+            }
+            std::lock_guard< std::mutex > lock( shards_[ s ]->mutex );
+            if( std::atomic_load( &splits_ ) == splits )
+            {
+                shards_[ s ]->map.insert( buckets[ s ].begin(), buckets[ s ].end() );
+            }
+            else
+            {
+                std::move( buckets[ s ].begin(), buckets[ s ].end(), std::back_inserter( pending ) );
+            }
+            buckets[ s ].clear();
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+bool sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::emplace( KeyType && refKey, ValueType && value )
+{
+    KeyType key( std::forward<KeyType>( refKey ) );
+    size_t idx;
+    std::unique_lock< std::mutex > lock = lock_shard( key, idx );
+    return shards_[ idx ]->map.emplace( std::move( key ), std::forward<ValueType>( value ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::erase( const KeyType &key )
+{
+    size_t idx;
+    std::unique_lock< std::mutex > lock = lock_shard( key, idx );
+    shard_type& map = shards_[ idx ]->map;
+    if( map.find( key ) == map.end() )
+    {
+        return 0;
+    }
+    map.erase( key );
+    return 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+ValueType sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::at( const KeyType & key ) const
+{
+    size_t idx;
+    std::unique_lock< std::mutex > lock = lock_shard( key, idx );
+    const shard_type& map = shards_[ idx ]->map;
+    return ValueType( map.at( key ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+template< class Function >
+bool sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::visit( const KeyType &key, Function function )
+{
+    size_t idx;
+    std::unique_lock< std::mutex > lock = lock_shard( key, idx );
+    shard_type& map = shards_[ idx ]->map;
+    auto pos = map.find( key );
+    if( map.end() == pos )
+    {
+        return false;
+    }
+    function( pos.value() );
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+// The split points are the keys at ranks total * i / shard_count(), taken under every shard lock.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::rebalance()
+{
+    std::vector< std::unique_lock< std::mutex > > locks;
+    size_t total = 0;
+    for( size_t i = 0; i < shards_.size(); ++i )
+    {
+        locks.emplace_back( shards_[ i ]->mutex );
+        total += shards_[ i ]->map.size();
+    }
+    if( total == 0 )
+    {
+        return;
+    }
+
+    std::shared_ptr< split_container_type > splits = std::make_shared< split_container_type >();
+    size_t s = 0;
+    size_t first = 0;
+    for( size_t i = 1; i < shards_.size(); ++i )
+    {
+        size_t rank = total * i / shards_.size();
+        while( rank >= first + shards_[ s ]->map.size() )
+        {
+            first += shards_[ s ]->map.size();
+            ++s;
+        }
+        splits->push_back( shards_[ s ]->map.keyAtIndex( rank - first ) );
+    }
+    redistribute( splits );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::rebalance( std::vector< KeyType > splits )
+{
+    if( splits.size() + 1 != shards_.size() )
+    {
+        throw std::invalid_argument( "sharded_soa_map::rebalance: wrong number of split points" );
+    }
+    KeyCompare comp;
+    if( std::adjacent_find( splits.begin(), splits.end(),
+                            [&comp]( const KeyType& a, const KeyType& b ) { return !comp( a, b ); } ) != splits.end() )
+    {
+        throw std::invalid_argument( "sharded_soa_map::rebalance: split points not sorted and unique" );
+    }
+
+    std::vector< std::unique_lock< std::mutex > > locks;
+    for( size_t i = 0; i < shards_.size(); ++i )
+    {
+        locks.emplace_back( shards_[ i ]->mutex );
+    }
+    redistribute( std::make_shared< const split_container_type >( std::move( splits ) ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::begin()
+{
+    return make_iterator( 0, 0 );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::begin() const
+{
+    return const_cast< sharded_soa_map* >( this )->begin();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::end()
+{
+    return iterator( *this, shards_.size(), 0 );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::end() const
+{
+    return const_cast< sharded_soa_map* >( this )->end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::lower_bound( const KeyType &key )
+{
+    size_t idx = shard_of( *splits_, key );
+    return make_iterator( idx, shards_[ idx ]->map.lower_bound( key ).base() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::lower_bound( const KeyType &key ) const
+{
+    return const_cast< sharded_soa_map* >( this )->lower_bound( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::upper_bound( const KeyType &key )
+{
+    size_t idx = shard_of( *splits_, key );
+    return make_iterator( idx, shards_[ idx ]->map.upper_bound( key ).base() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::upper_bound( const KeyType &key ) const
+{
+    return const_cast< sharded_soa_map* >( this )->upper_bound( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::find( const KeyType &key )
+{
+    size_t idx = shard_of( *splits_, key );
+    shard_type& map = shards_[ idx ]->map;
+    auto pos = map.find( key );
+    return ( map.end() == pos ) ? end() : iterator( *this, idx, pos.base() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::find( const KeyType &key ) const
+{
+    return const_cast< sharded_soa_map* >( this )->find( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Number of split points not greater than key.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+size_t sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::shard_of( const split_container_type& splits, const KeyType &key )
+{
+    return std::upper_bound( splits.begin(), splits.end(), key, KeyCompare() ) - splits.begin();
+}
+
+//-------------------------------------------------------------------------------------------------
+// Locks the shard of key. A rebalance swaps the split points with every shard locked, so once the
+// lock is held they cannot change: if they did since the shard was picked, pick again.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+std::unique_lock< std::mutex > sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::lock_shard( const KeyType &key, size_t &idx ) const
+{
+    for( ;; )
+    {
+        std::shared_ptr< const split_container_type > splits = std::atomic_load( &splits_ );
+        idx = shard_of( *splits, key );
+        std::unique_lock< std::mutex > lock( shards_[ idx ]->mutex );
+        if( std::atomic_load( &splits_ ) == splits )
+        {
+            return lock;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Moves every pair to the shard the new split points give it and publishes them. Called with
+// every shard locked; the shards are walked in key order, so each new shard gets sorted batches.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+void sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::redistribute( std::shared_ptr< const split_container_type > splits )
+{
+    typedef std::pair< KeyType, ValueType > batch_value_type;
+    std::vector< batch_value_type > pairs;
+    for( size_t s = 0; s < shards_.size(); ++s )
+    {
+        shard_type& map = shards_[ s ]->map;
+        for( size_t i = 0; i < map.size(); ++i )
+        {
+            pairs.push_back( batch_value_type( map.keyAtIndex( i ), ValueType( map.atIndex( i ) ) ) );
+        }
+        map.clear();
+    }
+
+    size_t first = 0;
+    for( size_t s = 0; s < shards_.size(); ++s )
+    {
+        size_t last = pairs.size();
+        if( s < splits->size() )
+        {
+            last = std::lower_bound( pairs.begin() + first, pairs.end(), ( *splits )[ s ],
+                                     []( const batch_value_type& a, const KeyType& b ) { return KeyCompare()( a.first, b ); } ) - pairs.begin();
+        }
+        shards_[ s ]->map.insert( pairs.begin() + first, pairs.begin() + last );
+        first = last;
+    }
+    std::atomic_store( &splits_, splits );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Moves a position past the end of a shard to the start of the next non empty one.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
+typename sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator sharded_soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::make_iterator( size_t shard, size_t pos )
+{
+    while( shard < shards_.size() && pos == shards_[ shard ]->map.size() )
+    {
+        ++shard;
+        pos = 0;
+    }
+    return iterator( *this, shard, pos );
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SHARDEDSOAMAP_IMPL_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SHARDEDSOAMAP_H
+#define CCPPBRASIL_SHARDEDSOAMAP_H
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include "soa_map.h"
+
+namespace ccppbrasil {
+
+template< class KeyType,
+          class ValueType,
+          class KeyCompare = std::less< KeyType >,
+          class KeyAllocator = std::allocator< KeyType >,
+          class ValueAllocator = std::allocator< ValueType > >
+class sharded_soa_map;
+
+template< class KeyType,
+          class ValueType,
+          class KeyCompare,
+          class KeyAllocator,
+          class ValueAllocator >
+class sharded_soa_iterator : public boost::iterator_facade< sharded_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >,
+                                                            std::pair< const KeyType, ValueType >,
+                                                            boost::forward_traversal_tag,
+                                                            std::pair< typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key_reference,
+                                                                       typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value_reference > >
+{
+public:
+    typedef sharded_soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > map_type;
+    typedef typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key_reference key_reference;
+    typedef typename soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value_reference value_reference;
+    typedef std::pair< key_reference, value_reference > ref_type;
+
+    sharded_soa_iterator( map_type& obj, size_t shard, size_t pos );
+
+    key_reference key() const;
+    value_reference value() const;
+
+    size_t shard() const;
+    size_t pos() const;
+
+private:
+    friend class boost::iterator_core_access;
+
+    ref_type dereference() const;
+    bool equal( const sharded_soa_iterator& other ) const;
+    void increment();
+
+    map_type* soa_map_;
+    size_t shard_;
+    size_t pos_;
+};
+
+// Ordered map split by key range into shards, each a soa_map with its own lock, so writers to
+// different ranges do not wait for each other.
+//
+// Shard i holds the keys in [ splits[ i - 1 ], splits[ i ] ). Point operations and the bulk
+// insert lock only the shards they touch. rebalance() moves the split points so every shard holds
+// about the same number of keys, locking every shard meanwhile; point operations that picked a
+// shard under the old split points find out under the shard lock and retry. Iteration and the
+// range searches cross shard boundaries transparently but do not lock: use them while no writer
+// runs.
+template< class KeyType,
+          class ValueType,
+          class KeyCompare,
+          class KeyAllocator,
+          class ValueAllocator >
+class sharded_soa_map
+{
+public:
+    typedef sharded_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >        iterator;
+    typedef const sharded_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >  const_iterator;
+    typedef soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >                     shard_type;
+    typedef typename shard_type::value_reference                                                        value_reference;
+
+    // One shard per split point plus one. Split points must be sorted and unique; throws
+    // std::invalid_argument otherwise.
+    explicit sharded_soa_map( std::vector< KeyType > splits = std::vector< KeyType >() );
+
+    size_t shard_count() const;
+    std::vector< KeyType > splits() const;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    bool insert( const std::pair< KeyType, ValueType > &keyValuePair );
+
+    // Buckets the batch by shard and bulk merges each bucket under its shard lock.
+    template< class InputIterator >
+    void insert( InputIterator first, InputIterator last );
+
+    bool emplace( KeyType && moveKey, ValueType && value );
+
+    size_t erase( const KeyType &key );
+
+    // A copy of the value, read under the shard lock.
+    ValueType at( const KeyType & key ) const;
+
+    // Calls function( value_reference ) under the shard lock if key is present.
+    template< class Function >
+    bool visit( const KeyType &key, Function function );
+
+    // Moves the split points so the shards hold the same number of keys, give or take one.
+    void rebalance();
+
+    // Moves the split points to splits, one less than shard_count(), sorted and unique; throws
+    // std::invalid_argument otherwise.
+    void rebalance( std::vector< KeyType > splits );
+
+    iterator begin();
+    const_iterator begin() const;
+
+    iterator end();
+    const_iterator end() const;
+
+    iterator lower_bound( const KeyType &key );
+    const_iterator lower_bound( const KeyType &key ) const;
+
+    iterator upper_bound( const KeyType &key );
+    const_iterator upper_bound( const KeyType &key ) const;
+
+    iterator find( const KeyType &key );
+    const_iterator find( const KeyType &key ) const;
+
+private:
+    typedef std::vector< KeyType > split_container_type;
+
+    struct shard
+    {
+        mutable std::mutex mutex;
+        shard_type map;
+    };
+
+    friend class sharded_soa_iterator< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >;
+
+    sharded_soa_map( const sharded_soa_map& ) = delete;
+    sharded_soa_map& operator=( const sharded_soa_map& ) = delete;
+
+    static size_t shard_of( const split_container_type& splits, const KeyType &key );
+    std::unique_lock< std::mutex > lock_shard( const KeyType &key, size_t &idx ) const;
+    void redistribute( std::shared_ptr< const split_container_type > splits );
+    iterator make_iterator( size_t shard, size_t pos );
+
+    std::vector< std::unique_ptr< shard > > shards_;
+    std::shared_ptr< const split_container_type > splits_;
+};
+
+}
+
+#include "sharded_soa_map-impl.h"
+
+#endif // CCPPBRASIL_SHARDEDSOAMAP_H
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAALLOCATOR_H
+#define CCPPBRASIL_SOAALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace ccppbrasil {
+
+const size_t huge_page_size = 2 * 1024 * 1024;
+
+// Allocator backing large blocks with huge pages, for containers whose columns span many pages:
+//
+//     soa_map< size_t, size_t, std::less< size_t >, huge_page_allocator< size_t > >
+//
+// Blocks of at least huge_page_size are mapped directly from the OS, rounded up to whole huge
+// pages: large pages when the process may lock them on Windows, transparent huge pages
+// (madvise) elsewhere. Smaller blocks come from operator new.
+template< class T >
+class huge_page_allocator
+{
+public:
+    typedef T value_type;
+
+    template< class U >
+    struct rebind
+    {
+        typedef huge_page_allocator< U > other;
+    };
+
+    huge_page_allocator() {}
+
+    template< class U >
+    huge_page_allocator( const huge_page_allocator< U >& ) {}
+
+    T* allocate( size_t count )
+    {
+        size_t bytes = count * sizeof( T );
+        if( bytes < huge_page_size )
+        {
+            return static_cast< T* >( ::operator new( bytes ) );
+        }
+        return static_cast< T* >( map_pages( round_up( bytes ) ) );
+    }
+
+    void deallocate( T* ptr, size_t count )
+    {
+        size_t bytes = count * sizeof( T );
+        if( bytes < huge_page_size )
+        {
+            ::operator delete( ptr );
+            return;
+        }
+        unmap_pages( ptr, round_up( bytes ) );
+    }
+
+private:
+    static size_t round_up( size_t bytes )
+    {
+        return ( bytes + huge_page_size - 1 ) / huge_page_size * huge_page_size;
+    }
+
+#ifdef _WIN32
+    static void* map_pages( size_t bytes )
+    {
+        // MEM_LARGE_PAGES needs SeLockMemoryPrivilege; without it fall back to normal pages.
+        size_t largePage = GetLargePageMinimum();
+        void* ptr = nullptr;
+        if( largePage != 0 && bytes % largePage == 0 )
+        {
+            ptr = VirtualAlloc( nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+        }
+        if( ptr == nullptr )
+        {
+            ptr = VirtualAlloc( nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+        }
+        if( ptr == nullptr )
+        {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    static void unmap_pages( void* ptr, size_t )
+    {
+        VirtualFree( ptr, 0, MEM_RELEASE );
+    }
+#else
+    static void* map_pages( size_t bytes )
+    {
+        // Over-map by one huge page and trim, so the block starts on a huge page boundary and
+        // the kernel can back it with huge pages from the first byte.
+        size_t mapped = bytes + huge_page_size;
+        void* raw = mmap( nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if( raw == MAP_FAILED )
+        {
+            throw std::bad_alloc();
+        }
+        char* first = static_cast< char* >( raw );
+        char* aligned = reinterpret_cast< char* >( round_up( reinterpret_cast< uintptr_t >( first ) ) );
+        if( aligned != first )
+        {
+            munmap( first, aligned - first );
+        }
+        size_t tail = ( first + mapped ) - ( aligned + bytes );
+        if( tail != 0 )
+        {
+            munmap( aligned + bytes, tail );
+        }
+#ifdef MADV_HUGEPAGE
+        madvise( aligned, bytes, MADV_HUGEPAGE );
+#endif
+        return aligned;
+    }
+
+    static void unmap_pages( void* ptr, size_t bytes )
+    {
+        munmap( ptr, bytes );
+    }
+#endif
+};
+
+template< class T, class U >
+bool operator==( const huge_page_allocator< T >&, const huge_page_allocator< U >& )
+{
+    return true;
+}
+
+template< class T, class U >
+bool operator!=( const huge_page_allocator< T >&, const huge_page_allocator< U >& )
+{
+    return false;
+}
+
+}
+
+#endif // CCPPBRASIL_SOAALLOCATOR_H
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAARENA_IMPL_H
+#define CCPPBRASIL_SOAARENA_IMPL_H
+
+#include <algorithm>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// soa_arena
+//-------------------------------------------------------------------------------------------------
+inline soa_arena::scope::scope( soa_arena& arena ) :
+    previous_( installed() )
+{
+    installed() = &arena;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_arena::scope::~scope()
+{
+    installed() = previous_;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_arena::soa_arena( size_t chunk_bytes ) :
+    chunk_bytes_( std::max( chunk_bytes, size_t( 1024 ) ) ), chunks_( nullptr ), cursor_( nullptr ), end_( nullptr ),
+    last_( nullptr ), used_( 0 ), reserved_( 0 )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_arena::~soa_arena()
+{
+    while( chunks_ != nullptr )
+    {
+        chunk* next = chunks_->next;
+        ::operator delete( chunks_ );
+        chunks_ = next;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void* soa_arena::allocate( size_t bytes, size_t alignment )
+{
+    bytes = std::max( bytes, size_t( 1 ) );
+    uintptr_t aligned = ( reinterpret_cast< uintptr_t >( cursor_ ) + alignment - 1 ) & ~uintptr_t( alignment - 1 );
+    if( cursor_ == nullptr || aligned + bytes > reinterpret_cast< uintptr_t >( end_ ) )
+    {
+        add_chunk( bytes + alignment );
+        aligned = ( reinterpret_cast< uintptr_t >( cursor_ ) + alignment - 1 ) & ~uintptr_t( alignment - 1 );
+    }
+    last_ = reinterpret_cast< char* >( aligned );
+    cursor_ = last_ + bytes;
+    used_ += bytes;
+    return last_;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_arena::deallocate( void* ptr, size_t bytes )
+{
+    bytes = std::max( bytes, size_t( 1 ) );
+    if( ptr == last_ && last_ + bytes == cursor_ )
+    {
+        cursor_ = last_;
+        last_ = nullptr;
+        used_ -= bytes;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_arena::release()
+{
+    if( chunks_ == nullptr )
+    {
+        return;
+    }
+    chunk* keep = chunks_;
+    chunks_ = keep->next;
+    while( chunks_ != nullptr )
+    {
+        chunk* next = chunks_->next;
+        ::operator delete( chunks_ );
+        chunks_ = next;
+    }
+    keep->next = nullptr;
+    chunks_ = keep;
+    cursor_ = reinterpret_cast< char* >( keep + 1 );
+    end_ = reinterpret_cast< char* >( keep ) + keep->bytes;
+    last_ = nullptr;
+    used_ = 0;
+    reserved_ = keep->bytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t soa_arena::bytes_used() const
+{
+    return used_;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t soa_arena::bytes_reserved() const
+{
+    return reserved_;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_arena& soa_arena::current()
+{
+    static thread_local soa_arena own;
+    soa_arena* arena = installed();
+    return arena != nullptr ? *arena : own;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Blocks larger than a chunk get a chunk of their own.
+inline void soa_arena::add_chunk( size_t bytes )
+{
+    size_t chunkBytes = std::max( chunk_bytes_, bytes + sizeof( chunk ) );
+    chunk* fresh = static_cast< chunk* >( ::operator new( chunkBytes ) );
+    fresh->next = chunks_;
+    fresh->bytes = chunkBytes;
+    chunks_ = fresh;
+    cursor_ = reinterpret_cast< char* >( fresh + 1 );
+    end_ = reinterpret_cast< char* >( fresh ) + chunkBytes;
+    last_ = nullptr;
+    reserved_ += chunkBytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_arena*& soa_arena::installed()
+{
+    static thread_local soa_arena* arena = nullptr;
+    return arena;
+}
+
+//-------------------------------------------------------------------------------------------------
+// soa_pool
+//-------------------------------------------------------------------------------------------------
+inline soa_pool::scope::scope( soa_pool& pool ) :
+    previous_( installed() )
+{
+    installed() = &pool;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_pool::scope::~scope()
+{
+    installed() = previous_;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_pool::soa_pool( size_t chunk_bytes ) :
+    arena_( chunk_bytes )
+{
+    std::fill( free_, free_ + class_count, nullptr );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void* soa_pool::allocate( size_t bytes )
+{
+    if( bytes > max_block )
+    {
+        return ::operator new( bytes );
+    }
+    size_t c = size_class( bytes );
+    if( free_[ c ] != nullptr )
+    {
+        free_block* block = free_[ c ];
+        free_[ c ] = block->next;
+        return block;
+    }
+    return arena_.allocate( min_block << c, alignof( std::max_align_t ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_pool::deallocate( void* ptr, size_t bytes )
+{
+    if( bytes > max_block )
+    {
+        ::operator delete( ptr );
+        return;
+    }
+    size_t c = size_class( bytes );
+    free_block* block = static_cast< free_block* >( ptr );
+    block->next = free_[ c ];
+    free_[ c ] = block;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_pool::release()
+{
+    arena_.release();
+    std::fill( free_, free_ + class_count, nullptr );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t soa_pool::bytes_reserved() const
+{
+    return arena_.bytes_reserved();
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_pool& soa_pool::current()
+{
+    static thread_local soa_pool own;
+    soa_pool* pool = installed();
+    return pool != nullptr ? *pool : own;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t soa_pool::size_class( size_t bytes )
+{
+    size_t c = 0;
+    while( ( min_block << c ) < bytes )
+    {
+        ++c;
+    }
+    return c;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_pool*& soa_pool::installed()
+{
+    static thread_local soa_pool* pool = nullptr;
+    return pool;
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOAARENA_IMPL_H
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAARENA_H
+#define CCPPBRASIL_SOAARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace ccppbrasil {
+
+// Monotonic arena: blocks are carved one after the other from chunks taken from operator new,
+// and only handed back all at once by release(). deallocate() gives back just the last block
+// allocated, e.g. a scratch buffer dropped right away; a growing container allocates its new
+// block before freeing the old one, so old blocks stay used until release(). Meant for
+// short-lived containers created and dropped together, e.g. per request:
+//
+//     {
+//         soa_arena::scope use( arena );
+//         soa_map< size_t, size_t, std::less< size_t >, arena_allocator< size_t >,
+//                  arena_allocator< size_t > > map;
+//         ...
+//     }
+//     arena.release();
+//
+// An arena is not thread safe: every container using it stays on one thread. Each thread has
+// its own default arena, see current().
+class soa_arena
+{
+public:
+    // Makes arena the calling thread's current() one until the end of the scope.
+    class scope
+    {
+    public:
+        explicit scope( soa_arena& arena );
+        ~scope();
+
+    private:
+        scope( const scope& ) = delete;
+        scope& operator=( const scope& ) = delete;
+
+        soa_arena* previous_;
+    };
+
+    explicit soa_arena( size_t chunk_bytes = 64 * 1024 );
+    ~soa_arena();
+
+    void* allocate( size_t bytes, size_t alignment );
+    void deallocate( void* ptr, size_t bytes );
+
+    // Frees every block at once, keeping the newest chunk for the next blocks. Containers using
+    // the arena must be destroyed first.
+    void release();
+
+    // Bytes handed out since the last release(), and bytes of chunks held.
+    size_t bytes_used() const;
+    size_t bytes_reserved() const;
+
+    // The arena of the innermost soa_arena::scope on this thread, or the thread's own arena,
+    // destroyed at thread exit.
+    static soa_arena& current();
+
+private:
+    struct chunk
+    {
+        chunk* next;
+        size_t bytes;
+    };
+
+    soa_arena( const soa_arena& ) = delete;
+    soa_arena& operator=( const soa_arena& ) = delete;
+
+    void add_chunk( size_t bytes );
+    static soa_arena*& installed();
+
+    size_t chunk_bytes_;
+    chunk* chunks_;
+    char* cursor_;
+    char* end_;
+    char* last_;
+    size_t used_;
+    size_t reserved_;
+};
+
+// Size-class pool: blocks up to max_block bytes are rounded up to a power of two and recycled
+// through one free list per size class, carved from a soa_arena when the list is empty. Larger
+// blocks go to operator new. Suits containers of similar sizes created and destroyed
+// repeatedly, which then reuse each other's blocks without touching malloc. Same threading and
+// current() rules as soa_arena.
+class soa_pool
+{
+public:
+    static const size_t min_block = 16;
+    static const size_t max_block = 256 * 1024;
+
+    // Makes pool the calling thread's current() one until the end of the scope.
+    class scope
+    {
+    public:
+        explicit scope( soa_pool& pool );
+        ~scope();
+
+    private:
+        scope( const scope& ) = delete;
+        scope& operator=( const scope& ) = delete;
+
+        soa_pool* previous_;
+    };
+
+    explicit soa_pool( size_t chunk_bytes = 256 * 1024 );
+
+    void* allocate( size_t bytes );
+    void deallocate( void* ptr, size_t bytes );
+
+    // Frees every pooled block at once, free or not. Containers using the pool must be destroyed
+    // first.
+    void release();
+
+    size_t bytes_reserved() const;
+
+    static soa_pool& current();
+
+private:
+    static const size_t class_count = 15;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    soa_pool( const soa_pool& ) = delete;
+    soa_pool& operator=( const soa_pool& ) = delete;
+
+    static size_t size_class( size_t bytes );
+    static soa_pool*& installed();
+
+    soa_arena arena_;
+    free_block* free_[ class_count ];
+};
+
+// Allocators over a soa_arena or a soa_pool, for the KeyAllocator and ValueAllocator of the
+// containers; a soa_map takes its single block from KeyAllocator and needs the same allocator
+// for both. Default constructed ones use the current() arena or pool of the thread, so
+// containers built inside a scope allocate from its arena or pool.
+template< class T >
+class arena_allocator
+{
+public:
+    typedef T value_type;
+
+    template< class U >
+    struct rebind
+    {
+        typedef arena_allocator< U > other;
+    };
+
+    arena_allocator() : arena_( &soa_arena::current() ) {}
+    explicit arena_allocator( soa_arena& arena ) : arena_( &arena ) {}
+
+    template< class U >
+    arena_allocator( const arena_allocator< U >& other ) : arena_( other.arena() ) {}
+
+    T* allocate( size_t count )
+    {
+        return static_cast< T* >( arena_->allocate( count * sizeof( T ), alignof( T ) ) );
+    }
+
+    void deallocate( T* ptr, size_t count )
+    {
+        arena_->deallocate( ptr, count * sizeof( T ) );
+    }
+
+    soa_arena* arena() const { return arena_; }
+
+private:
+    soa_arena* arena_;
+};
+
+template< class T, class U >
+bool operator==( const arena_allocator< T >& lhs, const arena_allocator< U >& rhs )
+{
+    return lhs.arena() == rhs.arena();
+}
+
+template< class T, class U >
+bool operator!=( const arena_allocator< T >& lhs, const arena_allocator< U >& rhs )
+{
+    return lhs.arena() != rhs.arena();
+}
+
+template< class T >
+class pool_allocator
+{
+public:
+    typedef T value_type;
+
+    template< class U >
+    struct rebind
+    {
+        typedef pool_allocator< U > other;
+    };
+
+    pool_allocator() : pool_( &soa_pool::current() ) {}
+    explicit pool_allocator( soa_pool& pool ) : pool_( &pool ) {}
+
+    template< class U >
+    pool_allocator( const pool_allocator< U >& other ) : pool_( other.pool() ) {}
+
+    T* allocate( size_t count )
+    {
+        return static_cast< T* >( pool_->allocate( count * sizeof( T ) ) );
+    }
+
+    void deallocate( T* ptr, size_t count )
+    {
+        pool_->deallocate( ptr, count * sizeof( T ) );
+    }
+
+    soa_pool* pool() const { return pool_; }
+
+private:
+    soa_pool* pool_;
+};
+
+template< class T, class U >
+bool operator==( const pool_allocator< T >& lhs, const pool_allocator< U >& rhs )
+{
+    return lhs.pool() == rhs.pool();
+}
+
+template< class T, class U >
+bool operator!=( const pool_allocator< T >& lhs, const pool_allocator< U >& rhs )
+{
+    return lhs.pool() != rhs.pool();
+}
+
+}
+
+#include "soa_arena-impl.h"
+
+#endif // CCPPBRASIL_SOAARENA_H
@@ -0,0 +1,640 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOABENCHMARK_IMPL_H
+#define CCPPBRASIL_SOABENCHMARK_IMPL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <boost/timer/timer.hpp>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// benchmark_options
+//-------------------------------------------------------------------------------------------------
+inline benchmark_options benchmark_options::parse( int argc, char* argv[] )
+{
+    benchmark_options options;
+    for( int i = 1; i < argc; ++i )
+    {
+        std::string arg( argv[ i ] );
+        std::string::size_type eq = arg.find( '=' );
+        std::string key = arg.substr( 0, eq );
+        std::string value = ( eq == std::string::npos ) ? std::string() : arg.substr( eq + 1 );
+        char* end = nullptr;
+
+        if( key == "--list" || key == "--counters" || key == "--check" )
+        {
+            ( key == "--list" ? options.list : key == "--counters" ? options.counters : options.check ) = true;
+            continue;
+        }
+        if( eq == std::string::npos )
+        {
+            throw std::invalid_argument( "benchmark_options::parse: unknown option " + arg );
+        }
+        if( key == "--filter" )
+        {
+            options.filter = value;
+        }
+        else if( key == "--warmup" || key == "--repetitions" )
+        {
+            unsigned long count = std::strtoul( value.c_str(), &end, 10 );
+            if( value.empty() || *end != '\0' || ( key == "--repetitions" && count == 0 ) )
+            {
+                throw std::invalid_argument( "benchmark_options::parse: bad value in " + arg );
+            }
+            ( key == "--warmup" ? options.warmup : options.repetitions ) = count;
+        }
+        else if( key == "--seed" )
+        {
+            unsigned long long seed = std::strtoull( value.c_str(), &end, 10 );
+            if( value.empty() || *end != '\0' )
+            {
+                throw std::invalid_argument( "benchmark_options::parse: bad value in " + arg );
+            }
+            options.seed = seed;
+        }
+        else if( key == "--scale" || key == "--threshold" )
+        {
+            double number = std::strtod( value.c_str(), &end );
+            if( value.empty() || *end != '\0' || !( number > 0. ) )
+            {
+                throw std::invalid_argument( "benchmark_options::parse: bad value in " + arg );
+            }
+            ( key == "--scale" ? options.scale : options.threshold ) = number;
+        }
+        else if( key == "--format" )
+        {
+            if( value != "text" && value != "json" && value != "csv" )
+            {
+                throw std::invalid_argument( "benchmark_options::parse: bad value in " + arg );
+            }
+            options.format = value;
+        }
+        else if( key == "--out" )
+        {
+            options.out = value;
+        }
+        else if( key == "--compare" )
+        {
+            options.compare = value;
+        }
+        else
+        {
+            throw std::invalid_argument( "benchmark_options::parse: unknown option " + arg );
+        }
+    }
+    return options;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t benchmark_options::scaled( size_t size ) const
+{
+    double value = std::floor( static_cast< double >( size ) * scale );
+    return value < 1. ? 1 : static_cast< size_t >( value );
+}
+
+//-------------------------------------------------------------------------------------------------
+// benchmark_state
+//-------------------------------------------------------------------------------------------------
+inline benchmark_state::benchmark_state( size_t warmup, size_t repetitions, perf_counters* counters ) :
+    warmup_( warmup ), repetitions_( repetitions ), started_( 0 ), measured_( false ),
+    current_( 0. ), items_( 0 ), bytes_( 0 ), sink_( 0. ), perf_( counters ),
+    event_samples_( perf_counters::event_count )
+{
+    std::fill( events_, events_ + perf_counters::event_count, 0. );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline bool benchmark_state::next_repetition()
+{
+    finish_repetition();
+    if( started_ == warmup_ + repetitions_ )
+    {
+        return false;
+    }
+    ++started_;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline bool benchmark_state::warming_up() const
+{
+    return started_ <= warmup_;
+}
+
+//-------------------------------------------------------------------------------------------------
+// The counters start before the timer and stop after it, so their system calls are not timed.
+template< class Function >
+void benchmark_state::measure( Function function )
+{
+    if( perf_ != nullptr )
+    {
+        perf_->start();
+    }
+    boost::timer::cpu_timer timer;
+    timer.start();
+    function();
+    timer.stop();
+    current_ += static_cast< double >( timer.elapsed().wall );
+    measured_ = true;
+
+    if( perf_ != nullptr )
+    {
+        double values[ perf_counters::event_count ];
+        perf_->stop( values );
+        for( size_t i = 0; i < perf_counters::event_count; ++i )
+        {
+            events_[ i ] += values[ i ];
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void benchmark_state::set_items( uint64_t items )
+{
+    items_ = items;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void benchmark_state::set_bytes( uint64_t bytes )
+{
+    bytes_ = bytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void benchmark_state::counter( const std::string& name, double value )
+{
+    for( size_t i = 0; i < counters_.size(); ++i )
+    {
+        if( counters_[ i ].first == name )
+        {
+            counters_[ i ].second = value;
+            return;
+        }
+    }
+    counters_.push_back( std::make_pair( name, value ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void benchmark_state::keep( double value )
+{
+    sink_ = value;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Repetitions that never called measure() are not recorded.
+inline void benchmark_state::finish_repetition()
+{
+    if( started_ > warmup_ && measured_ )
+    {
+        samples_.push_back( current_ );
+        for( size_t i = 0; perf_ != nullptr && i < perf_counters::event_count; ++i )
+        {
+            event_samples_[ i ].push_back( events_[ i ] );
+        }
+    }
+    measured_ = false;
+    current_ = 0.;
+    std::fill( events_, events_ + perf_counters::event_count, 0. );
+}
+
+//-------------------------------------------------------------------------------------------------
+// benchmark_suite
+//-------------------------------------------------------------------------------------------------
+inline void benchmark_suite::add( const std::string& name, case_function function )
+{
+    cases_.push_back( std::make_pair( name, function ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Progress goes to stdout while the report does not, to stderr otherwise.
+inline int benchmark_suite::run( const benchmark_options& options )
+{
+    std::regex filter( options.filter );
+
+    std::ofstream file;
+    if( !options.out.empty() )
+    {
+        file.open( options.out.c_str() );
+        if( !file )
+        {
+            throw std::runtime_error( "benchmark_suite::run: cannot write " + options.out );
+        }
+    }
+    std::ostream& report = options.out.empty() ? std::cout : file;
+    std::ostream& progress = ( options.out.empty() && options.format != "text" ) ? std::cerr : std::cout;
+
+    std::unique_ptr< perf_counters > counters;
+    if( options.counters && !options.list )
+    {
+        counters.reset( new perf_counters );
+        if( !counters->available() )
+        {
+            std::cerr << "benchmark_suite::run: no hardware counters, wall clock only (" << counters->error() << ")"
+                      << std::endl;
+            counters.reset();
+        }
+        else if( !counters->error().empty() )
+        {
+            std::cerr << "benchmark_suite::run: some hardware counters missing (" << counters->error() << ")"
+                      << std::endl;
+        }
+    }
+
+    std::vector< benchmark_result > results;
+    for( size_t i = 0; i < cases_.size(); ++i )
+    {
+        if( !std::regex_search( cases_[ i ].first, filter ) )
+        {
+            continue;
+        }
+        if( options.list )
+        {
+            std::cout << cases_[ i ].first << std::endl;
+            continue;
+        }
+
+        benchmark_state state( options.warmup, options.repetitions, counters.get() );
+        cases_[ i ].second( state );
+        state.finish_repetition();
+        results.push_back( summarize( cases_[ i ].first, state ) );
+        write_text( progress, results.back() );
+    }
+
+    if( options.format == "json" )
+    {
+        write_json( report, results );
+    }
+    else if( options.format == "csv" )
+    {
+        write_csv( report, results );
+    }
+    else if( !options.out.empty() )
+    {
+        for( size_t i = 0; i < results.size(); ++i )
+        {
+            write_text( report, results[ i ] );
+        }
+    }
+
+    return options.compare.empty() ? 0 : compare( progress, results, options );
+}
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// samples must be sorted and not empty.
+inline double sorted_median( const std::vector< double >& samples )
+{
+    size_t n = samples.size();
+    return ( n % 2 ) ? samples[ n / 2 ] : ( samples[ n / 2 - 1 ] + samples[ n / 2 ] ) / 2.;
+}
+
+} // namespace detail
+
+//-------------------------------------------------------------------------------------------------
+inline benchmark_result benchmark_suite::summarize( const std::string& name, const benchmark_state& state )
+{
+    benchmark_result result;
+    result.name = name;
+    result.items = state.items_;
+    result.bytes = state.bytes_;
+    result.counters = state.counters_;
+
+    std::vector< double > samples( state.samples_ );
+    result.repetitions = samples.size();
+    if( samples.empty() )
+    {
+        return result;
+    }
+
+    std::sort( samples.begin(), samples.end() );
+    size_t n = samples.size();
+    result.min = samples.front();
+    result.median = detail::sorted_median( samples );
+    result.p99 = samples[ static_cast< size_t >( std::ceil( 0.99 * n ) ) - 1 ];
+
+    double sum = 0.;
+    for( size_t i = 0; i < n; ++i )
+    {
+        sum += samples[ i ];
+    }
+    result.mean = sum / n;
+
+    double squares = 0.;
+    for( size_t i = 0; i < n; ++i )
+    {
+        squares += ( samples[ i ] - result.mean ) * ( samples[ i ] - result.mean );
+    }
+    result.stddev = ( n > 1 ) ? std::sqrt( squares / ( n - 1 ) ) : 0.;
+
+    if( result.items != 0 && result.median > 0. )
+    {
+        result.ns_per_item = result.median / result.items;
+        result.items_per_second = result.items / result.median * 1e9;
+    }
+
+    // Hardware events, skipping the ones some repetition could not read
+    double medians[ perf_counters::event_count ];
+    for( size_t e = 0; e < perf_counters::event_count; ++e )
+    {
+        std::vector< double > events( state.event_samples_[ e ] );
+        medians[ e ] = std::numeric_limits< double >::quiet_NaN();
+        if( events.empty() || std::count_if( events.begin(), events.end(), []( double v ) { return std::isnan( v ); } ) != 0 )
+        {
+            continue;
+        }
+        std::sort( events.begin(), events.end() );
+        medians[ e ] = detail::sorted_median( events );
+        std::string event = perf_counters::name( static_cast< perf_event >( e ) );
+        if( result.items != 0 )
+        {
+            result.counters.push_back( std::make_pair( event + "_per_op", medians[ e ] / result.items ) );
+        }
+        else
+        {
+            result.counters.push_back( std::make_pair( event, medians[ e ] ) );
+        }
+    }
+    double cycles = medians[ static_cast< size_t >( perf_event::cycles ) ];
+    double instructions = medians[ static_cast< size_t >( perf_event::instructions ) ];
+    if( cycles > 0. && !std::isnan( instructions ) )
+    {
+        result.counters.push_back( std::make_pair( std::string( "ipc" ), instructions / cycles ) );
+    }
+    return result;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void benchmark_suite::write_text( std::ostream& out, const benchmark_result& result )
+{
+    std::ostringstream line;
+    line << std::left << std::setw( 60 ) << result.name << std::right << std::fixed << std::setprecision( 3 )
+         << " median " << std::setw( 10 ) << result.median / 1e6 << " ms"
+         << "  p99 " << std::setw( 10 ) << result.p99 / 1e6 << " ms"
+         << "  stddev " << std::setw( 8 ) << ( result.median > 0. ? result.stddev / result.median * 100. : 0. ) << " %";
+    if( result.items != 0 )
+    {
+        line << "  " << std::setw( 10 ) << result.ns_per_item << " ns/op  "
+             << std::setprecision( 2 ) << result.items_per_second / 1e6 << " M/s";
+    }
+    for( size_t i = 0; i < result.counters.size(); ++i )
+    {
+        line << "  " << result.counters[ i ].first << " " << std::setprecision( 6 ) << std::defaultfloat
+             << result.counters[ i ].second;
+    }
+    out << line.str() << std::endl;
+}
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+inline std::string json_string( const std::string& value )
+{
+    std::string quoted( "\"" );
+    for( size_t i = 0; i < value.size(); ++i )
+    {
+        if( value[ i ] == '"' || value[ i ] == '\\' )
+        {
+            quoted += '\\';
+        }
+        quoted += value[ i ];
+    }
+    return quoted + "\"";
+}
+
+//-------------------------------------------------------------------------------------------------
+inline std::string csv_string( const std::string& value )
+{
+    if( value.find_first_of( ",\"" ) == std::string::npos )
+    {
+        return value;
+    }
+    std::string quoted( "\"" );
+    for( size_t i = 0; i < value.size(); ++i )
+    {
+        quoted += ( value[ i ] == '"' ) ? "\"\"" : std::string( 1, value[ i ] );
+    }
+    return quoted + "\"";
+}
+
+} // namespace detail
+
+//-------------------------------------------------------------------------------------------------
+// One case per line, so reports diff well and read_baseline needs no json parser.
+inline void benchmark_suite::write_json( std::ostream& out, const std::vector< benchmark_result >& results )
+{
+    out << "{\n  \"benchmarks\": [\n" << std::setprecision( 17 );
+    for( size_t i = 0; i < results.size(); ++i )
+    {
+        const benchmark_result& r = results[ i ];
+        out << "    { \"name\": " << detail::json_string( r.name )
+            << ", \"repetitions\": " << r.repetitions
+            << ", \"min_ns\": " << r.min
+            << ", \"median_ns\": " << r.median
+            << ", \"mean_ns\": " << r.mean
+            << ", \"p99_ns\": " << r.p99
+            << ", \"stddev_ns\": " << r.stddev
+            << ", \"items\": " << r.items
+            << ", \"bytes\": " << r.bytes
+            << ", \"ns_per_item\": " << r.ns_per_item
+            << ", \"items_per_second\": " << r.items_per_second;
+        for( size_t c = 0; c < r.counters.size(); ++c )
+        {
+            out << ", " << detail::json_string( r.counters[ c ].first ) << ": " << r.counters[ c ].second;
+        }
+        out << " }" << ( i + 1 < results.size() ? "," : "" ) << "\n";
+    }
+    out << "  ]\n}" << std::endl;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Counters go in a last column as name=value pairs separated by ';'.
+inline void benchmark_suite::write_csv( std::ostream& out, const std::vector< benchmark_result >& results )
+{
+    out << "name,repetitions,min_ns,median_ns,mean_ns,p99_ns,stddev_ns,items,bytes,ns_per_item,items_per_second,counters\n"
+        << std::setprecision( 17 );
+    for( size_t i = 0; i < results.size(); ++i )
+    {
+        const benchmark_result& r = results[ i ];
+        std::string counters;
+        for( size_t c = 0; c < r.counters.size(); ++c )
+        {
+            std::ostringstream pair;
+            pair << std::setprecision( 17 ) << ( c ? ";" : "" ) << r.counters[ c ].first << "=" << r.counters[ c ].second;
+            counters += pair.str();
+        }
+        out << detail::csv_string( r.name ) << "," << r.repetitions << "," << r.min << "," << r.median << ","
+            << r.mean << "," << r.p99 << "," << r.stddev << "," << r.items << "," << r.bytes << ","
+            << r.ns_per_item << "," << r.items_per_second << "," << detail::csv_string( counters ) << "\n";
+    }
+    out.flush();
+}
+
+//-------------------------------------------------------------------------------------------------
+// Reads the reports written by write_json and write_csv.
+inline std::map< std::string, std::pair< double, double > > benchmark_suite::read_baseline( const std::string& path )
+{
+    std::ifstream in( path.c_str() );
+    if( !in )
+    {
+        throw std::runtime_error( "benchmark_suite::read_baseline: cannot open " + path );
+    }
+
+    std::map< std::string, std::pair< double, double > > baseline;
+    std::string line;
+    bool csv = false;
+    while( std::getline( in, line ) )
+    {
+        if( line.compare( 0, 5, "name," ) == 0 )
+        {
+            csv = true;
+            continue;
+        }
+
+        std::string name;
+        double median = 0.;
+        double stddev = 0.;
+        if( csv )
+        {
+            // name, repetitions, min, median, mean, p99, stddev, ...
+            size_t pos = 0;
+            if( !line.empty() && line[ 0 ] == '"' )
+            {
+                for( pos = 1; pos < line.size(); ++pos )
+                {
+                    if( line[ pos ] == '"' )
+                    {
+                        if( pos + 1 == line.size() || line[ pos + 1 ] != '"' )
+                        {
+                            ++pos;
+                            break;
+                        }
+                        ++pos;
+                    }
+                    name += line[ pos ];
+                }
+            }
+            else
+            {
+                pos = std::min( line.find( ',' ), line.size() );
+                name = line.substr( 0, pos );
+            }
+            std::vector< double > fields;
+            std::istringstream rest( pos < line.size() ? line.substr( pos + 1 ) : std::string() );
+            std::string field;
+            while( fields.size() < 6 && std::getline( rest, field, ',' ) )
+            {
+                fields.push_back( std::strtod( field.c_str(), nullptr ) );
+            }
+            if( fields.size() < 6 )
+            {
+                continue;
+            }
+            median = fields[ 2 ];
+            stddev = fields[ 5 ];
+        }
+        else
+        {
+            std::string::size_type key = line.find( "\"name\": \"" );
+            if( key == std::string::npos )
+            {
+                continue;
+            }
+            size_t pos = key + 9;
+            for( ; pos < line.size() && line[ pos ] != '"'; ++pos )
+            {
+                if( line[ pos ] == '\\' )
+                {
+                    ++pos;
+                }
+                name += line[ pos ];
+            }
+            std::string::size_type m = line.find( "\"median_ns\": ", pos );
+            std::string::size_type s = line.find( "\"stddev_ns\": ", pos );
+            if( m == std::string::npos || s == std::string::npos )
+            {
+                continue;
+            }
+            median = std::strtod( line.c_str() + m + 13, nullptr );
+            stddev = std::strtod( line.c_str() + s + 13, nullptr );
+        }
+        baseline[ name ] = std::make_pair( median, stddev );
+    }
+    return baseline;
+}
+
+//-------------------------------------------------------------------------------------------------
+// A case regresses when its median is slower by more than the threshold and the difference is
+// more than twice the combined standard deviation of both runs, so noise alone does not trip it.
+inline int benchmark_suite::compare( std::ostream& out, const std::vector< benchmark_result >& results,
+                                     const benchmark_options& options ) const
+{
+    std::map< std::string, std::pair< double, double > > baseline = read_baseline( options.compare );
+
+    int regressions = 0;
+    out << "\ncompared with " << options.compare << std::endl;
+    for( size_t i = 0; i < results.size(); ++i )
+    {
+        const benchmark_result& r = results[ i ];
+        std::map< std::string, std::pair< double, double > >::const_iterator it = baseline.find( r.name );
+        if( it == baseline.end() || it->second.first <= 0. )
+        {
+            out << std::left << std::setw( 60 ) << r.name << " new" << std::endl;
+            continue;
+        }
+
+        double delta = r.median - it->second.first;
+        double relative = delta / it->second.first;
+        double noise = 2. * std::sqrt( r.stddev * r.stddev + it->second.second * it->second.second );
+        const char* verdict = "";
+        if( relative > options.threshold && delta > noise )
+        {
+            verdict = "  REGRESSION";
+            ++regressions;
+        }
+        else if( -relative > options.threshold && -delta > noise )
+        {
+            verdict = "  improvement";
+        }
+        out << std::left << std::setw( 60 ) << r.name << std::right << std::fixed << std::setprecision( 3 )
+            << " " << std::setw( 10 ) << it->second.first / 1e6 << " ms -> " << std::setw( 10 ) << r.median / 1e6
+            << " ms  " << std::showpos << std::setprecision( 1 ) << relative * 100. << std::noshowpos << " %"
+            << verdict << std::endl;
+    }
+    out << regressions << " regressions" << std::endl;
+    return regressions == 0 ? 0 : 1;
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOABENCHMARK_IMPL_H
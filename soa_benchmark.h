@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOABENCHMARK_H
+#define CCPPBRASIL_SOABENCHMARK_H
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "soa_perf_counters.h"
+
+namespace ccppbrasil {
+
+// Command line of a benchmark_suite run:
+//   --filter=REGEX       run the cases whose name matches REGEX (ECMAScript, searched anywhere)
+//   --list               print the case names and exit
+//   --warmup=N           untimed repetitions before the measured ones (1)
+//   --repetitions=N      measured repetitions per case (10)
+//   --scale=F            multiply the problem sizes the cases ask for by F (1)
+//   --format=FMT         report as text, json or csv (text)
+//   --out=PATH           write the report to PATH instead of stdout
+//   --compare=PATH       compare the medians with a json or csv report saved before
+//   --threshold=F        relative slowdown counted as a regression by --compare (0.05)
+//   --counters           also count hardware events around the timed regions, see perf_counters
+//   --seed=N             seed of the generated workloads, the same seed replays them (1)
+//   --check              compare the kernels of every instruction set with scalar loops and exit
+struct benchmark_options
+{
+    std::string filter;
+    bool list = false;
+    size_t warmup = 1;
+    size_t repetitions = 10;
+    double scale = 1.;
+    std::string format = "text";
+    std::string out;
+    std::string compare;
+    double threshold = 0.05;
+    bool counters = false;
+    bool check = false;
+    uint64_t seed = 1;
+
+    // Throws std::invalid_argument on an unknown option or a bad value.
+    static benchmark_options parse( int argc, char* argv[] );
+
+    // size * scale, at least 1. Cases put the scaled sizes in their names, so only runs with the
+    // same --scale compare.
+    size_t scaled( size_t size ) const;
+};
+
+// Summary of the measured repetitions of one case. Times are wall clock nanoseconds per
+// repetition; ns_per_item and items_per_second use the items set by the case. With --counters the
+// median of every hardware event follows the counters of the case, per item as "<event>_per_op"
+// when the case set its items, along with the instructions per cycle as "ipc".
+struct benchmark_result
+{
+    std::string name;
+    size_t repetitions = 0;
+    double min = 0.;
+    double median = 0.;
+    double mean = 0.;
+    double p99 = 0.;
+    double stddev = 0.;
+    uint64_t items = 0;
+    uint64_t bytes = 0;
+    double ns_per_item = 0.;
+    double items_per_second = 0.;
+    std::vector< std::pair< std::string, double > > counters;
+};
+
+// Handed to a case. The case runs its setup, then one repetition per next_repetition() call;
+// only the work passed to measure() is timed.
+//
+//     MapType map;
+//     fill( map, size );
+//     state.set_items( size );
+//     while( state.next_repetition() )
+//     {
+//         state.measure( [ & ]() { find( map, size ); } );
+//     }
+class benchmark_state
+{
+public:
+    // counters, when not null, are read around every measure() call.
+    benchmark_state( size_t warmup, size_t repetitions, perf_counters* counters = nullptr );
+
+    // False once the warmup and measured repetitions are done.
+    bool next_repetition();
+    bool warming_up() const;
+
+    // Times function() and adds it to the current repetition.
+    template< class Function >
+    void measure( Function function );
+
+    // Operations and bytes processed by one repetition.
+    void set_items( uint64_t items );
+    void set_bytes( uint64_t bytes );
+
+    // Extra value reported with the case, e.g. the bytes of a search layout.
+    void counter( const std::string& name, double value );
+
+    // Keeps a result alive, so the work computing it is not optimized away.
+    void keep( double value );
+
+private:
+    friend class benchmark_suite;
+
+    void finish_repetition();
+
+    size_t warmup_;
+    size_t repetitions_;
+    size_t started_;
+    bool measured_;
+    double current_;
+    std::vector< double > samples_;
+    uint64_t items_;
+    uint64_t bytes_;
+    std::vector< std::pair< std::string, double > > counters_;
+    volatile double sink_;
+    perf_counters* perf_;
+    double events_[ perf_counters::event_count ];
+    std::vector< std::vector< double > > event_samples_;
+};
+
+// Registry of named cases, run with the options of the command line.
+class benchmark_suite
+{
+public:
+    typedef std::function< void( benchmark_state& ) > case_function;
+
+    void add( const std::string& name, case_function function );
+
+    // Runs the selected cases and writes the report. Returns the process exit code: 0, or 1
+    // when --compare found a regression.
+    int run( const benchmark_options& options );
+
+    static benchmark_result summarize( const std::string& name, const benchmark_state& state );
+    static void write_text( std::ostream& out, const benchmark_result& result );
+    static void write_json( std::ostream& out, const std::vector< benchmark_result >& results );
+    static void write_csv( std::ostream& out, const std::vector< benchmark_result >& results );
+
+    // Median and standard deviation of every case in a json or csv report.
+    static std::map< std::string, std::pair< double, double > > read_baseline( const std::string& path );
+
+private:
+    int compare( std::ostream& out, const std::vector< benchmark_result >& results, const benchmark_options& options ) const;
+
+    std::vector< std::pair< std::string, case_function > > cases_;
+};
+
+}
+
+#include "soa_benchmark-impl.h"
+
+#endif // CCPPBRASIL_SOABENCHMARK_H
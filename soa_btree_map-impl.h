@@ -0,0 +1,706 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOABTREEMAP_IMPL_H
+#define CCPPBRASIL_SOABTREEMAP_IMPL_H
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// soa_btree_iterator
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::soa_btree_iterator( map_type& obj, leaf_type* leaf, size_t slot ) :
+    soa_map_( &obj ), leaf_( leaf ), slot_( slot )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+const KeyType& soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::key() const
+{
+    return leaf_->keys[ slot_ ];
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+ValueType& soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::value() const
+{
+    return leaf_->values[ slot_ ];
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::leaf_type* soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::leaf() const
+{
+    return leaf_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+size_t soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::slot() const
+{
+    return slot_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::ref_type
+soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::dereference() const
+{
+    return ref_type( key(), value() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+bool soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::equal( const soa_btree_iterator& other ) const
+{
+    return leaf_ == other.leaf_ && slot_ == other.slot_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::increment()
+{
+    if( ++slot_ == leaf_->size )
+    {
+        leaf_ = leaf_->next;
+        slot_ = 0;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// end() has no leaf, decrementing it goes to the last one.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_iterator<KeyType, ValueType, KeyCompare, LeafSize >::decrement()
+{
+    if( slot_ == 0 )
+    {
+        leaf_ = ( leaf_ == nullptr ) ? soa_map_->last_ : leaf_->prev;
+        slot_ = leaf_->size;
+    }
+    --slot_;
+}
+
+//-------------------------------------------------------------------------------------------------
+// soa_btree_map
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::soa_btree_map( soa_btree_map &&other )
+{
+    swap( other );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >& soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::operator=( soa_btree_map &&other )
+{
+    clear();
+    swap( other );
+    return *this;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::~soa_btree_map()
+{
+    clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+// Nodes are allocated one at a time as the tree grows, there is nothing to reserve.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::reserve( size_t )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+size_t soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::size() const
+{
+    return size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+bool soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::empty() const
+{
+    return size_ == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::clear()
+{
+    if( root_ != nullptr )
+    {
+        destroy( root_, depth_ );
+    }
+    size_ = 0;
+    depth_ = 0;
+    root_ = nullptr;
+    first_ = nullptr;
+    last_ = nullptr;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+bool soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::insert( const std::pair< KeyType, ValueType > &keyValuePair )
+{
+    return emplace( KeyType( keyValuePair.first ), ValueType( keyValuePair.second ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+bool soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::emplace( KeyType && refKey, ValueType && value )
+{
+    KeyType key( std::forward<KeyType>( refKey ) );
+
+    if( root_ == nullptr )
+    {
+        first_ = last_ = new_leaf();
+        root_ = first_;
+    }
+
+    path_type path;
+    leaf_type* leaf = find_leaf( key, &path );
+    size_t slot = leaf_lower_bound( *leaf, key );
+
+    if( slot < leaf->size && !KeyCompare()( key, leaf->keys[ slot ] ) )
+    {
+        return false;
+    }
+
+    prepare_insert( path, leaf, slot, key );
+
+    std::move_backward( leaf->keys + slot, leaf->keys + leaf->size, leaf->keys + leaf->size + 1 );
+    std::move_backward( leaf->values + slot, leaf->values + leaf->size, leaf->values + leaf->size + 1 );
+    leaf->keys[ slot ] = std::move( key );
+    leaf->values[ slot ] = std::forward<ValueType>( value );
+    ++leaf->size;
+    ++size_;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+// An underflowing leaf is fixed before returning, which may move the next key to another leaf;
+// it is looked up again then.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::erase( const KeyType &key )
+{
+    if( root_ == nullptr )
+    {
+        return end();
+    }
+
+    path_type path;
+    leaf_type* leaf = find_leaf( key, &path );
+    size_t slot = leaf_lower_bound( *leaf, key );
+    if( slot == leaf->size || KeyCompare()( key, leaf->keys[ slot ] ) )
+    {
+        return end();
+    }
+
+    std::move( leaf->keys + slot + 1, leaf->keys + leaf->size, leaf->keys + slot );
+    std::move( leaf->values + slot + 1, leaf->values + leaf->size, leaf->values + slot );
+    --leaf->size;
+    --size_;
+
+    if( depth_ == 0 && leaf->size == 0 )
+    {
+        clear();
+        return end();
+    }
+    if( depth_ == 0 || leaf->size >= min_leaf )
+    {
+        return make_iterator( leaf, slot );
+    }
+
+    bool hasNext = ( slot < leaf->size ) || ( leaf->next != nullptr );
+    KeyType next = ( slot < leaf->size ) ? leaf->keys[ slot ] : hasNext ? leaf->next->keys[ 0 ] : KeyType();
+    rebalance_leaf( path );
+    return hasNext ? lower_bound( next ) : end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::swap( soa_btree_map &other )
+{
+    std::swap( size_, other.size_ );
+    std::swap( depth_, other.depth_ );
+    std::swap( root_, other.root_ );
+    std::swap( first_, other.first_ );
+    std::swap( last_, other.last_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+ValueType& soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::at( const KeyType & key )
+{
+    auto pos = find( key );
+
+    if( end() != pos )
+    {
+        return pos.value();
+    }
+    throw std::out_of_range( "" );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+const ValueType& soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::at( const KeyType & key ) const
+{
+    return const_cast< soa_btree_map* >( this )->at( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+ValueType& soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::operator[]( const KeyType &key )
+{
+    auto pos = find( key );
+
+    if( end() != pos )
+    {
+        return pos.value();
+    }
+
+    insert( { key, ValueType() } );
+    return find( key ).value();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::begin()
+{
+    return iterator( *this, first_, 0 );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::const_iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::begin() const
+{
+    return const_cast< soa_btree_map* >( this )->begin();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::end()
+{
+    return iterator( *this, nullptr, 0 );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::const_iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::end() const
+{
+    return const_cast< soa_btree_map* >( this )->end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::lower_bound( const KeyType &key )
+{
+    if( root_ == nullptr )
+    {
+        return end();
+    }
+
+    leaf_type* leaf = find_leaf( key );
+    return make_iterator( leaf, leaf_lower_bound( *leaf, key ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::const_iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::lower_bound( const KeyType &key ) const
+{
+    return const_cast< soa_btree_map* >( this )->lower_bound( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::upper_bound( const KeyType &key )
+{
+    if( root_ == nullptr )
+    {
+        return end();
+    }
+
+    leaf_type* leaf = find_leaf( key );
+    size_t slot = leaf_lower_bound( *leaf, key );
+    if( slot < leaf->size && !KeyCompare()( key, leaf->keys[ slot ] ) )
+    {
+        ++slot;
+    }
+    return make_iterator( leaf, slot );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::const_iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::upper_bound( const KeyType &key ) const
+{
+    return const_cast< soa_btree_map* >( this )->upper_bound( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::find( const KeyType &key )
+{
+    auto pos = lower_bound( key );
+    if( end() != pos && !KeyCompare()( key, pos.key() ) )
+    {
+        return pos;
+    }
+    return end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::const_iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::find( const KeyType &key ) const
+{
+    return const_cast< soa_btree_map* >( this )->find( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Walks down from the root to the leaf that holds key, or would hold it, and records the path
+// when asked to. The map must not be empty.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::leaf_type* soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::find_leaf( const KeyType &key, path_type* path ) const
+{
+    detail::btree_node* node = root_;
+    for( size_t level = 0; level < depth_; ++level )
+    {
+        const inner_type& inner = *static_cast< const inner_type* >( node );
+        size_t idx = child_index( inner, key );
+        if( path != nullptr )
+        {
+            path->nodes[ level ] = const_cast< inner_type* >( &inner );
+            path->slots[ level ] = idx;
+        }
+        node = inner.children[ idx ];
+    }
+    return static_cast< leaf_type* >( node );
+}
+
+//-------------------------------------------------------------------------------------------------
+// The last child whose separator is not greater than key, or the first child. Separators that
+// fit a vector lane are all counted, other keys are binary searched.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+size_t soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::child_index( const inner_type &node, const KeyType &key ) const
+{
+    typedef detail::simd_key_for< KeyType, KeyCompare > lanes;
+    size_t count = node.size - 1;
+    const KeyType* separators = node.keys + 1;
+    size_t idx = ( lanes::value != detail::simd_key::none )
+                     ? detail::count_less( separators, count, key, KeyCompare(), lanes() )
+                     : detail::branchless_lower_bound( separators, count, key, KeyCompare() );
+    if( idx < count && !KeyCompare()( key, separators[ idx ] ) )
+    {
+        ++idx;
+    }
+    return idx;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+size_t soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::leaf_lower_bound( const leaf_type &leaf, const KeyType &key ) const
+{
+    return detail::branchless_lower_bound( leaf.keys, leaf.size, key, KeyCompare() );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Moves a position past the end of a leaf to the start of the next one.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::iterator
+soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::make_iterator( leaf_type* leaf, size_t slot )
+{
+    if( slot == leaf->size )
+    {
+        return iterator( *this, leaf->next, 0 );
+    }
+    return iterator( *this, leaf, slot );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+typename soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::leaf_type* soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::new_leaf()
+{
+    leaf_type* leaf = new leaf_type;
+    leaf->size = 0;
+    leaf->prev = nullptr;
+    leaf->next = nullptr;
+    return leaf;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Makes room for key at ( leaf, slot ), splitting the leaf when it is full. Updates leaf and slot
+// when the slot moved to the new leaf.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::prepare_insert( path_type &path, leaf_type* &leaf, size_t &slot, const KeyType &key )
+{
+    if( leaf->size < LeafSize )
+    {
+        return;
+    }
+
+    leaf_type* next = new_leaf();
+    next->prev = leaf;
+    next->next = leaf->next;
+    ( leaf->next != nullptr ? leaf->next->prev : last_ ) = next;
+    leaf->next = next;
+
+    if( slot == LeafSize && next == last_ )
+    {
+        // Appending past the last key: the new key starts the new leaf.
+        insert_child( path, key, next );
+        leaf = next;
+        slot = 0;
+        return;
+    }
+
+    const size_t half = LeafSize / 2;
+    std::move( leaf->keys + half, leaf->keys + LeafSize, next->keys );
+    std::move( leaf->values + half, leaf->values + LeafSize, next->values );
+    next->size = LeafSize - half;
+    leaf->size = half;
+    insert_child( path, next->keys[ 0 ], next );
+
+    if( slot > half )
+    {
+        leaf = next;
+        slot -= half;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Adds child right after the last node of path, splitting the inner nodes that are full on the
+// way up. A split of the root adds a level.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::insert_child( path_type &path, KeyType separator, detail::btree_node* child )
+{
+    const bool append = ( child == last_ );
+    for( size_t level = depth_; level-- > 0; )
+    {
+        inner_type* node = path.nodes[ level ];
+        size_t pos = path.slots[ level ] + 1;
+        inner_type* next = nullptr;
+
+        if( node->size == inner_size )
+        {
+            // The separator of the new node goes up from its keys[ 0 ]. Past the last leaf the
+            // new node starts with the new child alone, as leaves do.
+            const size_t half = ( append && pos == inner_size ) ? inner_size : inner_size / 2;
+            next = new inner_type;
+            std::move( node->keys + half, node->keys + inner_size, next->keys );
+            std::copy( node->children + half, node->children + inner_size, next->children );
+            next->size = inner_size - half;
+            node->size = half;
+            if( half == inner_size || pos > half )
+            {
+                node = next;
+                pos -= half;
+            }
+        }
+
+        std::move_backward( node->keys + pos, node->keys + node->size, node->keys + node->size + 1 );
+        std::copy_backward( node->children + pos, node->children + node->size, node->children + node->size + 1 );
+        node->keys[ pos ] = std::move( separator );
+        node->children[ pos ] = child;
+        ++node->size;
+
+        if( next == nullptr )
+        {
+            return;
+        }
+        separator = std::move( next->keys[ 0 ] );
+        child = next;
+    }
+
+    inner_type* root = new inner_type;
+    root->size = 2;
+    root->keys[ 1 ] = std::move( separator );
+    root->children[ 0 ] = root_;
+    root->children[ 1 ] = child;
+    root_ = root;
+    ++depth_;
+}
+
+//-------------------------------------------------------------------------------------------------
+// The leaf at the end of path is under min_leaf keys: merges it with a sibling, or moves keys
+// from the sibling until both hold half.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::rebalance_leaf( path_type &path )
+{
+    inner_type& parent = *path.nodes[ depth_ - 1 ];
+    size_t pos = path.slots[ depth_ - 1 ];
+    size_t leftPos = ( pos > 0 ) ? pos - 1 : pos;
+    leaf_type& left = *static_cast< leaf_type* >( parent.children[ leftPos ] );
+    leaf_type& right = *static_cast< leaf_type* >( parent.children[ leftPos + 1 ] );
+
+    if( left.size + right.size <= LeafSize )
+    {
+        std::move( right.keys, right.keys + right.size, left.keys + left.size );
+        std::move( right.values, right.values + right.size, left.values + left.size );
+        left.size += right.size;
+        left.next = right.next;
+        ( right.next != nullptr ? right.next->prev : last_ ) = &left;
+        delete &right;
+        remove_child( path, depth_ - 1, leftPos + 1 );
+        return;
+    }
+
+    size_t half = ( left.size + right.size ) / 2;
+    if( left.size > half )
+    {
+        size_t count = left.size - half;
+        std::move_backward( right.keys, right.keys + right.size, right.keys + right.size + count );
+        std::move_backward( right.values, right.values + right.size, right.values + right.size + count );
+        std::move( left.keys + half, left.keys + left.size, right.keys );
+        std::move( left.values + half, left.values + left.size, right.values );
+        left.size = half;
+        right.size += count;
+    }
+    else
+    {
+        size_t count = half - left.size;
+        std::move( right.keys, right.keys + count, left.keys + left.size );
+        std::move( right.values, right.values + count, left.values + left.size );
+        std::move( right.keys + count, right.keys + right.size, right.keys );
+        std::move( right.values + count, right.values + right.size, right.values );
+        left.size = half;
+        right.size -= count;
+    }
+    parent.keys[ leftPos + 1 ] = right.keys[ 0 ];
+}
+
+//-------------------------------------------------------------------------------------------------
+// Removes children[ pos ] from the inner node at level of path. A node left under min_inner
+// children merges with or borrows from a sibling, which may go on up to the root; a root left
+// with one child is replaced by it.
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::remove_child( path_type &path, size_t level, size_t pos )
+{
+    for( ;; )
+    {
+        inner_type& node = *path.nodes[ level ];
+        std::move( node.keys + pos + 1, node.keys + node.size, node.keys + pos );
+        std::copy( node.children + pos + 1, node.children + node.size, node.children + pos );
+        --node.size;
+
+        if( level == 0 )
+        {
+            if( node.size == 1 )
+            {
+                root_ = node.children[ 0 ];
+                --depth_;
+                delete &node;
+            }
+            return;
+        }
+        if( node.size >= min_inner )
+        {
+            return;
+        }
+
+        inner_type& parent = *path.nodes[ level - 1 ];
+        size_t nodePos = path.slots[ level - 1 ];
+        size_t leftPos = ( nodePos > 0 ) ? nodePos - 1 : nodePos;
+        inner_type& left = *static_cast< inner_type* >( parent.children[ leftPos ] );
+        inner_type& right = *static_cast< inner_type* >( parent.children[ leftPos + 1 ] );
+        KeyType& separator = parent.keys[ leftPos + 1 ];
+
+        if( left.size + right.size <= inner_size )
+        {
+            // The parent separator becomes the one of right's first child.
+            left.keys[ left.size ] = std::move( separator );
+            std::move( right.keys + 1, right.keys + right.size, left.keys + left.size + 1 );
+            std::copy( right.children, right.children + right.size, left.children + left.size );
+            left.size += right.size;
+            delete &right;
+            --level;
+            pos = leftPos + 1;
+            continue;
+        }
+
+        // Rotates children through the parent separator until both hold half.
+        size_t half = ( left.size + right.size ) / 2;
+        if( left.size > half )
+        {
+            size_t count = left.size - half;
+            std::move_backward( right.keys + 1, right.keys + right.size, right.keys + right.size + count );
+            std::copy_backward( right.children, right.children + right.size, right.children + right.size + count );
+            right.keys[ count ] = std::move( separator );
+            std::move( left.keys + half + 1, left.keys + left.size, right.keys + 1 );
+            std::copy( left.children + half, left.children + left.size, right.children );
+            separator = std::move( left.keys[ half ] );
+            left.size = half;
+            right.size += count;
+        }
+        else
+        {
+            size_t count = half - left.size;
+            left.keys[ left.size ] = std::move( separator );
+            std::move( right.keys + 1, right.keys + count, left.keys + left.size + 1 );
+            std::copy( right.children, right.children + count, left.children + left.size );
+            separator = std::move( right.keys[ count ] );
+            std::move( right.keys + count + 1, right.keys + right.size, right.keys + 1 );
+            std::copy( right.children + count, right.children + right.size, right.children );
+            left.size = half;
+            right.size -= count;
+        }
+        return;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, size_t LeafSize >
+void soa_btree_map<KeyType, ValueType, KeyCompare, LeafSize >::destroy( detail::btree_node* node, size_t depth )
+{
+    if( depth == 0 )
+    {
+        delete static_cast< leaf_type* >( node );
+        return;
+    }
+
+    inner_type* inner = static_cast< inner_type* >( node );
+    for( size_t i = 0; i < inner->size; ++i )
+    {
+        destroy( inner->children[ i ], depth - 1 );
+    }
+    delete inner;
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOABTREEMAP_IMPL_H
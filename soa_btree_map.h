@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOABTREEMAP_H
+#define CCPPBRASIL_SOABTREEMAP_H
+
+#include <vector>
+#include <memory>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include "soa_search.h"
+
+namespace ccppbrasil {
+
+template< class KeyType,
+          class ValueType,
+          class KeyCompare = std::less< KeyType >,
+          size_t LeafSize = 256 >
+class soa_btree_map;
+
+namespace detail {
+
+// Header of the inner nodes and leaves of a soa_btree_map: the number of keys in a leaf, of
+// children in an inner node.
+struct btree_node
+{
+    size_t size;
+};
+
+// Leaf of a soa_btree_map. The leaves are linked in key order, so iterators walk them without
+// going back to the inner nodes.
+template< class KeyType, class ValueType, size_t LeafSize >
+struct btree_leaf : btree_node
+{
+    btree_leaf* prev;
+    btree_leaf* next;
+    KeyType keys[ LeafSize ];
+    ValueType values[ LeafSize ];
+};
+
+}
+
+template< class KeyType,
+          class ValueType,
+          class KeyCompare,
+          size_t LeafSize >
+class soa_btree_iterator : public boost::iterator_facade< soa_btree_iterator< KeyType, ValueType, KeyCompare, LeafSize >,
+                                                          std::pair< const KeyType, ValueType >,
+                                                          boost::bidirectional_traversal_tag,
+                                                          std::pair< const KeyType&, ValueType& > >
+{
+public:
+    typedef soa_btree_map< KeyType, ValueType, KeyCompare, LeafSize > map_type;
+    typedef detail::btree_leaf< KeyType, ValueType, LeafSize > leaf_type;
+    typedef std::pair< const KeyType&, ValueType& > ref_type;
+
+    soa_btree_iterator( map_type& obj, leaf_type* leaf, size_t slot );
+
+    const KeyType& key() const;
+    ValueType& value() const;
+
+    leaf_type* leaf() const;
+    size_t slot() const;
+
+private:
+    friend class boost::iterator_core_access;
+
+    ref_type dereference() const;
+    bool equal( const soa_btree_iterator& other ) const;
+    void increment();
+    void decrement();
+
+    map_type* soa_map_;
+    leaf_type* leaf_;
+    size_t slot_;
+};
+
+// Ordered map for write-heavy workloads, a B+-tree of struct of arrays leaves.
+//
+// Every leaf holds up to LeafSize keys and values in two fixed arrays, so an insert or erase only
+// shifts within one leaf. Inner nodes hold up to inner_size children and the keys that separate
+// them. Integer and floating point separators are counted with the linear scan kernel soa_map ends
+// its searches with, so the loads of a node go out together instead of one cache miss per halving.
+// A full node splits in two and the split goes up the path to the root, so an insert or erase
+// touches O(log n) nodes. Appending past the last key starts new nodes instead of splitting, so
+// sequential fills keep the nodes full. A node left with less than a quarter of its capacity
+// merges with a sibling, or borrows from it when both do not fit in one node. Iterators address
+// ( leaf, slot ) and are invalidated by inserts and erases.
+template< class KeyType,
+          class ValueType,
+          class KeyCompare,
+          size_t LeafSize >
+class soa_btree_map
+{
+public:
+    typedef soa_btree_iterator< KeyType, ValueType, KeyCompare, LeafSize >          iterator;
+    typedef const soa_btree_iterator< KeyType, ValueType, KeyCompare, LeafSize >    const_iterator;
+
+    // Children of an inner node.
+    static const size_t inner_size = 64;
+
+    soa_btree_map() = default;
+    soa_btree_map( soa_btree_map &&other );
+    soa_btree_map& operator=( soa_btree_map &&other );
+    ~soa_btree_map();
+
+    void reserve( size_t capacity );
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    bool insert( const std::pair< KeyType, ValueType > &keyValuePair );
+
+    bool emplace( KeyType && moveKey, ValueType && value );
+
+    iterator erase( const KeyType &key );
+
+    void swap( soa_btree_map &other );
+
+    ValueType& at( const KeyType & key );
+    const ValueType& at( const KeyType & key ) const;
+
+    ValueType& operator[]( const KeyType &key );
+
+    iterator begin();
+    const_iterator begin() const;
+
+    iterator end();
+    const_iterator end() const;
+
+    iterator lower_bound( const KeyType &key );
+    const_iterator lower_bound( const KeyType &key ) const;
+
+    iterator upper_bound( const KeyType &key );
+    const_iterator upper_bound( const KeyType &key ) const;
+
+    iterator find( const KeyType &key );
+    const_iterator find( const KeyType &key ) const;
+
+private:
+    typedef detail::btree_leaf< KeyType, ValueType, LeafSize > leaf_type;
+
+    static_assert( LeafSize >= 2, "a soa_btree_map leaf needs room for 2 keys" );
+
+    // keys[ i ] separates children[ i - 1 ] from children[ i ]: every key under children[ i - 1 ]
+    // is less than it, and no key under children[ i ] is. keys[ 0 ] is not used.
+    struct inner_type : detail::btree_node
+    {
+        KeyType keys[ inner_size ];
+        detail::btree_node* children[ inner_size ];
+    };
+
+    // Fewest keys of a leaf and children of an inner node, other than the root, before they
+    // merge or borrow.
+    static const size_t min_leaf = ( LeafSize < 8 ) ? 1 : LeafSize / 4;
+    static const size_t min_inner = inner_size / 4;
+
+    // Inner nodes other than the root keep at least min_inner children, so below 2^64 keys the
+    // tree has at most log16( 2^64 ) + 1 inner levels.
+    static const size_t max_depth = 24;
+
+    // Inner nodes from the root down to a leaf and the child taken in each one.
+    struct path_type
+    {
+        inner_type* nodes[ max_depth ];
+        size_t slots[ max_depth ];
+    };
+
+    friend class soa_btree_iterator< KeyType, ValueType, KeyCompare, LeafSize >;
+
+    leaf_type* find_leaf( const KeyType &key, path_type* path = nullptr ) const;
+    size_t child_index( const inner_type &node, const KeyType &key ) const;
+    size_t leaf_lower_bound( const leaf_type &leaf, const KeyType &key ) const;
+    iterator make_iterator( leaf_type* leaf, size_t slot );
+    leaf_type* new_leaf();
+    void prepare_insert( path_type &path, leaf_type* &leaf, size_t &slot, const KeyType &key );
+    void insert_child( path_type &path, KeyType separator, detail::btree_node* child );
+    void rebalance_leaf( path_type &path );
+    void remove_child( path_type &path, size_t level, size_t pos );
+    void destroy( detail::btree_node* node, size_t depth );
+
+    size_t size_ = 0;
+    size_t depth_ = 0;      // inner levels above the leaves
+    detail::btree_node* root_ = nullptr;
+    leaf_type* first_ = nullptr;
+    leaf_type* last_ = nullptr;
+};
+
+}
+
+#include "soa_btree_map-impl.h"
+
+#endif // CCPPBRASIL_SOABTREEMAP_H
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOACOLUMNS_H
+#define CCPPBRASIL_SOACOLUMNS_H
+
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "soa_snapshot.h"
+#include "soa_vector.h"
+
+namespace ccppbrasil {
+
+// Value type of a map that keeps every field in its own column:
+//
+//     soa_map< size_t, soa_columns< float, float, int > >
+//
+// It is a std::tuple, so std::get< I > works on it. Reading a stored row gives a std::tuple of
+// references instead, one per column.
+template< class... Ts >
+class soa_columns : public std::tuple< Ts... >
+{
+public:
+    soa_columns() {}
+    soa_columns( const Ts&... values ) : std::tuple< Ts... >( values... ) {}
+    soa_columns( const std::tuple< Ts... >& values ) : std::tuple< Ts... >( values ) {}
+};
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Type of column I of a value type: the field for soa_columns, the value itself otherwise.
+template< class ValueType, size_t I >
+struct column_element
+{
+    static_assert( I == 0, "a single value soa_map has only column 0" );
+    typedef ValueType type;
+};
+
+template< size_t I, class... Ts >
+struct column_element< soa_columns< Ts... >, I >
+{
+    typedef typename std::tuple_element< I, std::tuple< Ts... > >::type type;
+};
+
+//-------------------------------------------------------------------------------------------------
+// Key and value columns of a soa_map: a basic_soa_vector with the key in column 0 and the value
+// in column 1, so both live in one block and grow together. The block comes from KeyAllocator
+// rebound to char; ValueAllocator must rebind to the same allocator, it only types
+// container_type.
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyAllocator, class ValueAllocator >
+class map_columns
+{
+public:
+    typedef std::vector< KeyType, KeyAllocator > key_container_type;
+    typedef std::vector< ValueType, ValueAllocator > container_type;
+    typedef ValueType& reference;
+    typedef const ValueType& const_reference;
+
+    map_columns() {}
+
+    map_columns( key_container_type&& keys, container_type&& values )
+    {
+        if( keys.size() != values.size() )
+        {
+            throw std::invalid_argument( "soa_map::from_sorted_unique: key and value sizes differ" );
+        }
+        storage_.reserve( keys.size() );
+        storage_.append_columns( keys.size(), keys.data(), values.data() );
+    }
+
+    size_t size() const { return storage_.size(); }
+    bool empty() const { return storage_.empty(); }
+    size_t capacity() const { return storage_.capacity(); }
+    void reserve( size_t capacity ) { storage_.reserve( capacity ); }
+    void resize( size_t size ) { storage_.resize( size ); }
+    void truncate( size_t size ) { storage_.erase( size, storage_.size() ); }
+    void clear() { storage_.clear(); }
+    void swap( map_columns& other ) { storage_.swap( other.storage_ ); }
+    void detach() { storage_.detach(); }
+    bool borrowed() const { return storage_.borrowed(); }
+
+    // Writes keys as the key column, which may be dropped.
+    void save( const std::string& path, const KeyType* keys ) const { write_snapshot( path, storage_, column_sequence(), keys ); }
+    void open_mapped( const std::string& path ) { open_snapshot( path, storage_, column_sequence() ); }
+
+    const KeyType* keys() const { return storage_.template data< 0 >(); }
+
+    // Frees the key column while soa_map keeps the keys compressed: keys() is null and rows can
+    // not be added or removed until restore_keys() copies them back.
+    void drop_keys() { storage_.drop_front(); }
+    void restore_keys( const KeyType* keys ) { storage_.restore_front( keys ); }
+    bool keys_dropped() const { return storage_.front_dropped(); }
+
+    const KeyType& key_at( size_t idx ) const
+    {
+        check( idx );
+        return keys()[ idx ];
+    }
+
+    reference operator[]( size_t idx ) { return storage_.template data< 1 >()[ idx ]; }
+    const_reference operator[]( size_t idx ) const { return storage_.template data< 1 >()[ idx ]; }
+
+    reference at( size_t idx )
+    {
+        check( idx );
+        return ( *this )[ idx ];
+    }
+
+    const_reference at( size_t idx ) const
+    {
+        check( idx );
+        return ( *this )[ idx ];
+    }
+
+    template< class K, class V >
+    void insert( size_t idx, K&& key, V&& value )
+    {
+        storage_.emplace( idx, std::forward< K >( key ), std::forward< V >( value ) );
+    }
+
+    template< class K, class V >
+    void assign( size_t idx, K&& key, V&& value )
+    {
+        storage_.assign( idx, std::forward< K >( key ), std::forward< V >( value ) );
+    }
+
+    void erase( size_t idx ) { storage_.erase( idx, idx + 1 ); }
+    void move_element( size_t dst, size_t src ) { storage_.move_rows( src, src + 1, dst ); }
+
+    // Moves [first, last) down to dst, dst <= first.
+    void move_range( size_t first, size_t last, size_t dst ) { storage_.move_rows( first, last, dst ); }
+
+    template< size_t I >
+    ValueType* data()
+    {
+        static_assert( I == 0, "a single value soa_map has only column 0" );
+        return storage_.template data< 1 >();
+    }
+
+    template< size_t I >
+    const ValueType* data() const
+    {
+        static_assert( I == 0, "a single value soa_map has only column 0" );
+        return storage_.template data< 1 >();
+    }
+
+private:
+    typedef typename std::allocator_traits< KeyAllocator >::template rebind_alloc< char > storage_allocator_type;
+    static_assert( std::is_same< storage_allocator_type, typename std::allocator_traits< ValueAllocator >::template rebind_alloc< char > >::value,
+                   "soa_map: keys and values share one block, KeyAllocator and ValueAllocator must rebind to the same allocator" );
+    typedef make_index_sequence< 2 > column_sequence;
+
+    void check( size_t idx ) const
+    {
+        if( idx >= size() )
+        {
+            throw std::out_of_range( "soa_map: index out of range" );
+        }
+    }
+
+    basic_soa_vector< storage_allocator_type, KeyType, ValueType > storage_;
+};
+
+//-------------------------------------------------------------------------------------------------
+// Key and value columns of a soa_map: the key in column 0 and field I of soa_columns in column
+// I + 1 of a single basic_soa_vector, from KeyAllocator as above.
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class KeyAllocator, class ValueAllocator, class... Ts >
+class map_columns< KeyType, soa_columns< Ts... >, KeyAllocator, ValueAllocator >
+{
+public:
+    typedef std::vector< KeyType, KeyAllocator > key_container_type;
+    typedef std::tuple< std::vector< Ts, typename std::allocator_traits< ValueAllocator >::template rebind_alloc< Ts > >... > container_type;
+    typedef std::tuple< Ts&... > reference;
+    typedef std::tuple< const Ts&... > const_reference;
+
+    map_columns() {}
+
+    map_columns( key_container_type&& keys, container_type&& values )
+    {
+        adopt( keys, values, sequence() );
+    }
+
+    size_t size() const { return storage_.size(); }
+    bool empty() const { return storage_.empty(); }
+    size_t capacity() const { return storage_.capacity(); }
+    void reserve( size_t capacity ) { storage_.reserve( capacity ); }
+    void resize( size_t size ) { storage_.resize( size ); }
+    void truncate( size_t size ) { storage_.erase( size, storage_.size() ); }
+    void clear() { storage_.clear(); }
+    void swap( map_columns& other ) { storage_.swap( other.storage_ ); }
+    void detach() { storage_.detach(); }
+    bool borrowed() const { return storage_.borrowed(); }
+
+    void save( const std::string& path, const KeyType* keys ) const { write_snapshot( path, storage_, column_sequence(), keys ); }
+    void open_mapped( const std::string& path ) { open_snapshot( path, storage_, column_sequence() ); }
+
+    const KeyType* keys() const { return storage_.template data< 0 >(); }
+
+    void drop_keys() { storage_.drop_front(); }
+    void restore_keys( const KeyType* keys ) { storage_.restore_front( keys ); }
+    bool keys_dropped() const { return storage_.front_dropped(); }
+
+    const KeyType& key_at( size_t idx ) const
+    {
+        check( idx );
+        return keys()[ idx ];
+    }
+
+    reference operator[]( size_t idx ) { return row( idx, sequence() ); }
+    const_reference operator[]( size_t idx ) const { return row( idx, sequence() ); }
+
+    reference at( size_t idx )
+    {
+        check( idx );
+        return row( idx, sequence() );
+    }
+
+    const_reference at( size_t idx ) const
+    {
+        check( idx );
+        return row( idx, sequence() );
+    }
+
+    template< class K, class V >
+    void insert( size_t idx, K&& key, V&& value )
+    {
+        insert( idx, std::forward< K >( key ), std::forward< V >( value ), sequence() );
+    }
+
+    template< class K, class V >
+    void assign( size_t idx, K&& key, V&& value )
+    {
+        assign( idx, std::forward< K >( key ), std::forward< V >( value ), sequence() );
+    }
+
+    void erase( size_t idx ) { storage_.erase( idx, idx + 1 ); }
+    void move_element( size_t dst, size_t src ) { storage_.move_rows( src, src + 1, dst ); }
+    void move_range( size_t first, size_t last, size_t dst ) { storage_.move_rows( first, last, dst ); }
+
+    template< size_t I >
+    typename column_element< soa_columns< Ts... >, I >::type* data()
+    {
+        return storage_.template data< I + 1 >();
+    }
+
+    template< size_t I >
+    const typename column_element< soa_columns< Ts... >, I >::type* data() const
+    {
+        return storage_.template data< I + 1 >();
+    }
+
+private:
+    typedef typename std::allocator_traits< KeyAllocator >::template rebind_alloc< char > storage_allocator_type;
+    static_assert( std::is_same< storage_allocator_type, typename std::allocator_traits< ValueAllocator >::template rebind_alloc< char > >::value,
+                   "soa_map: keys and values share one block, KeyAllocator and ValueAllocator must rebind to the same allocator" );
+    typedef make_index_sequence< sizeof...( Ts ) > sequence;
+    typedef make_index_sequence< sizeof...( Ts ) + 1 > column_sequence;
+
+    void check( size_t idx ) const
+    {
+        if( idx >= size() )
+        {
+            throw std::out_of_range( "soa_map: index out of range" );
+        }
+    }
+
+    template< size_t... Is >
+    void adopt( key_container_type& keys, container_type& values, index_sequence< Is... > )
+    {
+        bool sameSize = true;
+        CCPPBRASIL_SOA_EXPAND( sameSize = sameSize && std::get< Is >( values ).size() == keys.size() )
+        if( !sameSize )
+        {
+            throw std::invalid_argument( "soa_map::from_sorted_unique: key and value sizes differ" );
+        }
+        storage_.reserve( keys.size() );
+        storage_.append_columns( keys.size(), keys.data(), std::get< Is >( values ).data()... );
+    }
+
+    template< size_t... Is >
+    reference row( size_t idx, index_sequence< Is... > )
+    {
+        return reference( storage_.template data< Is + 1 >()[ idx ]... );
+    }
+
+    template< size_t... Is >
+    const_reference row( size_t idx, index_sequence< Is... > ) const
+    {
+        return const_reference( storage_.template data< Is + 1 >()[ idx ]... );
+    }
+
+    template< class K, class V, size_t... Is >
+    void insert( size_t idx, K&& key, V&& value, index_sequence< Is... > )
+    {
+        storage_.emplace( idx, std::forward< K >( key ), std::get< Is >( std::forward< V >( value ) )... );
+    }
+
+    template< class K, class V, size_t... Is >
+    void assign( size_t idx, K&& key, V&& value, index_sequence< Is... > )
+    {
+        storage_.assign( idx, std::forward< K >( key ), std::get< Is >( std::forward< V >( value ) )... );
+    }
+
+    basic_soa_vector< storage_allocator_type, KeyType, Ts... > storage_;
+};
+
+} // namespace detail
+} // namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOACOLUMNS_H
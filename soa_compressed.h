@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOACOMPRESSED_H
+#define CCPPBRASIL_SOACOMPRESSED_H
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "soa_search.h"
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Frame of reference key compression
+//
+// The sorted keys are cut in blocks of compressed_block_size. A block keeps its first key as the
+// base and the other keys as bit packed deltas from it, using as many bits as the largest delta
+// needs: 7 bits a key for dense ids instead of 64. A search binary searches the block bases and
+// then a single block, unpacking only the deltas it probes.
+//-------------------------------------------------------------------------------------------------
+const size_t compressed_block_size = 128;
+
+//-------------------------------------------------------------------------------------------------
+// Delta i of a block packed width bits each. Reads the word after the delta too: ( x << 1 ) <<
+// ( 63 - shift ) is x << ( 64 - shift ) without the undefined shift by 64 when shift is 0.
+inline uint64_t unpack_delta( const uint64_t* words, unsigned width, uint64_t mask, size_t i )
+{
+    size_t bit = i * width;
+    size_t shift = bit & 63;
+    const uint64_t* word = words + ( bit >> 6 );
+    return ( ( word[ 0 ] >> shift ) | ( ( word[ 1 ] << 1 ) << ( 63 - shift ) ) ) & mask;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t delta_mask( unsigned width )
+{
+    return ( width == 64 ) ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << width ) - 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Lower bound of target among the count sorted deltas of a block, unpacking only the log2( count )
+// deltas the branchless halving probes.
+inline size_t packed_lower_bound( const uint64_t* words, unsigned width, size_t count, uint64_t target )
+{
+    if( width == 0 )
+    {
+        return target > 0 ? count : 0;
+    }
+    const uint64_t mask = delta_mask( width );
+    size_t base = 0;
+    while( count > 1 )
+    {
+        size_t half = count / 2;
+        base = ( unpack_delta( words, width, mask, base + half - 1 ) < target ) ? base + half : base;
+        count -= half;
+    }
+    return base + ( ( unpack_delta( words, width, mask, base ) < target ) ? 1 : 0 );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Compressed copy of a key column, for soa_layout::compressed; soa_map drops the key column and
+// reads the keys back through key_at(), by value. Only integer keys ordered by std::less are
+// compressed; for every other key type supported is false and soa_map::freeze() throws.
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class KeyCompare, class Enable = void >
+class compressed_keys
+{
+public:
+    static const bool supported = false;
+    typedef const KeyType& key_reference;
+
+    void build( const KeyType*, size_t ) {}
+    size_t lower_bound( const KeyType& ) const { return 0; }
+    const KeyType& key_at( size_t ) const { throw std::logic_error( "compressed_keys: key type not supported" ); }
+    void decode( KeyType* ) const {}
+    size_t bytes() const { return 0; }
+    void clear() {}
+    void swap( compressed_keys& ) {}
+};
+
+template< class KeyType >
+class compressed_keys< KeyType, std::less< KeyType >,
+                       typename std::enable_if< std::is_integral< KeyType >::value && !std::is_same< KeyType, bool >::value >::type >
+{
+public:
+    static const bool supported = true;
+    typedef KeyType key_reference;
+
+    compressed_keys() : size_( 0 ) {}
+
+    void build( const KeyType* keys, size_t size )
+    {
+        clear();
+        size_ = size;
+        for( size_t first = 0; first < size; first += compressed_block_size )
+        {
+            size_t count = ( size - first < compressed_block_size ) ? size - first : compressed_block_size;
+            uint64_t base = static_cast< uint64_t >( keys[ first ] );
+            uint64_t range = static_cast< uint64_t >( keys[ first + count - 1 ] ) - base;
+
+            block_info info;
+            info.offset = words_.size();
+            info.width = 0;
+            while( info.width < 64 && ( range >> info.width ) != 0 )
+            {
+                ++info.width;
+            }
+            bases_.push_back( keys[ first ] );
+            blocks_.push_back( info );
+
+            words_.resize( words_.size() + ( count * info.width + 63 ) / 64, 0 );
+            for( size_t i = 0; info.width != 0 && i < count; ++i )
+            {
+                uint64_t delta = static_cast< uint64_t >( keys[ first + i ] ) - base;
+                size_t bit = i * info.width;
+                size_t shift = bit & 63;
+                uint64_t* word = words_.data() + info.offset + ( bit >> 6 );
+                word[ 0 ] |= delta << shift;
+                if( shift + info.width > 64 )
+                {
+                    word[ 1 ] |= delta >> ( 64 - shift );
+                }
+            }
+        }
+        // unpack_delta reads one word past the last delta.
+        words_.push_back( 0 );
+    }
+
+    size_t lower_bound( const KeyType& key ) const
+    {
+        size_t blockCount = bases_.size();
+        size_t idx = branchless_lower_bound( bases_.data(), blockCount, key, std::less< KeyType >() );
+        if( idx < blockCount && bases_[ idx ] == key )
+        {
+            return idx * compressed_block_size;
+        }
+        if( idx == 0 )
+        {
+            return 0;
+        }
+
+        size_t block = idx - 1;
+        size_t first = block * compressed_block_size;
+        size_t count = ( size_ - first < compressed_block_size ) ? size_ - first : compressed_block_size;
+        uint64_t target = static_cast< uint64_t >( key ) - static_cast< uint64_t >( bases_[ block ] );
+        return first + packed_lower_bound( words_.data() + blocks_[ block ].offset, blocks_[ block ].width, count, target );
+    }
+
+    KeyType key_at( size_t idx ) const
+    {
+        size_t block = idx / compressed_block_size;
+        unsigned width = blocks_[ block ].width;
+        uint64_t delta = ( width == 0 ) ? 0 : unpack_delta( words_.data() + blocks_[ block ].offset, width, delta_mask( width ),
+                                                            idx % compressed_block_size );
+        return static_cast< KeyType >( static_cast< uint64_t >( bases_[ block ] ) + delta );
+    }
+
+    // Writes the size keys to out, a block at a time.
+    void decode( KeyType* out ) const
+    {
+        for( size_t block = 0; block < blocks_.size(); ++block )
+        {
+            size_t first = block * compressed_block_size;
+            size_t count = ( size_ - first < compressed_block_size ) ? size_ - first : compressed_block_size;
+            uint64_t base = static_cast< uint64_t >( bases_[ block ] );
+            unsigned width = blocks_[ block ].width;
+            const uint64_t* words = words_.data() + blocks_[ block ].offset;
+            for( size_t i = 0; i < count; ++i )
+            {
+                uint64_t delta = ( width == 0 ) ? 0 : unpack_delta( words, width, delta_mask( width ), i );
+                out[ first + i ] = static_cast< KeyType >( base + delta );
+            }
+        }
+    }
+
+    size_t bytes() const
+    {
+        return bases_.size() * sizeof( KeyType ) + blocks_.size() * sizeof( block_info ) + words_.size() * sizeof( uint64_t );
+    }
+
+    void clear()
+    {
+        std::vector< KeyType >().swap( bases_ );
+        std::vector< block_info >().swap( blocks_ );
+        std::vector< uint64_t >().swap( words_ );
+        size_ = 0;
+    }
+
+    void swap( compressed_keys& other )
+    {
+        bases_.swap( other.bases_ );
+        blocks_.swap( other.blocks_ );
+        words_.swap( other.words_ );
+        std::swap( size_, other.size_ );
+    }
+
+private:
+    struct block_info
+    {
+        size_t offset;      // first word of the block in words_
+        unsigned width;     // bits per delta
+    };
+
+    std::vector< KeyType > bases_;
+    std::vector< block_info > blocks_;
+    std::vector< uint64_t > words_;
+    size_t size_;
+};
+
+} // namespace detail
+} // namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOACOMPRESSED_H
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAISA_H
+#define CCPPBRASIL_SOAISA_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Instruction sets of the search and column kernels. SSE2 is the x86-64 baseline. Every wider
+// variant the compiler can emit is built too, whatever the target flags: GCC and Clang compile
+// each one under a target attribute, MSVC emits intrinsics without one. active_isa() picks the
+// variant at run time.
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define CCPPBRASIL_SOA_SSE2
+#include <emmintrin.h>
+#include <nmmintrin.h>
+#include <immintrin.h>
+
+#if defined( __GNUC__ )
+#include <cpuid.h>
+#define CCPPBRASIL_SOA_SSE42
+#define CCPPBRASIL_SOA_AVX2
+#define CCPPBRASIL_SOA_AVX512
+#define CCPPBRASIL_SOA_TARGET_SSE42 __attribute__(( target( "sse4.2,popcnt" ) ))
+#define CCPPBRASIL_SOA_TARGET_AVX2 __attribute__(( target( "avx2,fma,popcnt" ) ))
+#define CCPPBRASIL_SOA_TARGET_AVX512 __attribute__(( target( "avx512f,avx2,fma,popcnt" ) ))
+#elif defined( _MSC_VER )
+#define CCPPBRASIL_SOA_SSE42
+#define CCPPBRASIL_SOA_AVX2
+#if _MSC_VER >= 1911
+#define CCPPBRASIL_SOA_AVX512
+#endif
+#define CCPPBRASIL_SOA_TARGET_SSE42
+#define CCPPBRASIL_SOA_TARGET_AVX2
+#define CCPPBRASIL_SOA_TARGET_AVX512
+#endif
+#endif
+
+namespace ccppbrasil {
+
+// Kernel variants, from the narrowest. avx2 also needs FMA, avx512 means AVX-512F.
+enum class soa_isa
+{
+    scalar,
+    sse2,
+    sse42,
+    avx2,
+    avx512
+};
+
+namespace detail {
+
+#if defined( CCPPBRASIL_SOA_SSE2 )
+//-------------------------------------------------------------------------------------------------
+// CPU detection, x86 only
+//-------------------------------------------------------------------------------------------------
+inline void cpuid( unsigned info[ 4 ], unsigned leaf )
+{
+#if defined( _MSC_VER )
+    int regs[ 4 ];
+    __cpuidex( regs, static_cast< int >( leaf ), 0 );
+    for( int i = 0; i < 4; ++i )
+    {
+        info[ i ] = static_cast< unsigned >( regs[ i ] );
+    }
+#else
+    __cpuid_count( leaf, 0, info[ 0 ], info[ 1 ], info[ 2 ], info[ 3 ] );
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+// Register state the OS saves on context switches: bits 1-2 for AVX, bits 5-7 for AVX-512.
+inline uint64_t xgetbv0()
+{
+#if defined( _MSC_VER )
+    return _xgetbv( 0 );
+#else
+    unsigned eax;
+    unsigned edx;
+    __asm__ __volatile__( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+    return ( static_cast< uint64_t >( edx ) << 32 ) | eax;
+#endif
+}
+#endif
+
+//-------------------------------------------------------------------------------------------------
+inline soa_isa parse_isa( const char* name, soa_isa fallback )
+{
+    const char* names[] = { "scalar", "sse2", "sse42", "avx2", "avx512" };
+    for( int i = 0; i < 5; ++i )
+    {
+        if( std::strcmp( name, names[ i ] ) == 0 )
+        {
+            return static_cast< soa_isa >( i );
+        }
+    }
+    return fallback;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline std::atomic< soa_isa >& active_isa_storage();
+
+} // namespace detail
+
+//-------------------------------------------------------------------------------------------------
+// Widest variant the CPU and the OS support, among the ones built.
+inline soa_isa detect_isa()
+{
+#if defined( CCPPBRASIL_SOA_SSE2 )
+    unsigned leaf0[ 4 ];
+    detail::cpuid( leaf0, 0 );
+    unsigned leaf1[ 4 ];
+    detail::cpuid( leaf1, 1 );
+    unsigned leaf7[ 4 ] = { 0, 0, 0, 0 };
+    if( leaf0[ 0 ] >= 7 )
+    {
+        detail::cpuid( leaf7, 7 );
+    }
+
+    const bool sse42 = ( leaf1[ 2 ] & ( 1u << 20 ) ) != 0 && ( leaf1[ 2 ] & ( 1u << 23 ) ) != 0;
+    const bool osxsave = ( leaf1[ 2 ] & ( 1u << 27 ) ) != 0;
+    const uint64_t xcr0 = osxsave ? detail::xgetbv0() : 0;
+    const bool avx2 = ( xcr0 & 0x6 ) == 0x6 && ( leaf1[ 2 ] & ( 1u << 28 ) ) != 0 &&
+                      ( leaf1[ 2 ] & ( 1u << 12 ) ) != 0 && ( leaf7[ 1 ] & ( 1u << 5 ) ) != 0;
+    const bool avx512 = ( xcr0 & 0xe6 ) == 0xe6 && ( leaf7[ 1 ] & ( 1u << 16 ) ) != 0;
+
+#if defined( CCPPBRASIL_SOA_AVX512 )
+    if( avx2 && avx512 )
+    {
+        return soa_isa::avx512;
+    }
+#endif
+    if( avx2 )
+    {
+        return soa_isa::avx2;
+    }
+    if( sse42 )
+    {
+        return soa_isa::sse42;
+    }
+    return soa_isa::sse2;
+#else
+    return soa_isa::scalar;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+// Variant the kernels run. Detected on first use and lowered to the CCPPBRASIL_SOA_ISA environment
+// variable (scalar, sse2, sse42, avx2 or avx512) when it names a narrower one.
+inline soa_isa active_isa()
+{
+    return detail::active_isa_storage().load( std::memory_order_relaxed );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Runs the kernels on isa, or on detect_isa() if the CPU lacks it, and returns the variant set.
+// For A/B runs in one process; kernels already running keep their variant.
+inline soa_isa set_active_isa( soa_isa isa )
+{
+    soa_isa detected = detect_isa();
+    isa = ( isa < detected ) ? isa : detected;
+    detail::active_isa_storage().store( isa, std::memory_order_relaxed );
+    return isa;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline const char* isa_name( soa_isa isa )
+{
+    const char* names[] = { "scalar", "sse2", "sse42", "avx2", "avx512" };
+    return names[ static_cast< int >( isa ) ];
+}
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+inline std::atomic< soa_isa >& active_isa_storage()
+{
+    struct initial
+    {
+        static soa_isa get()
+        {
+            soa_isa detected = detect_isa();
+            const char* name = std::getenv( "CCPPBRASIL_SOA_ISA" );
+            soa_isa requested = name ? parse_isa( name, detected ) : detected;
+            return ( requested < detected ) ? requested : detected;
+        }
+    };
+    static std::atomic< soa_isa > isa( initial::get() );
+    return isa;
+}
+
+} // namespace detail
+} // namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOAISA_H
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Column kernels of one instruction set. Included by soa_kernels.h once per variant, without an
+// include guard, with these macros set:
+//   CCPPBRASIL_SOA_KERNEL_ISA         namespace of the variant, inside ccppbrasil::detail
+//   CCPPBRASIL_SOA_KERNEL_TARGET      target attribute its functions are compiled with
+//   CCPPBRASIL_SOA_KERNEL_FLOAT_OPS   vector ops for float columns
+//   CCPPBRASIL_SOA_KERNEL_DOUBLE_OPS  vector ops for double columns
+// Other element types use simd_scalar, compiled for the same target.
+
+namespace ccppbrasil {
+namespace detail {
+namespace CCPPBRASIL_SOA_KERNEL_ISA {
+
+template< class T >
+struct simd_ops
+{
+    typedef simd_scalar< T > type;
+};
+
+template<>
+struct simd_ops< float >
+{
+    typedef CCPPBRASIL_SOA_KERNEL_FLOAT_OPS type;
+};
+
+template<>
+struct simd_ops< double >
+{
+    typedef CCPPBRASIL_SOA_KERNEL_DOUBLE_OPS type;
+};
+
+//-------------------------------------------------------------------------------------------------
+template< class V >
+CCPPBRASIL_SOA_KERNEL_TARGET
+typename V::type apply( typename V::type a, typename V::type b, std::integral_constant< binary_op, binary_op::add > )
+{
+    return V::add( a, b );
+}
+
+template< class V >
+CCPPBRASIL_SOA_KERNEL_TARGET
+typename V::type apply( typename V::type a, typename V::type b, std::integral_constant< binary_op, binary_op::sub > )
+{
+    return V::sub( a, b );
+}
+
+template< class V >
+CCPPBRASIL_SOA_KERNEL_TARGET
+typename V::type apply( typename V::type a, typename V::type b, std::integral_constant< binary_op, binary_op::mul > )
+{
+    return V::mul( a, b );
+}
+
+template< class V >
+CCPPBRASIL_SOA_KERNEL_TARGET
+typename V::type apply( typename V::type a, typename V::type b, std::integral_constant< binary_op, binary_op::div > )
+{
+    return V::div( a, b );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Reductions keep four independent accumulators, so consecutive adds do not wait on each other,
+// and the lanes are combined once at the end. The result is the same sum reassociated: it differs
+// from a left to right scalar loop in the last bits, like any vectorized sum.
+template< class T >
+CCPPBRASIL_SOA_KERNEL_TARGET
+T sum( const T* first, size_t size )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    typename V::type acc0 = V::zero();
+    typename V::type acc1 = V::zero();
+    typename V::type acc2 = V::zero();
+    typename V::type acc3 = V::zero();
+    size_t i = 0;
+    for( ; i + 4 * w <= size; i += 4 * w )
+    {
+        acc0 = V::add( acc0, V::load( first + i ) );
+        acc1 = V::add( acc1, V::load( first + i + w ) );
+        acc2 = V::add( acc2, V::load( first + i + 2 * w ) );
+        acc3 = V::add( acc3, V::load( first + i + 3 * w ) );
+    }
+    for( ; i + w <= size; i += w )
+    {
+        acc0 = V::add( acc0, V::load( first + i ) );
+    }
+    T total = V::reduce_add( V::add( V::add( acc0, acc1 ), V::add( acc2, acc3 ) ) );
+    for( ; i < size; ++i )
+    {
+        total += first[ i ];
+    }
+    return total;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Kahan summation in every lane, then over the lane sums and the tail. Compilers must not
+// reassociate floating point here (no /fp:fast or -ffast-math), or the compensation is dropped.
+template< class T >
+CCPPBRASIL_SOA_KERNEL_TARGET
+T sum_compensated( const T* first, size_t size )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    typename V::type total = V::zero();
+    typename V::type error = V::zero();
+    size_t i = 0;
+    for( ; i + w <= size; i += w )
+    {
+        typename V::type y = V::sub( V::load( first + i ), error );
+        typename V::type t = V::add( total, y );
+        error = V::sub( V::sub( t, total ), y );
+        total = t;
+    }
+
+    T lanes[ V::width ];
+    T errors[ V::width ];
+    V::store( lanes, total );
+    V::store( errors, error );
+
+    T result = T();
+    T c = T();
+    for( size_t k = 0; k < 2 * w + size - i; ++k )
+    {
+        T x = ( k < w ) ? lanes[ k ] : ( k < 2 * w ) ? -errors[ k - w ] : first[ i + k - 2 * w ];
+        T y = x - c;
+        T t = result + y;
+        c = ( t - result ) - y;
+        result = t;
+    }
+    return result;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T >
+CCPPBRASIL_SOA_KERNEL_TARGET
+T dot( const T* a, const T* b, size_t size )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    typename V::type acc0 = V::zero();
+    typename V::type acc1 = V::zero();
+    typename V::type acc2 = V::zero();
+    typename V::type acc3 = V::zero();
+    size_t i = 0;
+    for( ; i + 4 * w <= size; i += 4 * w )
+    {
+        acc0 = V::fmadd( V::load( a + i ), V::load( b + i ), acc0 );
+        acc1 = V::fmadd( V::load( a + i + w ), V::load( b + i + w ), acc1 );
+        acc2 = V::fmadd( V::load( a + i + 2 * w ), V::load( b + i + 2 * w ), acc2 );
+        acc3 = V::fmadd( V::load( a + i + 3 * w ), V::load( b + i + 3 * w ), acc3 );
+    }
+    for( ; i + w <= size; i += w )
+    {
+        acc0 = V::fmadd( V::load( a + i ), V::load( b + i ), acc0 );
+    }
+    T total = V::reduce_add( V::add( V::add( acc0, acc1 ), V::add( acc2, acc3 ) ) );
+    for( ; i < size; ++i )
+    {
+        total += a[ i ] * b[ i ];
+    }
+    return total;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Two accumulators for each bound, seeded with the first vectors.
+template< class T >
+CCPPBRASIL_SOA_KERNEL_TARGET
+std::pair< T, T > min_max( const T* first, size_t size )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    T lo = first[ 0 ];
+    T hi = first[ 0 ];
+    size_t i = 0;
+    if( size >= 2 * w )
+    {
+        typename V::type lo0 = V::load( first );
+        typename V::type lo1 = V::load( first + w );
+        typename V::type hi0 = lo0;
+        typename V::type hi1 = lo1;
+        for( i = 2 * w; i + 2 * w <= size; i += 2 * w )
+        {
+            typename V::type x0 = V::load( first + i );
+            typename V::type x1 = V::load( first + i + w );
+            lo0 = V::min( lo0, x0 );
+            lo1 = V::min( lo1, x1 );
+            hi0 = V::max( hi0, x0 );
+            hi1 = V::max( hi1, x1 );
+        }
+        lo = V::reduce_min( V::min( lo0, lo1 ) );
+        hi = V::reduce_max( V::max( hi0, hi1 ) );
+    }
+    for( ; i < size; ++i )
+    {
+        lo = first[ i ] < lo ? first[ i ] : lo;
+        hi = hi < first[ i ] ? first[ i ] : hi;
+    }
+    return std::make_pair( lo, hi );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T >
+CCPPBRASIL_SOA_KERNEL_TARGET
+void axpy( T a, const T* x, T* y, size_t size )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    typename V::type va = V::set1( a );
+    size_t i = 0;
+    for( ; i + w <= size; i += w )
+    {
+        V::store( y + i, V::fmadd( va, V::load( x + i ), V::load( y + i ) ) );
+    }
+    for( ; i < size; ++i )
+    {
+        y[ i ] = a * x[ i ] + y[ i ];
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T, class BinaryOp, binary_op Op >
+CCPPBRASIL_SOA_KERNEL_TARGET
+void transform( const T* a, const T* b, T* out, size_t size, BinaryOp op, std::integral_constant< binary_op, Op > vop )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    size_t i = 0;
+    for( ; i + w <= size; i += w )
+    {
+        V::store( out + i, apply< V >( V::load( a + i ), V::load( b + i ), vop ) );
+    }
+    for( ; i < size; ++i )
+    {
+        out[ i ] = op( a[ i ], b[ i ] );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T, class BinaryOp >
+CCPPBRASIL_SOA_KERNEL_TARGET
+void transform( const T* a, const T* b, T* out, size_t size, BinaryOp op, std::integral_constant< binary_op, binary_op::none > )
+{
+    for( size_t i = 0; i < size; ++i )
+    {
+        out[ i ] = op( a[ i ], b[ i ] );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T, class BinaryOp, binary_op Op >
+CCPPBRASIL_SOA_KERNEL_TARGET
+void transform( const T* a, T b, T* out, size_t size, BinaryOp op, std::integral_constant< binary_op, Op > vop )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    typename V::type vb = V::set1( b );
+    size_t i = 0;
+    for( ; i + w <= size; i += w )
+    {
+        V::store( out + i, apply< V >( V::load( a + i ), vb, vop ) );
+    }
+    for( ; i < size; ++i )
+    {
+        out[ i ] = op( a[ i ], b );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T, class BinaryOp >
+CCPPBRASIL_SOA_KERNEL_TARGET
+void transform( const T* a, T b, T* out, size_t size, BinaryOp op, std::integral_constant< binary_op, binary_op::none > )
+{
+    for( size_t i = 0; i < size; ++i )
+    {
+        out[ i ] = op( a[ i ], b );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// One compare per vector gives a lane mask; the index of every set bit is written out, lowest
+// first, so the output stays in column order.
+template< class T, class OutputIterator >
+CCPPBRASIL_SOA_KERNEL_TARGET
+OutputIterator filter( const T* first, size_t size, compare_op op, T value, OutputIterator out )
+{
+    typedef typename simd_ops< T >::type V;
+    const size_t w = V::width;
+    typename V::type vvalue = V::set1( value );
+    size_t i = 0;
+    for( ; i + w <= size; i += w )
+    {
+        unsigned mask = V::compare( V::load( first + i ), vvalue, op );
+        while( mask != 0 )
+        {
+            *out++ = i + count_trailing_zeros( mask );
+            mask &= mask - 1;
+        }
+    }
+    for( ; i < size; ++i )
+    {
+        if( simd_scalar< T >::compare( first[ i ], value, op ) )
+        {
+            *out++ = i;
+        }
+    }
+    return out;
+}
+
+} // namespace CCPPBRASIL_SOA_KERNEL_ISA
+} // namespace detail
+} // namespace ccppbrasil
+
+#undef CCPPBRASIL_SOA_KERNEL_ISA
+#undef CCPPBRASIL_SOA_KERNEL_TARGET
+#undef CCPPBRASIL_SOA_KERNEL_FLOAT_OPS
+#undef CCPPBRASIL_SOA_KERNEL_DOUBLE_OPS
@@ -0,0 +1,545 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAKERNELS_H
+#define CCPPBRASIL_SOAKERNELS_H
+
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <boost/range/iterator_range.hpp>
+
+#include "soa_search.h"
+
+namespace ccppbrasil {
+
+// Comparison applied by column_filter( column, op, value, out ): column[ i ] op value.
+enum class compare_op { less, less_equal, greater, greater_equal, equal, not_equal };
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Vector operations
+//
+// Each ops struct wraps one register type: width lanes of value_type, unaligned loads and stores,
+// lane-wise arithmetic, horizontal reductions and a compare that returns one bit per lane. The
+// kernels of soa_kernels-isa.h are written once against this interface and built once per
+// instruction set, with the float and double ops of that set and simd_scalar< T >, one lane, for
+// every other type.
+//-------------------------------------------------------------------------------------------------
+template< class T >
+struct simd_scalar
+{
+    typedef T value_type;
+    typedef T type;
+    static const size_t width = 1;
+
+    static type zero() { return T(); }
+    static type set1( T value ) { return value; }
+    static type load( const T* ptr ) { return *ptr; }
+    static void store( T* ptr, type value ) { *ptr = value; }
+    static type add( type a, type b ) { return a + b; }
+    static type sub( type a, type b ) { return a - b; }
+    static type mul( type a, type b ) { return a * b; }
+    static type div( type a, type b ) { return a / b; }
+    static type min( type a, type b ) { return b < a ? b : a; }
+    static type max( type a, type b ) { return a < b ? b : a; }
+    static type fmadd( type a, type b, type c ) { return a * b + c; }
+    static T reduce_add( type value ) { return value; }
+    static T reduce_min( type value ) { return value; }
+    static T reduce_max( type value ) { return value; }
+
+    static unsigned compare( type a, type b, compare_op op )
+    {
+        switch( op )
+        {
+        case compare_op::less:          return a < b ? 1u : 0u;
+        case compare_op::less_equal:    return a <= b ? 1u : 0u;
+        case compare_op::greater:       return a > b ? 1u : 0u;
+        case compare_op::greater_equal: return a >= b ? 1u : 0u;
+        case compare_op::equal:         return a == b ? 1u : 0u;
+        default:                        return a != b ? 1u : 0u;
+        }
+    }
+};
+
+#if defined( CCPPBRASIL_SOA_SSE2 )
+//-------------------------------------------------------------------------------------------------
+struct simd_sse_float
+{
+    typedef float value_type;
+    typedef __m128 type;
+    static const size_t width = 4;
+
+    static type zero() { return _mm_setzero_ps(); }
+    static type set1( float value ) { return _mm_set1_ps( value ); }
+    static type load( const float* ptr ) { return _mm_loadu_ps( ptr ); }
+    static void store( float* ptr, type value ) { _mm_storeu_ps( ptr, value ); }
+    static type add( type a, type b ) { return _mm_add_ps( a, b ); }
+    static type sub( type a, type b ) { return _mm_sub_ps( a, b ); }
+    static type mul( type a, type b ) { return _mm_mul_ps( a, b ); }
+    static type div( type a, type b ) { return _mm_div_ps( a, b ); }
+    static type min( type a, type b ) { return _mm_min_ps( a, b ); }
+    static type max( type a, type b ) { return _mm_max_ps( a, b ); }
+    static type fmadd( type a, type b, type c ) { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+
+    static float reduce_add( type value )
+    {
+        value = _mm_add_ps( value, _mm_movehl_ps( value, value ) );
+        return _mm_cvtss_f32( _mm_add_ss( value, _mm_shuffle_ps( value, value, 1 ) ) );
+    }
+
+    static float reduce_min( type value )
+    {
+        value = _mm_min_ps( value, _mm_movehl_ps( value, value ) );
+        return _mm_cvtss_f32( _mm_min_ss( value, _mm_shuffle_ps( value, value, 1 ) ) );
+    }
+
+    static float reduce_max( type value )
+    {
+        value = _mm_max_ps( value, _mm_movehl_ps( value, value ) );
+        return _mm_cvtss_f32( _mm_max_ss( value, _mm_shuffle_ps( value, value, 1 ) ) );
+    }
+
+    static unsigned compare( type a, type b, compare_op op )
+    {
+        switch( op )
+        {
+        case compare_op::less:          return _mm_movemask_ps( _mm_cmplt_ps( a, b ) );
+        case compare_op::less_equal:    return _mm_movemask_ps( _mm_cmple_ps( a, b ) );
+        case compare_op::greater:       return _mm_movemask_ps( _mm_cmpgt_ps( a, b ) );
+        case compare_op::greater_equal: return _mm_movemask_ps( _mm_cmpge_ps( a, b ) );
+        case compare_op::equal:         return _mm_movemask_ps( _mm_cmpeq_ps( a, b ) );
+        default:                        return _mm_movemask_ps( _mm_cmpneq_ps( a, b ) );
+        }
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+struct simd_sse_double
+{
+    typedef double value_type;
+    typedef __m128d type;
+    static const size_t width = 2;
+
+    static type zero() { return _mm_setzero_pd(); }
+    static type set1( double value ) { return _mm_set1_pd( value ); }
+    static type load( const double* ptr ) { return _mm_loadu_pd( ptr ); }
+    static void store( double* ptr, type value ) { _mm_storeu_pd( ptr, value ); }
+    static type add( type a, type b ) { return _mm_add_pd( a, b ); }
+    static type sub( type a, type b ) { return _mm_sub_pd( a, b ); }
+    static type mul( type a, type b ) { return _mm_mul_pd( a, b ); }
+    static type div( type a, type b ) { return _mm_div_pd( a, b ); }
+    static type min( type a, type b ) { return _mm_min_pd( a, b ); }
+    static type max( type a, type b ) { return _mm_max_pd( a, b ); }
+    static type fmadd( type a, type b, type c ) { return _mm_add_pd( _mm_mul_pd( a, b ), c ); }
+    static double reduce_add( type value ) { return _mm_cvtsd_f64( _mm_add_sd( value, _mm_unpackhi_pd( value, value ) ) ); }
+    static double reduce_min( type value ) { return _mm_cvtsd_f64( _mm_min_sd( value, _mm_unpackhi_pd( value, value ) ) ); }
+    static double reduce_max( type value ) { return _mm_cvtsd_f64( _mm_max_sd( value, _mm_unpackhi_pd( value, value ) ) ); }
+
+    static unsigned compare( type a, type b, compare_op op )
+    {
+        switch( op )
+        {
+        case compare_op::less:          return _mm_movemask_pd( _mm_cmplt_pd( a, b ) );
+        case compare_op::less_equal:    return _mm_movemask_pd( _mm_cmple_pd( a, b ) );
+        case compare_op::greater:       return _mm_movemask_pd( _mm_cmpgt_pd( a, b ) );
+        case compare_op::greater_equal: return _mm_movemask_pd( _mm_cmpge_pd( a, b ) );
+        case compare_op::equal:         return _mm_movemask_pd( _mm_cmpeq_pd( a, b ) );
+        default:                        return _mm_movemask_pd( _mm_cmpneq_pd( a, b ) );
+        }
+    }
+};
+#endif
+
+#if defined( CCPPBRASIL_SOA_AVX2 )
+//-------------------------------------------------------------------------------------------------
+struct simd_avx_float
+{
+    typedef float value_type;
+    typedef __m256 type;
+    static const size_t width = 8;
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static type zero() { return _mm256_setzero_ps(); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type set1( float value ) { return _mm256_set1_ps( value ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type load( const float* ptr ) { return _mm256_loadu_ps( ptr ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static void store( float* ptr, type value ) { _mm256_storeu_ps( ptr, value ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type add( type a, type b ) { return _mm256_add_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type sub( type a, type b ) { return _mm256_sub_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type mul( type a, type b ) { return _mm256_mul_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type div( type a, type b ) { return _mm256_div_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type min( type a, type b ) { return _mm256_min_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type max( type a, type b ) { return _mm256_max_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type fmadd( type a, type b, type c ) { return _mm256_fmadd_ps( a, b, c ); }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static float reduce_add( type value )
+    {
+        return simd_sse_float::reduce_add( _mm_add_ps( _mm256_castps256_ps128( value ), _mm256_extractf128_ps( value, 1 ) ) );
+    }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static float reduce_min( type value )
+    {
+        return simd_sse_float::reduce_min( _mm_min_ps( _mm256_castps256_ps128( value ), _mm256_extractf128_ps( value, 1 ) ) );
+    }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static float reduce_max( type value )
+    {
+        return simd_sse_float::reduce_max( _mm_max_ps( _mm256_castps256_ps128( value ), _mm256_extractf128_ps( value, 1 ) ) );
+    }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static unsigned compare( type a, type b, compare_op op )
+    {
+        switch( op )
+        {
+        case compare_op::less:          return _mm256_movemask_ps( _mm256_cmp_ps( a, b, _CMP_LT_OQ ) );
+        case compare_op::less_equal:    return _mm256_movemask_ps( _mm256_cmp_ps( a, b, _CMP_LE_OQ ) );
+        case compare_op::greater:       return _mm256_movemask_ps( _mm256_cmp_ps( a, b, _CMP_GT_OQ ) );
+        case compare_op::greater_equal: return _mm256_movemask_ps( _mm256_cmp_ps( a, b, _CMP_GE_OQ ) );
+        case compare_op::equal:         return _mm256_movemask_ps( _mm256_cmp_ps( a, b, _CMP_EQ_OQ ) );
+        default:                        return _mm256_movemask_ps( _mm256_cmp_ps( a, b, _CMP_NEQ_UQ ) );
+        }
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+struct simd_avx_double
+{
+    typedef double value_type;
+    typedef __m256d type;
+    static const size_t width = 4;
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static type zero() { return _mm256_setzero_pd(); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type set1( double value ) { return _mm256_set1_pd( value ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type load( const double* ptr ) { return _mm256_loadu_pd( ptr ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static void store( double* ptr, type value ) { _mm256_storeu_pd( ptr, value ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type add( type a, type b ) { return _mm256_add_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type sub( type a, type b ) { return _mm256_sub_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type mul( type a, type b ) { return _mm256_mul_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type div( type a, type b ) { return _mm256_div_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type min( type a, type b ) { return _mm256_min_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type max( type a, type b ) { return _mm256_max_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX2 static type fmadd( type a, type b, type c ) { return _mm256_fmadd_pd( a, b, c ); }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static double reduce_add( type value )
+    {
+        return simd_sse_double::reduce_add( _mm_add_pd( _mm256_castpd256_pd128( value ), _mm256_extractf128_pd( value, 1 ) ) );
+    }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static double reduce_min( type value )
+    {
+        return simd_sse_double::reduce_min( _mm_min_pd( _mm256_castpd256_pd128( value ), _mm256_extractf128_pd( value, 1 ) ) );
+    }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static double reduce_max( type value )
+    {
+        return simd_sse_double::reduce_max( _mm_max_pd( _mm256_castpd256_pd128( value ), _mm256_extractf128_pd( value, 1 ) ) );
+    }
+
+    CCPPBRASIL_SOA_TARGET_AVX2 static unsigned compare( type a, type b, compare_op op )
+    {
+        switch( op )
+        {
+        case compare_op::less:          return _mm256_movemask_pd( _mm256_cmp_pd( a, b, _CMP_LT_OQ ) );
+        case compare_op::less_equal:    return _mm256_movemask_pd( _mm256_cmp_pd( a, b, _CMP_LE_OQ ) );
+        case compare_op::greater:       return _mm256_movemask_pd( _mm256_cmp_pd( a, b, _CMP_GT_OQ ) );
+        case compare_op::greater_equal: return _mm256_movemask_pd( _mm256_cmp_pd( a, b, _CMP_GE_OQ ) );
+        case compare_op::equal:         return _mm256_movemask_pd( _mm256_cmp_pd( a, b, _CMP_EQ_OQ ) );
+        default:                        return _mm256_movemask_pd( _mm256_cmp_pd( a, b, _CMP_NEQ_UQ ) );
+        }
+    }
+};
+#endif
+
+#if defined( CCPPBRASIL_SOA_AVX512 )
+//-------------------------------------------------------------------------------------------------
+struct simd_avx512_float
+{
+    typedef float value_type;
+    typedef __m512 type;
+    static const size_t width = 16;
+
+    CCPPBRASIL_SOA_TARGET_AVX512 static type zero() { return _mm512_setzero_ps(); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type set1( float value ) { return _mm512_set1_ps( value ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type load( const float* ptr ) { return _mm512_loadu_ps( ptr ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static void store( float* ptr, type value ) { _mm512_storeu_ps( ptr, value ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type add( type a, type b ) { return _mm512_add_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type sub( type a, type b ) { return _mm512_sub_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type mul( type a, type b ) { return _mm512_mul_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type div( type a, type b ) { return _mm512_div_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type min( type a, type b ) { return _mm512_min_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type max( type a, type b ) { return _mm512_max_ps( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type fmadd( type a, type b, type c ) { return _mm512_fmadd_ps( a, b, c ); }
+
+    // Halves added by hand, through memory: GCC 12's _mm512_reduce_add_ps, and every 512 to 256
+    // bit extract or cast it builds on, warns about _mm256_undefined_pd in -Wall builds. Once per
+    // reduction, the store and two loads cost nothing measurable.
+    CCPPBRASIL_SOA_TARGET_AVX512 static float reduce_add( type value )
+    {
+        alignas( 64 ) float lanes[ width ];
+        _mm512_store_ps( lanes, value );
+        return simd_avx_float::reduce_add( _mm256_add_ps( _mm256_load_ps( lanes ), _mm256_load_ps( lanes + 8 ) ) );
+    }
+
+    CCPPBRASIL_SOA_TARGET_AVX512 static float reduce_min( type value ) { return _mm512_reduce_min_ps( value ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static float reduce_max( type value ) { return _mm512_reduce_max_ps( value ); }
+
+    CCPPBRASIL_SOA_TARGET_AVX512 static unsigned compare( type a, type b, compare_op op )
+    {
+        switch( op )
+        {
+        case compare_op::less:          return _mm512_cmp_ps_mask( a, b, _CMP_LT_OQ );
+        case compare_op::less_equal:    return _mm512_cmp_ps_mask( a, b, _CMP_LE_OQ );
+        case compare_op::greater:       return _mm512_cmp_ps_mask( a, b, _CMP_GT_OQ );
+        case compare_op::greater_equal: return _mm512_cmp_ps_mask( a, b, _CMP_GE_OQ );
+        case compare_op::equal:         return _mm512_cmp_ps_mask( a, b, _CMP_EQ_OQ );
+        default:                        return _mm512_cmp_ps_mask( a, b, _CMP_NEQ_UQ );
+        }
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+struct simd_avx512_double
+{
+    typedef double value_type;
+    typedef __m512d type;
+    static const size_t width = 8;
+
+    CCPPBRASIL_SOA_TARGET_AVX512 static type zero() { return _mm512_setzero_pd(); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type set1( double value ) { return _mm512_set1_pd( value ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type load( const double* ptr ) { return _mm512_loadu_pd( ptr ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static void store( double* ptr, type value ) { _mm512_storeu_pd( ptr, value ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type add( type a, type b ) { return _mm512_add_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type sub( type a, type b ) { return _mm512_sub_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type mul( type a, type b ) { return _mm512_mul_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type div( type a, type b ) { return _mm512_div_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type min( type a, type b ) { return _mm512_min_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type max( type a, type b ) { return _mm512_max_pd( a, b ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static type fmadd( type a, type b, type c ) { return _mm512_fmadd_pd( a, b, c ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static double reduce_add( type value ) { return _mm512_reduce_add_pd( value ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static double reduce_min( type value ) { return _mm512_reduce_min_pd( value ); }
+    CCPPBRASIL_SOA_TARGET_AVX512 static double reduce_max( type value ) { return _mm512_reduce_max_pd( value ); }
+
+    CCPPBRASIL_SOA_TARGET_AVX512 static unsigned compare( type a, type b, compare_op op )
+    {
+        switch( op )
+        {
+        case compare_op::less:          return _mm512_cmp_pd_mask( a, b, _CMP_LT_OQ );
+        case compare_op::less_equal:    return _mm512_cmp_pd_mask( a, b, _CMP_LE_OQ );
+        case compare_op::greater:       return _mm512_cmp_pd_mask( a, b, _CMP_GT_OQ );
+        case compare_op::greater_equal: return _mm512_cmp_pd_mask( a, b, _CMP_GE_OQ );
+        case compare_op::equal:         return _mm512_cmp_pd_mask( a, b, _CMP_EQ_OQ );
+        default:                        return _mm512_cmp_pd_mask( a, b, _CMP_NEQ_UQ );
+        }
+    }
+};
+#endif
+
+
+//-------------------------------------------------------------------------------------------------
+// Binary functors with a vector form; any other functor runs one element at a time.
+enum class binary_op { none, add, sub, mul, div };
+
+template< class BinaryOp, class T >
+struct simd_binary : std::integral_constant< binary_op, binary_op::none >
+{
+};
+
+template< class T >
+struct simd_binary< std::plus< T >, T > : std::integral_constant< binary_op, binary_op::add >
+{
+};
+
+template< class T >
+struct simd_binary< std::minus< T >, T > : std::integral_constant< binary_op, binary_op::sub >
+{
+};
+
+template< class T >
+struct simd_binary< std::multiplies< T >, T > : std::integral_constant< binary_op, binary_op::mul >
+{
+};
+
+template< class T >
+struct simd_binary< std::divides< T >, T > : std::integral_constant< binary_op, binary_op::div >
+{
+};
+
+} // namespace detail
+} // namespace ccppbrasil
+
+#define CCPPBRASIL_SOA_KERNEL_ISA isa_scalar
+#define CCPPBRASIL_SOA_KERNEL_TARGET
+#define CCPPBRASIL_SOA_KERNEL_FLOAT_OPS simd_scalar< float >
+#define CCPPBRASIL_SOA_KERNEL_DOUBLE_OPS simd_scalar< double >
+#include "soa_kernels-isa.h"
+
+#if defined( CCPPBRASIL_SOA_SSE2 )
+#define CCPPBRASIL_SOA_KERNEL_ISA isa_sse2
+#define CCPPBRASIL_SOA_KERNEL_TARGET
+#define CCPPBRASIL_SOA_KERNEL_FLOAT_OPS simd_sse_float
+#define CCPPBRASIL_SOA_KERNEL_DOUBLE_OPS simd_sse_double
+#include "soa_kernels-isa.h"
+#define CCPPBRASIL_SOA_KERNEL_CASE_SSE2( ... ) case soa_isa::sse42: case soa_isa::sse2: return detail::isa_sse2::__VA_ARGS__;
+#else
+#define CCPPBRASIL_SOA_KERNEL_CASE_SSE2( ... )
+#endif
+
+#if defined( CCPPBRASIL_SOA_AVX2 )
+#define CCPPBRASIL_SOA_KERNEL_ISA isa_avx2
+#define CCPPBRASIL_SOA_KERNEL_TARGET CCPPBRASIL_SOA_TARGET_AVX2
+#define CCPPBRASIL_SOA_KERNEL_FLOAT_OPS simd_avx_float
+#define CCPPBRASIL_SOA_KERNEL_DOUBLE_OPS simd_avx_double
+#include "soa_kernels-isa.h"
+#define CCPPBRASIL_SOA_KERNEL_CASE_AVX2( ... ) case soa_isa::avx2: return detail::isa_avx2::__VA_ARGS__;
+#else
+#define CCPPBRASIL_SOA_KERNEL_CASE_AVX2( ... )
+#endif
+
+#if defined( CCPPBRASIL_SOA_AVX512 )
+#define CCPPBRASIL_SOA_KERNEL_ISA isa_avx512
+#define CCPPBRASIL_SOA_KERNEL_TARGET CCPPBRASIL_SOA_TARGET_AVX512
+#define CCPPBRASIL_SOA_KERNEL_FLOAT_OPS simd_avx512_float
+#define CCPPBRASIL_SOA_KERNEL_DOUBLE_OPS simd_avx512_double
+#include "soa_kernels-isa.h"
+#define CCPPBRASIL_SOA_KERNEL_CASE_AVX512( ... ) case soa_isa::avx512: return detail::isa_avx512::__VA_ARGS__;
+#else
+#define CCPPBRASIL_SOA_KERNEL_CASE_AVX512( ... )
+#endif
+
+// Returns the kernel call, made in the namespace of the variant active_isa() picks.
+#define CCPPBRASIL_SOA_KERNEL_DISPATCH( ... )                 \
+    switch( active_isa() )                                   \
+    {                                                        \
+    CCPPBRASIL_SOA_KERNEL_CASE_AVX512( __VA_ARGS__ )         \
+    CCPPBRASIL_SOA_KERNEL_CASE_AVX2( __VA_ARGS__ )           \
+    CCPPBRASIL_SOA_KERNEL_CASE_SSE2( __VA_ARGS__ )           \
+    default: return detail::isa_scalar::__VA_ARGS__;         \
+    }
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// Column algorithms
+//
+// Work on contiguous columns, e.g. soa_map::column< I >() or soa_vector::column< I >(), with the
+// kernels of active_isa(). float and double columns run on vector registers; other element types
+// run the same loops one element at a time, compiled for the same instruction set.
+//-------------------------------------------------------------------------------------------------
+template< class T >
+typename std::remove_const< T >::type column_sum( boost::iterator_range< T* > column )
+{
+    typedef typename std::remove_const< T >::type value_type;
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( sum< value_type >( column.begin(), column.size() ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+// Kahan compensated sum: slower than column_sum, with an error that does not grow with the size.
+template< class T >
+typename std::remove_const< T >::type column_sum_compensated( boost::iterator_range< T* > column )
+{
+    typedef typename std::remove_const< T >::type value_type;
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( sum_compensated< value_type >( column.begin(), column.size() ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T, class U >
+typename std::remove_const< T >::type column_dot( boost::iterator_range< T* > a, boost::iterator_range< U* > b )
+{
+    typedef typename std::remove_const< T >::type value_type;
+    if( a.size() != b.size() )
+    {
+        throw std::invalid_argument( "column_dot: column sizes differ" );
+    }
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( dot< value_type >( a.begin(), b.begin(), a.size() ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+// Smallest and largest element of a non-empty column without NaNs.
+template< class T >
+std::pair< typename std::remove_const< T >::type, typename std::remove_const< T >::type >
+column_min_max( boost::iterator_range< T* > column )
+{
+    typedef typename std::remove_const< T >::type value_type;
+    if( column.empty() )
+    {
+        throw std::invalid_argument( "column_min_max: empty column" );
+    }
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( min_max< value_type >( column.begin(), column.size() ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+// y = a * x + y
+template< class T, class U >
+void column_axpy( typename std::remove_const< T >::type a, boost::iterator_range< U* > x, boost::iterator_range< T* > y )
+{
+    if( x.size() != y.size() )
+    {
+        throw std::invalid_argument( "column_axpy: column sizes differ" );
+    }
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( axpy< T >( a, x.begin(), y.begin(), y.size() ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+// out[ i ] = op( a[ i ], b[ i ] ). std::plus, std::minus, std::multiplies and std::divides of the
+// element type are vectorized. out may be a or b.
+template< class T, class U, class BinaryOp >
+void column_transform( boost::iterator_range< T* > a, boost::iterator_range< U* > b,
+                       boost::iterator_range< typename std::remove_const< T >::type* > out, BinaryOp op )
+{
+    typedef typename std::remove_const< T >::type value_type;
+    if( a.size() != b.size() || a.size() != out.size() )
+    {
+        throw std::invalid_argument( "column_transform: column sizes differ" );
+    }
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( transform< value_type >( a.begin(), b.begin(), out.begin(), a.size(), op,
+                                                             detail::simd_binary< BinaryOp, value_type >() ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+// out[ i ] = op( a[ i ], b ), for a scalar b.
+template< class T, class BinaryOp >
+void column_transform( boost::iterator_range< T* > a, typename std::remove_const< T >::type b,
+                       boost::iterator_range< typename std::remove_const< T >::type* > out, BinaryOp op )
+{
+    typedef typename std::remove_const< T >::type value_type;
+    if( a.size() != out.size() )
+    {
+        throw std::invalid_argument( "column_transform: column sizes differ" );
+    }
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( transform< value_type >( a.begin(), b, out.begin(), a.size(), op,
+                                                             detail::simd_binary< BinaryOp, value_type >() ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+// Writes the index of every element with column[ i ] op value to out, in column order, and
+// returns the end of the output.
+template< class T, class OutputIterator >
+OutputIterator column_filter( boost::iterator_range< T* > column, compare_op op,
+                              typename std::remove_const< T >::type value, OutputIterator out )
+{
+    typedef typename std::remove_const< T >::type value_type;
+    CCPPBRASIL_SOA_KERNEL_DISPATCH( filter< value_type >( column.begin(), column.size(), op, value, out ) )
+}
+
+}
+
+#endif // CCPPBRASIL_SOAKERNELS_H
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOALEARNED_H
+#define CCPPBRASIL_SOALEARNED_H
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "soa_search.h"
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Learned index
+//
+// The sorted key column is cut in segments where position grows close to linearly with the key.
+// Each segment keeps its first key, its first position and a slope, chosen so every key of the
+// segment is predicted within learned_max_error positions. A search binary searches the segment
+// starts, predicts the position and checks that the window around it brackets the key before
+// searching it; when it does not, it falls back to the whole segment.
+//
+// Segments are fitted with a shrinking cone: the slopes that keep every key so far within the
+// error form an interval, narrowed by each new key, and the segment ends when it becomes empty.
+//-------------------------------------------------------------------------------------------------
+const size_t learned_max_error = 16;
+
+//-------------------------------------------------------------------------------------------------
+// Learned search index over a sorted key column, for soa_layout::learned. Only arithmetic keys
+// ordered by std::less have a position model; for every other key type supported is false and
+// soa_map keeps the sorted layout. The index does not keep a pointer to the column, lower_bound
+// takes it.
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class KeyCompare, class Enable = void >
+class learned_keys
+{
+public:
+    static const bool supported = false;
+
+    void build( const KeyType*, size_t ) {}
+    size_t lower_bound( const KeyType*, size_t, const KeyType& ) const { return 0; }
+    size_t bytes() const { return 0; }
+    void clear() {}
+    void swap( learned_keys& ) {}
+};
+
+template< class KeyType >
+class learned_keys< KeyType, std::less< KeyType >,
+                    typename std::enable_if< std::is_arithmetic< KeyType >::value && !std::is_same< KeyType, bool >::value >::type >
+{
+public:
+    static const bool supported = true;
+
+    void build( const KeyType* keys, size_t size )
+    {
+        clear();
+        const double error = static_cast< double >( learned_max_error );
+        size_t first = 0;
+        while( first < size )
+        {
+            double low = 0;
+            double high = std::numeric_limits< double >::infinity();
+            size_t last = first + 1;
+            for( ; last < size; ++last )
+            {
+                double dx = distance( keys[ first ], keys[ last ] );
+                double dy = static_cast< double >( last - first );
+                double lowNext = ( dy - error ) / dx;
+                double highNext = ( dy + error ) / dx;
+                if( lowNext > high || highNext < low )
+                {
+                    break;
+                }
+                low = ( lowNext > low ) ? lowNext : low;
+                high = ( highNext < high ) ? highNext : high;
+            }
+
+            starts_.push_back( keys[ first ] );
+            positions_.push_back( first );
+            slopes_.push_back( ( last - first > 1 ) ? ( low + high ) / 2 : 0 );
+            first = last;
+        }
+    }
+
+    size_t lower_bound( const KeyType* keys, size_t size, const KeyType& key ) const
+    {
+        std::less< KeyType > comp;
+        size_t segmentCount = starts_.size();
+        size_t segment = branchless_lower_bound( starts_.data(), segmentCount, key, comp );
+        if( segment < segmentCount && !comp( key, starts_[ segment ] ) )
+        {
+            return positions_[ segment ];
+        }
+        if( segment == 0 )
+        {
+            return 0;
+        }
+
+        // The key is past the first key of the segment and before the first key of the next one,
+        // so its lower bound is in ( begin, end ].
+        --segment;
+        size_t begin = positions_[ segment ];
+        size_t end = ( segment + 1 < segmentCount ) ? positions_[ segment + 1 ] : size;
+        double predicted = slopes_[ segment ] * distance( starts_[ segment ], key );
+        size_t offset = ( predicted < static_cast< double >( end - begin ) ) ? static_cast< size_t >( predicted ) : end - begin;
+        size_t pos = begin + offset;
+
+        size_t low = ( offset > learned_max_error ) ? pos - learned_max_error : begin;
+        size_t high = ( end - pos > learned_max_error + 2 ) ? pos + learned_max_error + 2 : end;
+        if( ( low != begin && !comp( keys[ low - 1 ], key ) ) || ( high != end && comp( keys[ high ], key ) ) )
+        {
+            low = begin;
+            high = end;
+        }
+        return low + branchless_lower_bound( keys + low, high - low, key, comp );
+    }
+
+    size_t bytes() const
+    {
+        return starts_.size() * sizeof( KeyType ) + positions_.size() * sizeof( size_t ) + slopes_.size() * sizeof( double );
+    }
+
+    void clear()
+    {
+        std::vector< KeyType >().swap( starts_ );
+        std::vector< size_t >().swap( positions_ );
+        std::vector< double >().swap( slopes_ );
+    }
+
+    void swap( learned_keys& other )
+    {
+        starts_.swap( other.starts_ );
+        positions_.swap( other.positions_ );
+        slopes_.swap( other.slopes_ );
+    }
+
+private:
+    // Distance from one key to a larger one. Integer keys subtract before converting, so 64 bit
+    // keys far from zero keep their low bits.
+    static double distance( const KeyType& from, const KeyType& to )
+    {
+        return distance( from, to, std::is_integral< KeyType >() );
+    }
+
+    static double distance( const KeyType& from, const KeyType& to, std::true_type )
+    {
+        return static_cast< double >( static_cast< uint64_t >( to ) - static_cast< uint64_t >( from ) );
+    }
+
+    static double distance( const KeyType& from, const KeyType& to, std::false_type )
+    {
+        return static_cast< double >( to ) - static_cast< double >( from );
+    }
+
+    std::vector< KeyType > starts_;     // first key of each segment
+    std::vector< size_t > positions_;   // position of that key in the column
+    std::vector< double > slopes_;      // positions per key unit
+};
+
+} // namespace detail
+} // namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOALEARNED_H
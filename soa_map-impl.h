@@ -23,249 +23,713 @@
 #define CCPPBRASIL_SOAMAP_IMPL_H
 
 #include <algorithm>
+#include <cassert>
+#include <stdexcept>
 
 namespace ccppbrasil {
 
 //-------------------------------------------------------------------------------------------------
 // soa_pair
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::soa_pair( value_type& obj, size_t pos ) :
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::soa_pair( value_type& obj, size_t pos ) :
     soa_map_( obj ), pos_(pos)
 {
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-bool soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::operator<( const my_type& other ) const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+bool soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::operator<( const my_type& other ) const
 {
     return( KeyCompare()( key(), other.key ) );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const KeyType& soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename detail::compressed_keys< KeyType, KeyCompare >::key_reference soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::key() const
 {
     return soa_map_.keyAtIndex( pos_ );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-ValueType& soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value()
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::reference soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::value()
 {
     return soa_map_.atIndex( pos_ );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const ValueType& soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::const_reference soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::value() const
 {
-    return soa_map_.atIndex( pos_ );
+    return static_cast< const value_type& >( soa_map_ ).atIndex( pos_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< size_t I >
+typename detail::column_element< ValueType, I >::type& soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::get()
+{
+    return soa_map_.template column< I >()[ pos_ ];
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< size_t I >
+const typename detail::column_element< ValueType, I >::type& soa_pair<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::get() const
+{
+    return static_cast< const value_type& >( soa_map_ ).template column< I >()[ pos_ ];
 }
 
 //-------------------------------------------------------------------------------------------------
 // soa_iterator
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::soa_iterator( value_type& obj, size_t pos ) :
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::soa_iterator( value_type& obj, size_t pos ) :
     boost::counting_iterator<size_t>( pos ),
     soa_map_( obj )
 {
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-void soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::swap( soa_iterator& other )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::swap( soa_iterator& other )
 {
     std::swap( soa_map_, other.soa_map_ );
     std::swap( base(), other.base() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const KeyType& soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::key() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename detail::compressed_keys< KeyType, KeyCompare >::key_reference soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::key() const
 {
     return soa_map_.keyAtIndex( base() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-ValueType& soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value()
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::reference soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::value()
 {
     return soa_map_.atIndex( base() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const ValueType& soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::value() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::const_reference soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::value() const
 {
-    return soa_map_.atIndex( base() );
+    return static_cast< const value_type& >( soa_map_ ).atIndex( base() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::operator*()
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::operator*()
 {
-    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >( soa_map_, base() );
+    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >( soa_map_, base() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::operator*() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::operator*() const
 {
-    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >( soa_map_, base() );
+    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >( soa_map_, base() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::operator->()
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::operator->()
 {
-    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >( soa_map_, base() );
+    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >( soa_map_, base() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::operator->() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::operator->() const
 {
-    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >( soa_map_, base() );
+    return soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >( soa_map_, base() );
 }
 
 
 //-------------------------------------------------------------------------------------------------
 // soa_map
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::reserve( size_t capacity )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::from_sorted_unique( key_container_type keys, value_container_type values )
+{
+    assert( std::adjacent_find( keys.begin(), keys.end(),
+                                []( const KeyType& a, const KeyType& b ) { return !KeyCompare()( a, b ); } ) == keys.end() );
+
+    column_storage_type columns( std::move( keys ), std::move( values ) );
+    soa_map ret;
+    ret.columns_.swap( columns );
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::reserve( size_t capacity )
 {
-    key_container_.reserve( capacity );
-    value_container_.reserve( capacity );
+    restore_keys();
+    columns_.detach();
+    size_t oldCapacity = columns_.capacity();
+    columns_.reserve( capacity );
+    count_reallocation( oldCapacity, size() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::size() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::size() const
 {
-    return key_container_.size();
+    return columns_.size();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-bool soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::empty() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+bool soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::empty() const
 {
-    return key_container_.empty();
+    return columns_.empty();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::clear()
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::clear()
 {
-    key_container_.clear();
-    value_container_.clear();
+    columns_.clear();
+    thaw();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-bool soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::insert( const std::pair< KeyType, ValueType > &keyValuePair )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+bool soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::insert( const std::pair< KeyType, ValueType > &keyValuePair )
 {
-    typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator pos = lower_bound( keyValuePair.first );
+    typename Stats::scope timing( stats(), soa_stats_op::insert );
+    typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator pos( *this, lower_bound_index( keyValuePair.first ) );
 
     if( end() != pos && keyValuePair.first == pos.key() )
     {
+        Stats::inserted( 0, 1 );
         return false;
     }
 
-    size_t idx = pos.base();
-    auto keyPos = key_container_.begin();
-    std::advance( keyPos, idx );
-    key_container_.insert( keyPos, keyValuePair.first );
-    
-    auto valPos = value_container_.begin();
-    std::advance( valPos, idx );
-    value_container_.insert( valPos, keyValuePair.second );
-    
+    thaw();
+    columns_.detach();
+
+    size_t oldCapacity = columns_.capacity();
+    columns_.insert( pos.base(), keyValuePair.first, keyValuePair.second );
+    count_insert( pos.base(), oldCapacity );
+
     return true;
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-bool soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::emplace( KeyType && refKey, ValueType && value )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class InputIterator >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::insert( InputIterator first, InputIterator last )
+{
+    typedef std::pair< KeyType, ValueType > batch_value_type;
+    std::vector< batch_value_type > batch( first, last );
+    if( batch.empty() )
+    {
+        return;
+    }
+
+    KeyCompare comp;
+    size_t requested = batch.size();
+
+    // stable_sort keeps repeated keys in input order, so unique() keeps the first one.
+    std::stable_sort( batch.begin(), batch.end(),
+                      [&comp]( const batch_value_type& a, const batch_value_type& b ) { return comp( a.first, b.first ); } );
+    batch.erase( std::unique( batch.begin(), batch.end(),
+                              [&comp]( const batch_value_type& a, const batch_value_type& b ) { return !comp( a.first, b.first ); } ),
+                 batch.end() );
+    Stats::inserted( 0, requested - batch.size() );
+
+    merge_sorted_batch( batch );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class InputIterator >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::insert( InputIterator first, InputIterator last,
+                                                                                     thread_pool& pool )
+{
+    typedef std::pair< KeyType, ValueType > batch_value_type;
+    std::vector< batch_value_type > batch( first, last );
+    if( batch.empty() )
+    {
+        return;
+    }
+
+    KeyCompare comp;
+    size_t requested = batch.size();
+
+    parallel_stable_sort( batch.begin(), batch.end(),
+                          [&comp]( const batch_value_type& a, const batch_value_type& b ) { return comp( a.first, b.first ); },
+                          pool );
+    batch.erase( std::unique( batch.begin(), batch.end(),
+                              [&comp]( const batch_value_type& a, const batch_value_type& b ) { return !comp( a.first, b.first ); } ),
+                 batch.end() );
+    Stats::inserted( 0, requested - batch.size() );
+
+    merge_sorted_batch( batch );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Merges a sorted batch of unique keys with the columns. Keys already in the map are skipped.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::merge_sorted_batch( std::vector< std::pair< KeyType, ValueType > >& batch )
 {
+    KeyCompare comp;
+
+    // Drop the keys already present, walking both sorted sequences once.
+    size_t oldSize = size();
+    size_t keyIdx = 0;
+    size_t newCount = 0;
+    for( size_t i = 0; i < batch.size(); ++i )
+    {
+        while( keyIdx < oldSize && comp( stored_key( keyIdx ), batch[ i ].first ) )
+        {
+            ++keyIdx;
+        }
+        if( keyIdx < oldSize && !comp( batch[ i ].first, stored_key( keyIdx ) ) )
+        {
+            continue;
+        }
+        if( newCount != i )
+        {
+            batch[ newCount ] = std::move( batch[ i ] );
+        }
+        ++newCount;
+    }
+
+    Stats::inserted( newCount, batch.size() - newCount );
+    if( newCount == 0 )
+    {
+        return;
+    }
+
+    // Merge from the back, so every element is moved at most once.
+    size_t newSize = oldSize + newCount;
+    restore_keys();
+    columns_.detach();
+    size_t oldCapacity = columns_.capacity();
+    columns_.resize( newSize );
+    count_reallocation( oldCapacity, oldSize );
+
+    size_t oldIdx = oldSize;
+    size_t dstIdx = newSize;
+    while( newCount > 0 )
+    {
+        --dstIdx;
+        if( oldIdx > 0 && comp( batch[ newCount - 1 ].first, columns_.keys()[ oldIdx - 1 ] ) )
+        {
+            --oldIdx;
+            columns_.move_element( dstIdx, oldIdx );
+        }
+        else
+        {
+            --newCount;
+            columns_.assign( dstIdx, std::move( batch[ newCount ].first ), std::move( batch[ newCount ].second ) );
+        }
+    }
+    Stats::shifted( oldSize - oldIdx );
+
+    if( layout_ != soa_layout::sorted )
+    {
+        freeze( layout_ );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+bool soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::emplace( KeyType && refKey, ValueType && value )
+{
+    typename Stats::scope timing( stats(), soa_stats_op::insert );
     KeyType key( std::forward<KeyType>(refKey) );
-    typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator pos = lower_bound( key );
+    typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator pos( *this, lower_bound_index( key ) );
 
     if( end() != pos && key == pos.key() )
     {
+        Stats::inserted( 0, 1 );
         return false;
     }
 
-    size_t idx = pos.base();
-    auto keyPos = key_container_.begin();
-    std::advance( keyPos, idx );
-    key_container_.insert( keyPos, key );
+    thaw();
+    columns_.detach();
 
-    auto valPos = value_container_.begin();
-    std::advance( valPos, idx );
-    value_container_.insert( valPos, std::forward<ValueType>( value ) );
+    size_t oldCapacity = columns_.capacity();
+    columns_.insert( pos.base(), std::move( key ), std::forward<ValueType>( value ) );
+    count_insert( pos.base(), oldCapacity );
 
     return true;
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator 
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::erase( const KeyType &key )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator 
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::erase( const KeyType &key )
 {
-    auto pos = find( key );
+    typename Stats::scope timing( stats(), soa_stats_op::erase );
+    size_t idx = lower_bound_index( key );
 
-    if( end() != pos )
+    if( idx != size() && key == stored_key( idx ) )
     {
-        size_t idx = pos.base();
+        thaw();
+        columns_.detach();
+
+        columns_.erase( idx );
+        Stats::erased( 1, 0 );
+        Stats::shifted( size() - idx );
 
-        auto keyPos = key_container_.begin();
-        std::advance( keyPos, idx );
-        key_container_.erase( keyPos );
-        
-        auto valPos = value_container_.begin();
-        std::advance( valPos, idx );
-        value_container_.erase( valPos );
-        
         return iterator( *this, idx );
     }
+    Stats::erased( 0, 1 );
     return end();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::swap( soa_map &other )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class InputIterator >
+size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::erase_sorted( InputIterator first, InputIterator last )
+{
+    KeyCompare comp;
+    size_t oldSize = size();
+    size_t srcIdx = 0;
+    size_t dstIdx = 0;
+    size_t missing = 0;
+    size_t moved = 0;
+    restore_keys();
+
+    // Keeps [srcIdx, pos) and skips pos for every key found, moving each survivor once.
+    for( ; first != last && srcIdx < oldSize; ++first )
+    {
+        size_t pos = detail::gallop_lower_bound( columns_.keys(), oldSize, srcIdx, *first, comp );
+        if( pos == oldSize || comp( *first, columns_.keys()[ pos ] ) )
+        {
+            ++missing;
+            continue;
+        }
+        columns_.detach();
+        if( dstIdx != srcIdx )
+        {
+            columns_.move_range( srcIdx, pos, dstIdx );
+            moved += pos - srcIdx;
+        }
+        dstIdx += pos - srcIdx;
+        srcIdx = pos + 1;
+    }
+    if( Stats::enabled )
+    {
+        // Keys past the last element were never searched.
+        for( ; first != last; ++first )
+        {
+            ++missing;
+        }
+    }
+
+    if( srcIdx == dstIdx )
+    {
+        Stats::erased( 0, missing );
+        drop_keys();
+        return 0;
+    }
+
+    columns_.move_range( srcIdx, oldSize, dstIdx );
+    size_t newSize = dstIdx + ( oldSize - srcIdx );
+    columns_.truncate( newSize );
+    Stats::erased( oldSize - newSize, missing );
+    Stats::shifted( moved + oldSize - srcIdx );
+
+    if( layout_ != soa_layout::sorted )
+    {
+        freeze( layout_ );
+    }
+    return oldSize - newSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::swap( soa_map &other )
+{
+    columns_.swap( other.columns_ );
+    std::swap( layout_, other.layout_ );
+    eytzinger_keys_.swap( other.eytzinger_keys_ );
+    eytzinger_rank_.swap( other.eytzinger_rank_ );
+    compressed_keys_.swap( other.compressed_keys_ );
+    learned_keys_.swap( other.learned_keys_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::save( const std::string& path ) const
+{
+    key_container_type decoded;
+    columns_.save( path, sorted_keys( decoded ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::open_mapped( const std::string& path )
+{
+    soa_map ret;
+    ret.columns_.open_mapped( path );
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::freeze( soa_layout layout )
+{
+    if( layout == soa_layout::compressed && !detail::compressed_keys< KeyType, KeyCompare >::supported )
+    {
+        throw std::invalid_argument( "soa_map::freeze: soa_layout::compressed needs integer keys ordered by std::less" );
+    }
+    thaw();
+    if( layout == soa_layout::eytzinger )
+    {
+        eytzinger_keys_.resize( size() + 1 );
+        eytzinger_rank_.resize( size() + 1 );
+        detail::eytzinger_build( columns_.keys(), size(), eytzinger_keys_.data(), eytzinger_rank_.data() );
+    }
+    else if( layout == soa_layout::compressed )
+    {
+        compressed_keys_.build( columns_.keys(), size() );
+    }
+    else if( layout == soa_layout::learned )
+    {
+        if( !detail::learned_keys< KeyType, KeyCompare >::supported )
+        {
+            return;
+        }
+        learned_keys_.build( columns_.keys(), size() );
+    }
+    layout_ = layout;
+    drop_keys();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+soa_layout soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::layout() const
+{
+    return layout_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::layout_bytes() const
+{
+    return eytzinger_keys_.size() * sizeof( KeyType ) + eytzinger_rank_.size() * sizeof( size_t )
+         + compressed_keys_.bytes() + learned_keys_.bytes();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const Stats& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::stats() const
+{
+    return *this;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+Stats& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::stats()
+{
+    return *this;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Accounts for the element just inserted at pos.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::count_insert( size_t pos, size_t oldCapacity ) const
+{
+    Stats::inserted( 1, 0 );
+    Stats::shifted( size() - 1 - pos );
+    count_reallocation( oldCapacity, size() - 1 );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::count_reallocation( size_t oldCapacity, size_t elements ) const
+{
+    if( columns_.capacity() != oldCapacity )
+    {
+        Stats::reallocated( elements );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::detach()
 {
-    key_container_.swap( other.key_container_ );
-    value_container_.swap( other.value_container_ );
+    columns_.detach();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const KeyType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::keyAtIndex( size_t index ) const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+bool soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::mapped() const
 {
-    return key_container_.at( index );
+    return columns_.borrowed();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-ValueType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::atIndex( size_t index )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::thaw()
 {
-    return value_container_.at( index );
+    if( layout_ != soa_layout::sorted )
+    {
+        restore_keys();
+        layout_ = soa_layout::sorted;
+        key_container_type().swap( eytzinger_keys_ );
+        rank_container_type().swap( eytzinger_rank_ );
+        compressed_keys_.clear();
+        learned_keys_.clear();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::drop_keys()
+{
+    drop_keys( std::integral_constant< bool, detail::compressed_keys< KeyType, KeyCompare >::supported >() );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Mapped columns are not ours to shrink, they keep the key column.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::drop_keys( std::true_type )
+{
+    if( layout_ == soa_layout::compressed && !columns_.borrowed() && !columns_.keys_dropped() )
+    {
+        columns_.drop_keys();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Key types soa_layout::compressed cannot pack always keep their column.
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::drop_keys( std::false_type )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::restore_keys()
+{
+    if( columns_.keys_dropped() )
+    {
+        key_container_type decoded( size() );
+        compressed_keys_.decode( decoded.data() );
+        columns_.restore_keys( decoded.data() );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const KeyType* soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::sorted_keys( key_container_type& decoded ) const
+{
+    if( columns_.keys_dropped() )
+    {
+        decoded.resize( size() );
+        compressed_keys_.decode( decoded.data() );
+        return decoded.data();
+    }
+    return columns_.keys();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::lower_bound_index( const KeyType &key ) const
+{
+    if( layout_ == soa_layout::eytzinger )
+    {
+        size_t node = detail::eytzinger_search< false >( eytzinger_keys_.data(), size(), key, KeyCompare() );
+        return ( node == 0 ) ? size() : eytzinger_rank_[ node ];
+    }
+    if( layout_ == soa_layout::compressed )
+    {
+        return compressed_keys_.lower_bound( key );
+    }
+    if( layout_ == soa_layout::learned )
+    {
+        return learned_keys_.lower_bound( columns_.keys(), size(), key );
+    }
+    return detail::branchless_lower_bound( columns_.keys(), size(), key, KeyCompare() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::upper_bound_index( const KeyType &key ) const
+{
+    if( layout_ == soa_layout::eytzinger )
+    {
+        size_t node = detail::eytzinger_search< true >( eytzinger_keys_.data(), size(), key, KeyCompare() );
+        return ( node == 0 ) ? size() : eytzinger_rank_[ node ];
+    }
+    if( layout_ == soa_layout::compressed || layout_ == soa_layout::learned )
+    {
+        // Keys are unique: the upper bound is one past an exact hit.
+        size_t idx = lower_bound_index( key );
+        return ( idx != size() && !KeyCompare()( key, stored_key( idx ) ) ) ? idx + 1 : idx;
+    }
+    return std::upper_bound( columns_.keys(), columns_.keys() + size(), key, KeyCompare() ) - columns_.keys();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const ValueType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::atIndex( size_t index ) const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::counted_lower_bound_index( const KeyType &key ) const
 {
-    return value_container_.at( index );
+    typename Stats::scope timing( stats(), soa_stats_op::find );
+    size_t idx = lower_bound_index( key );
+    Stats::found( idx != size() && !KeyCompare()( key, stored_key( idx ) ) );
+    return idx;
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-ValueType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::at( const KeyType & key )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+size_t soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::counted_upper_bound_index( const KeyType &key ) const
+{
+    typename Stats::scope timing( stats(), soa_stats_op::find );
+    size_t idx = upper_bound_index( key );
+    Stats::found( idx != 0 && !KeyCompare()( stored_key( idx - 1 ), key ) );
+    return idx;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::key_reference soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::keyAtIndex( size_t index ) const
+{
+    if( index >= size() )
+    {
+        throw std::out_of_range( "soa_map: index out of range" );
+    }
+    return stored_key( index );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::key_reference soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::stored_key( size_t index ) const
+{
+    return columns_.keys_dropped() ? compressed_keys_.key_at( index ) : columns_.keys()[ index ];
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::value_reference soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::atIndex( size_t index )
+{
+    columns_.detach();
+    return columns_.at( index );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::const_value_reference soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::atIndex( size_t index ) const
+{
+    return columns_.at( index );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::value_reference soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::at( const KeyType & key )
 {
     auto pos = find( key );
 
@@ -277,15 +741,24 @@ ValueType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const ValueType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::at( const KeyType & key ) const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::const_value_reference soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::at( const KeyType & key ) const
 {
-    return const_cast< ValueType & >( const_cast< const soa_map* >( this )->at( key ) );
+    typename Stats::scope timing( stats(), soa_stats_op::find );
+    size_t idx = lower_bound_index( key );
+    bool hit = idx != size() && !KeyCompare()( key, stored_key( idx ) );
+    Stats::found( hit );
+
+    if( hit )
+    {
+        return columns_[ idx ];
+    }
+    throw std::out_of_range( "" );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-ValueType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::operator[]( const KeyType &key )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::value_reference soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::operator[]( const KeyType &key )
 {
     auto pos = find( key );
 
@@ -295,131 +768,256 @@ ValueType& soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator
     }
     
     insert( { key, ValueType() } );
-    pos = find( key );
-    return pos.value();
+    return atIndex( lower_bound_index( key ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< size_t I >
+boost::iterator_range< typename detail::column_element< ValueType, I >::type* >
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::column()
+{
+    columns_.detach();
+    auto first = columns_.template data< I >();
+    return boost::make_iterator_range( first, first + size() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::begin()
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< size_t I >
+boost::iterator_range< const typename detail::column_element< ValueType, I >::type* >
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::column() const
+{
+    auto first = columns_.template data< I >();
+    return boost::make_iterator_range( first, first + size() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::begin()
 {
     return iterator( *this, 0 );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::begin() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::const_iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::begin() const
 {
-    return const_iterator( *this, 0 );
+    return const_iterator( const_cast< soa_map& >( *this ), 0 );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::end()
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::end()
 {
     return iterator( *this, size() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::end() const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::const_iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::end() const
 {
-    return const_iterator( *this, size() );
+    return const_iterator( const_cast< soa_map& >( *this ), size() );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::lower_bound( const KeyType &key )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::lower_bound( const KeyType &key )
 {
-    auto pos = std::lower_bound( key_container_.begin(), key_container_.end(), key, KeyCompare() );
-    if( key_container_.end() != pos )
-    {
-        size_t idx = std::distance( key_container_.begin(), pos );
-        return iterator( *this, idx );
-    }
-    return end();
+    return iterator( *this, counted_lower_bound_index( key ) );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::lower_bound( const KeyType &key ) const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::const_iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::lower_bound( const KeyType &key ) const
 {
-    auto pos = std::lower_bound( key_container_.begin(), key_container_.end(), key, KeyCompare() );
-    if( key_container_.end() != pos )
-    {
-        size_t idx = std::distance( key_container_.begin(), pos );
-        return const_iterator( *this, idx );
-    }
-    return end();
+    return const_iterator( const_cast< soa_map& >( *this ), counted_lower_bound_index( key ) );
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::upper_bound( const KeyType &key )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::upper_bound( const KeyType &key )
 {
-    auto pos = std::upper_bound( key_container_.begin(), key_container_.end(), key, KeyCompare() );
-    if( key_container_.end() != pos )
+    return iterator( *this, counted_upper_bound_index( key ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::const_iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::upper_bound( const KeyType &key ) const
+{
+    return const_iterator( const_cast< soa_map& >( *this ), counted_upper_bound_index( key ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::find( const KeyType &key )
+{
+    typename Stats::scope timing( stats(), soa_stats_op::find );
+    size_t idx = lower_bound_index( key );
+    if( idx != size() && key == stored_key( idx ) )
     {
-        size_t idx = std::distance( key_container_.begin(), pos );
+        Stats::found( true );
         return iterator( *this, idx );
     }
+    Stats::found( false );
     return end();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::upper_bound( const KeyType &key ) const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::const_iterator
+soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::find( const KeyType &key ) const
 {
-    auto pos = std::upper_bound( key_container_.begin(), key_container_.end(), key, KeyCompare() );
-    if( key_container_.end() != pos )
+    typename Stats::scope timing( stats(), soa_stats_op::find );
+    size_t idx = lower_bound_index( key );
+    if( idx != size() && key == stored_key( idx ) )
     {
-        size_t idx = std::distance( key_container_.begin(), pos );
-        return const_iterator( *this, idx );
+        Stats::found( true );
+        return const_iterator( const_cast< soa_map& >( *this ), idx );
     }
+    Stats::found( false );
     return end();
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::find( const KeyType &key )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class InputIterator, class OutputIterator >
+OutputIterator soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::lower_bound_batch( InputIterator first, InputIterator last, OutputIterator out ) const
 {
-    auto pos = lower_bound( key );
-    if( end() != pos && key == pos.key() )
+    return search_batch< false >( first, last, out );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class InputIterator, class OutputIterator >
+OutputIterator soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::find_batch( InputIterator first, InputIterator last, OutputIterator out ) const
+{
+    return search_batch< true >( first, last, out );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< bool Find, class InputIterator, class OutputIterator >
+OutputIterator soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::search_batch( InputIterator first, InputIterator last, OutputIterator out ) const
+{
+    // The batch searches the sorted column, it hides the latency itself. Compressed keys have no
+    // column left and are searched one key at a time.
+    KeyCompare comp;
+    KeyType keys[ detail::search_group_size ];
+    size_t results[ detail::search_group_size ];
+    size_t hits = 0;
+    size_t misses = 0;
+
+    while( first != last )
     {
-        return pos;
+        size_t count = 0;
+        for( ; count < detail::search_group_size && first != last; ++count, ++first )
+        {
+            keys[ count ] = *first;
+        }
+
+        if( columns_.keys_dropped() )
+        {
+            for( size_t g = 0; g < count; ++g )
+            {
+                results[ g ] = compressed_keys_.lower_bound( keys[ g ] );
+            }
+        }
+        else
+        {
+            detail::branchless_lower_bound_group( columns_.keys(), size(), keys, count, results, comp );
+        }
+
+        for( size_t g = 0; g < count; ++g )
+        {
+            bool hit = results[ g ] != size() && !comp( keys[ g ], stored_key( results[ g ] ) );
+            if( Find && !hit )
+            {
+                results[ g ] = size();
+            }
+            if( Stats::enabled )
+            {
+                ++( hit ? hits : misses );
+            }
+            *out = results[ g ];
+            ++out;
+        }
     }
-    return end();
+    Stats::found( hits, misses );
+    return out;
 }
 
 //-------------------------------------------------------------------------------------------------
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-const typename soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::const_iterator
-soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >::find( const KeyType &key ) const
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class InputIterator, class OutputIterator >
+OutputIterator soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::lower_bound_sorted( InputIterator first, InputIterator last, OutputIterator out ) const
 {
-    auto pos = lower_bound( key );
-    if( end() != pos && key == pos.key() )
+    return search_sorted< false >( first, last, out );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class InputIterator, class OutputIterator >
+OutputIterator soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::find_sorted( InputIterator first, InputIterator last, OutputIterator out ) const
+{
+    return search_sorted< true >( first, last, out );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< bool Find, class InputIterator, class OutputIterator >
+OutputIterator soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::search_sorted( InputIterator first, InputIterator last, OutputIterator out ) const
+{
+    KeyCompare comp;
+    size_t pos = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    for( ; first != last; ++first )
     {
-        return pos;
+        const KeyType& key = *first;
+        pos = columns_.keys_dropped() ? compressed_keys_.lower_bound( key )
+                                      : detail::gallop_lower_bound( columns_.keys(), size(), pos, key, comp );
+        assert( pos == 0 || comp( stored_key( pos - 1 ), key ) );
+
+        bool hit = pos != size() && !comp( key, stored_key( pos ) );
+        if( Stats::enabled )
+        {
+            ++( hit ? hits : misses );
+        }
+        *out = ( Find && !hit ) ? size() : pos;
+        ++out;
     }
-    return end();
+    Stats::found( hits, misses );
+    return out;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+template< class OtherValueType, class OtherValueAllocator, class OtherStats, class OutputIterator >
+OutputIterator soa_map<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >::intersect(
+    const soa_map< KeyType, OtherValueType, KeyCompare, KeyAllocator, OtherValueAllocator, OtherStats >& other, OutputIterator out ) const
+{
+    key_container_type decoded;
+    key_container_type otherDecoded;
+    return detail::gallop_intersect( sorted_keys( decoded ), size(), other.sorted_keys( otherDecoded ), other.size(), out, KeyCompare() );
 }
 
 } //namespace ccppbrasil
 
 namespace std {
 
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-void swap( ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >& lhs,
-           ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >& rhs )
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void swap( ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >& lhs,
+           ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >& rhs )
 {
     std::swap( lhs.key(), rhs.key() );
     std::swap( lhs.value(), rhs.value() );
@@ -23,27 +23,42 @@
 #define CCPPBRASIL_SOAMAP_H
 
 #include <vector>
+#include <memory>
+#include <string>
+#include <type_traits>
 #include <boost/iterator/counting_iterator.hpp>
 
+#include <boost/range/iterator_range.hpp>
+
+#include "soa_allocator.h"
+#include "soa_columns.h"
+#include "soa_compressed.h"
+#include "soa_learned.h"
+#include "soa_parallel.h"
+#include "soa_search.h"
+#include "soa_stats.h"
+
 namespace ccppbrasil {
 
 template< class KeyType,
 		  class ValueType,
 		  class KeyCompare = std::less< KeyType >,
 		  class KeyAllocator = std::allocator< KeyType >,
-		  class ValueAllocator = std::allocator< ValueType > >
+		  class ValueAllocator = std::allocator< ValueType >,
+		  class Stats = soa_no_stats >
 class soa_map;
 
 template< class KeyType,
           class ValueType,
           class KeyCompare,
           class KeyAllocator,
-          class ValueAllocator >
+          class ValueAllocator,
+          class Stats >
 class soa_pair
 {
 public:
-    typedef soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > my_type;
-    typedef soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > value_type;
+    typedef soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > my_type;
+    typedef soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > value_type;
 
     soa_pair( value_type& obj, size_t pos );
     soa_pair( const soa_pair& other ) = default;
@@ -51,10 +66,20 @@ public:
     my_type& operator=( soa_pair&& other );
     bool operator<( const my_type& other ) const;
 
-    const KeyType& key() const;
+    typename detail::compressed_keys< KeyType, KeyCompare >::key_reference key() const;
+
+    typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::reference value();
+    typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::const_reference value() const;
+
+    // So that soa_iterator::operator->() chains: it->value(). A const pair only reads.
+    my_type* operator->() { return this; }
+    const my_type* operator->() const { return this; }
 
-    ValueType& value();
-    const ValueType& value() const;
+    // Field I of the value, for soa_columns values. Column 0 is the value itself otherwise.
+    template< size_t I >
+    typename detail::column_element< ValueType, I >::type& get();
+    template< size_t I >
+    const typename detail::column_element< ValueType, I >::type& get() const;
 
 private:
     value_type& soa_map_;
@@ -65,12 +90,13 @@ template< class KeyType,
 		  class ValueType,
 		  class KeyCompare,
 		  class KeyAllocator,
-		  class ValueAllocator >
+		  class ValueAllocator,
+		  class Stats >
 class soa_iterator : public boost::counting_iterator<size_t>
 {
 public:
-    typedef soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > value_type;
-    typedef soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator > ref_type;
+    typedef soa_map< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > value_type;
+    typedef soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > ref_type;
 
     soa_iterator( value_type& obj, size_t pos );
     soa_iterator( const soa_iterator& other ) = default;
@@ -79,31 +105,49 @@ public:
 
     void swap( soa_iterator& other );
 
-    const KeyType& key() const;
+    typename detail::compressed_keys< KeyType, KeyCompare >::key_reference key() const;
 
-    ValueType& value();
-    const ValueType& value() const;
+    typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::reference value();
+    typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::const_reference value() const;
 
     ref_type operator*();
-    ref_type operator*() const;
+    const ref_type operator*() const;
 
     ref_type operator->();
-    ref_type operator->() const;
+    const ref_type operator->() const;
 
 private:
     value_type& soa_map_;
 };
 
+// Keys and values share a single block from KeyAllocator (rebound to char), one column after
+// the other, each starting on a soa_column_alignment boundary; growing reallocates once for all
+// of them. ValueAllocator only types value_container_type and must rebind to the same allocator
+// as KeyAllocator, a static_assert checks it. Use huge_page_allocator as both allocators to back
+// large maps with huge pages. Stats picks the operation statistics kept by
+// the map, none by default; see soa_stats.
 template< class KeyType,
 		  class ValueType,
 		  class KeyCompare,
 		  class KeyAllocator,
-		  class ValueAllocator >
-class soa_map
+		  class ValueAllocator,
+		  class Stats >
+class soa_map : private Stats
 {
 public:
-   	typedef soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >            iterator;
-   	typedef const soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >      const_iterator;
+   	typedef soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >       iterator;
+   	typedef const soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats > const_iterator;
+    typedef std::vector< KeyType, KeyAllocator >                                                    key_container_type;
+    typedef typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::container_type value_container_type;
+    typedef typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::reference value_reference;
+    typedef typename detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator >::const_reference const_value_reference;
+    // What keyAtIndex() and iterator key() return: a copy for the key types soa_layout::compressed
+    // supports, which may have no key column to refer to, a const reference otherwise.
+    typedef typename detail::compressed_keys< KeyType, KeyCompare >::key_reference key_reference;
+
+    // Builds a map from already sorted and unique key/value columns, moving the elements into
+    // the map's column block.
+    static soa_map from_sorted_unique( key_container_type keys, value_container_type values );
 
 	void reserve( size_t capacity );
 	size_t size() const;
@@ -112,21 +156,72 @@ public:
 
 	bool insert( const std::pair< KeyType, ValueType > &keyValuePair );
 
-    bool emplace( KeyType && moveKey, ValueType && value );
+    // Sorts the batch once and merges it with the columns in a single pass.
+    // Keys already in the map, or repeated in the batch, keep the first value.
+    template< class InputIterator >
+    void insert( InputIterator first, InputIterator last );
 
-	iterator erase( const KeyType &key );
+    // Same as above, with the batch sorted on pool.
+    template< class InputIterator >
+    void insert( InputIterator first, InputIterator last, thread_pool& pool );
 
-	void swap( soa_map &other );
+    bool emplace( KeyType && moveKey, ValueType && value );
 
-	const KeyType& keyAtIndex( size_t index ) const;
+	iterator erase( const KeyType &key );
 
-	ValueType& atIndex( size_t index );
-	const ValueType& atIndex( size_t index ) const;
+    // Erases every key of the sorted range [first, last) in a single compaction pass and returns
+    // how many were found.
+    template< class InputIterator >
+    size_t erase_sorted( InputIterator first, InputIterator last );
 
-	ValueType& at( const KeyType & key );
-	const ValueType& at( const KeyType & key ) const;
+	void swap( soa_map &other );
 
-	ValueType& operator[]( const KeyType &key );
+    // Writes the sorted key and value columns to path as a versioned binary snapshot. Key and
+    // value fields must be trivially copyable.
+    void save( const std::string& path ) const;
+
+    // Maps a snapshot written by save() read-only and searches it in place, without reading it
+    // into memory. Mapped pages are shared with every process mapping the same file. Read it
+    // through a const soa_map (at, atIndex, find, find_batch, column, iterator value()) to stay
+    // on the mapping. Anything that may write copies the columns into memory first, once: insert,
+    // emplace, erase, erase_sorted, reserve and the non-const value accessors (at, atIndex,
+    // operator[], column, iterator value()).
+    static soa_map open_mapped( const std::string& path );
+
+    // Copies the columns of a mapped map into memory of its own, once; does nothing otherwise.
+    void detach();
+    bool mapped() const;
+
+    // Builds a search copy of the key column in the given layout. The sorted columns, iteration
+    // order and indexes are unchanged. Single element insert/erase drop back to soa_layout::sorted,
+    // insert( first, last ) and erase_sorted rebuild the current layout.
+    // soa_layout::compressed replaces the key column instead of copying it: keys are decoded from
+    // the packed blocks, so the batch and sorted searches and intersect lose their sorted column
+    // fast paths, and thawing copies the column back. It needs integer keys ordered by std::less
+    // and throws std::invalid_argument otherwise. soa_layout::learned needs arithmetic keys
+    // ordered by std::less; other maps stay sorted.
+    void freeze( soa_layout layout = soa_layout::eytzinger );
+    soa_layout layout() const;
+
+    // Bytes of the search copy built by freeze(), 0 for soa_layout::sorted.
+    size_t layout_bytes() const;
+
+	key_reference keyAtIndex( size_t index ) const;
+
+	value_reference atIndex( size_t index );
+	const_value_reference atIndex( size_t index ) const;
+
+	value_reference at( const KeyType & key );
+	const_value_reference at( const KeyType & key ) const;
+
+	value_reference operator[]( const KeyType &key );
+
+    // Contiguous column I of the values: field I for soa_columns values, column 0 otherwise.
+    // Scanning one column never touches the others.
+    template< size_t I >
+    boost::iterator_range< typename detail::column_element< ValueType, I >::type* > column();
+    template< size_t I >
+    boost::iterator_range< const typename detail::column_element< ValueType, I >::type* > column() const;
 
 	iterator begin();
 	const_iterator begin() const;
@@ -143,23 +238,83 @@ public:
 	iterator find( const KeyType &key );
 	const_iterator find( const KeyType &key ) const;
 
-private:
-    typedef std::vector< KeyType, KeyAllocator > key_container_type;
-    typedef std::vector< ValueType, ValueAllocator > value_container_type;
+    // Write one index per key in [first, last) to out: the lower bound, or for find_batch the
+    // position of the key and size() when it is missing. The searches of a group of keys run
+    // interleaved, so the cache misses of one key overlap with the work on the others.
+    template< class InputIterator, class OutputIterator >
+    OutputIterator lower_bound_batch( InputIterator first, InputIterator last, OutputIterator out ) const;
+
+    template< class InputIterator, class OutputIterator >
+    OutputIterator find_batch( InputIterator first, InputIterator last, OutputIterator out ) const;
 
-    friend class soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >;
+    // Same output as the batch versions, for keys already sorted by KeyCompare. Each key is
+    // searched with a galloping search that starts at the previous result.
+    template< class InputIterator, class OutputIterator >
+    OutputIterator lower_bound_sorted( InputIterator first, InputIterator last, OutputIterator out ) const;
 
-    key_container_type key_container_;
-    value_container_type value_container_;
+    template< class InputIterator, class OutputIterator >
+    OutputIterator find_sorted( InputIterator first, InputIterator last, OutputIterator out ) const;
+
+    // Writes a std::pair< size_t, size_t > with the index in this map and the index in other for
+    // every key present in both maps, in key order.
+    template< class OtherValueType, class OtherValueAllocator, class OtherStats, class OutputIterator >
+    OutputIterator intersect( const soa_map< KeyType, OtherValueType, KeyCompare, KeyAllocator, OtherValueAllocator, OtherStats >& other,
+                              OutputIterator out ) const;
+
+    // Counters and latencies of the operations on this map, kept by the Stats policy.
+    const Stats& stats() const;
+    Stats& stats();
+
+private:
+    typedef detail::map_columns< KeyType, ValueType, KeyAllocator, ValueAllocator > column_storage_type;
+    typedef typename std::allocator_traits< KeyAllocator >::template rebind_alloc< size_t > rank_allocator_type;
+    typedef std::vector< size_t, rank_allocator_type > rank_container_type;
+
+    friend class soa_iterator<KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >;
+    template< class, class, class, class, class, class > friend class soa_map;
+
+    template< bool Find, class InputIterator, class OutputIterator >
+    OutputIterator search_batch( InputIterator first, InputIterator last, OutputIterator out ) const;
+    template< bool Find, class InputIterator, class OutputIterator >
+    OutputIterator search_sorted( InputIterator first, InputIterator last, OutputIterator out ) const;
+
+    void merge_sorted_batch( std::vector< std::pair< KeyType, ValueType > >& batch );
+
+    void count_insert( size_t pos, size_t oldCapacity ) const;
+    void count_reallocation( size_t oldCapacity, size_t elements ) const;
+
+    size_t lower_bound_index( const KeyType &key ) const;
+    size_t upper_bound_index( const KeyType &key ) const;
+    // lower_bound_index/upper_bound_index counted as a lookup, for the public entry points.
+    size_t counted_lower_bound_index( const KeyType &key ) const;
+    size_t counted_upper_bound_index( const KeyType &key ) const;
+    // Key index, from the key column or the compressed keys that replace it.
+    key_reference stored_key( size_t index ) const;
+    // Drop and give back the key column while the keys are compressed.
+    void drop_keys();
+    void drop_keys( std::true_type );
+    void drop_keys( std::false_type );
+    void restore_keys();
+    // The key column, or the keys decoded into decoded while they are compressed.
+    const KeyType* sorted_keys( key_container_type& decoded ) const;
+    void thaw();
+
+    column_storage_type columns_;
+
+    soa_layout layout_ = soa_layout::sorted;
+    key_container_type eytzinger_keys_;
+    rank_container_type eytzinger_rank_;
+    detail::compressed_keys< KeyType, KeyCompare > compressed_keys_;
+    detail::learned_keys< KeyType, KeyCompare > learned_keys_;
 };
 
 }
 
 namespace std {
 
-template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator >
-void swap( ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >& lhs,
-           ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator >& rhs );
+template< class KeyType, class ValueType, class KeyCompare, class KeyAllocator, class ValueAllocator, class Stats >
+void swap( ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >& lhs,
+           ::ccppbrasil::soa_pair< KeyType, ValueType, KeyCompare, KeyAllocator, ValueAllocator, Stats >& rhs );
 
 }
 
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAMAPBUILDER_IMPL_H
+#define CCPPBRASIL_SOAMAPBUILDER_IMPL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <queue>
+#include <stdexcept>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// soa_map_builder
+//-------------------------------------------------------------------------------------------------
+// spill() stable sorts the buffer, and std::stable_sort takes scratch space for up to half of it:
+// the buffer gets two thirds of memoryLimit.
+template< class KeyType, class ValueType, class KeyCompare >
+soa_map_builder< KeyType, ValueType, KeyCompare >::soa_map_builder( const std::string& path, size_t memoryLimit,
+                                                                   const std::string& tempPrefix ) :
+    path_( path ),
+    temp_prefix_( tempPrefix.empty() ? path : tempPrefix ),
+    run_capacity_( std::max( memoryLimit / 3 * 2 / sizeof( pair_type ), size_t( 1 ) ) ),
+    run_count_( 0 )
+{
+    static_assert( std::is_trivially_copyable< KeyType >::value, "soa_map_builder: keys must be trivially copyable" );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+soa_map_builder< KeyType, ValueType, KeyCompare >::~soa_map_builder()
+{
+    remove_files( runs_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+void soa_map_builder< KeyType, ValueType, KeyCompare >::insert( const std::pair< KeyType, ValueType > &keyValuePair )
+{
+    if( buffer_.capacity() == 0 )
+    {
+        buffer_.reserve( run_capacity_ );
+    }
+    buffer_.push_back( keyValuePair );
+    if( buffer_.size() >= run_capacity_ )
+    {
+        spill();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+template< class InputIterator >
+void soa_map_builder< KeyType, ValueType, KeyCompare >::insert( InputIterator first, InputIterator last )
+{
+    for( ; first != last; ++first )
+    {
+        insert( *first );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+size_t soa_map_builder< KeyType, ValueType, KeyCompare >::finish()
+{
+    if( !buffer_.empty() )
+    {
+        spill();
+    }
+    std::vector< pair_type >().swap( buffer_ );
+
+    while( runs_.size() > max_fan_in )
+    {
+        merge_pass();
+    }
+    size_t rows = write_snapshot();
+
+    remove_files( runs_ );
+    run_rows_.clear();
+    run_count_ = 0;
+    return rows;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Sorts the buffer, keeps the first pair of each key and writes it out as the next run.
+template< class KeyType, class ValueType, class KeyCompare >
+void soa_map_builder< KeyType, ValueType, KeyCompare >::spill()
+{
+    KeyCompare comp;
+    std::stable_sort( buffer_.begin(), buffer_.end(),
+                      [&comp]( const pair_type& a, const pair_type& b ) { return comp( a.first, b.first ); } );
+    buffer_.erase( std::unique( buffer_.begin(), buffer_.end(),
+                                [&comp]( const pair_type& a, const pair_type& b ) { return !comp( a.first, b.first ); } ),
+                   buffer_.end() );
+
+    runs_.push_back( next_run_name() );
+    run_rows_.push_back( buffer_.size() );
+    std::ofstream out( runs_.back().c_str(), std::ios::binary | std::ios::trunc );
+    for( size_t i = 0; i < buffer_.size(); ++i )
+    {
+        write_pair( out, buffer_[ i ] );
+    }
+    out.close();
+    if( !out )
+    {
+        throw std::runtime_error( "soa_map_builder: cannot write " + runs_.back() );
+    }
+    buffer_.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+std::string soa_map_builder< KeyType, ValueType, KeyCompare >::next_run_name()
+{
+    return temp_prefix_ + ".run" + std::to_string( run_count_++ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+void soa_map_builder< KeyType, ValueType, KeyCompare >::write_pair( std::ostream& out, const pair_type& pair )
+{
+    out.write( reinterpret_cast< const char* >( &pair.first ), sizeof( KeyType ) );
+    fields::write( out, pair.second );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+bool soa_map_builder< KeyType, ValueType, KeyCompare >::read_pair( std::istream& in, pair_type& pair )
+{
+    in.read( reinterpret_cast< char* >( &pair.first ), sizeof( KeyType ) );
+    fields::read( in, pair.second );
+    return static_cast< bool >( in );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Merges the runs max_fan_in at a time into runs appended in the same order, so earlier pairs
+// still win, and removes each group as soon as it is merged. A last group of one run is kept
+// as it is.
+template< class KeyType, class ValueType, class KeyCompare >
+void soa_map_builder< KeyType, ValueType, KeyCompare >::merge_pass()
+{
+    size_t count = runs_.size();
+    for( size_t first = 0; first < count; first += max_fan_in )
+    {
+        size_t last = ( count - first < max_fan_in ) ? count : first + max_fan_in;
+        if( last - first == 1 )
+        {
+            runs_.push_back( runs_[ first ] );
+            run_rows_.push_back( run_rows_[ first ] );
+            runs_[ first ].clear();
+            continue;
+        }
+
+        std::string name = next_run_name();
+        std::ofstream out( name.c_str(), std::ios::binary | std::ios::trunc );
+        runs_.push_back( name );
+        auto sink = [this, &out]( const pair_type& pair ) { write_pair( out, pair ); };
+        run_rows_.push_back( merge_runs( first, last, sink ) );
+        out.close();
+        if( !out )
+        {
+            throw std::runtime_error( "soa_map_builder: cannot write " + name );
+        }
+
+        std::vector< std::string > merged( runs_.begin() + first, runs_.begin() + last );
+        remove_files( merged );
+        std::fill( runs_.begin() + first, runs_.begin() + last, std::string() );
+    }
+    runs_.erase( runs_.begin(), runs_.begin() + count );
+    run_rows_.erase( run_rows_.begin(), run_rows_.begin() + count );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Merges the sorted runs [first, last), handing the first pair of each key to sink. On equal keys
+// the earlier run wins, so the first pair inserted is the one kept.
+template< class KeyType, class ValueType, class KeyCompare >
+template< class Sink >
+size_t soa_map_builder< KeyType, ValueType, KeyCompare >::merge_runs( size_t first, size_t last, Sink& sink )
+{
+    std::vector< std::unique_ptr< run_cursor > > cursors;
+    for( size_t i = first; i < last; ++i )
+    {
+        std::unique_ptr< run_cursor > cursor( new run_cursor );
+        cursor->in.open( runs_[ i ].c_str(), std::ios::binary );
+        if( !cursor->in )
+        {
+            throw std::runtime_error( "soa_map_builder: cannot read " + runs_[ i ] );
+        }
+        if( read_pair( cursor->in, cursor->current ) )
+        {
+            cursors.push_back( std::move( cursor ) );
+        }
+    }
+
+    KeyCompare comp;
+    auto later = [&cursors, &comp]( size_t a, size_t b )
+    {
+        const KeyType& keyA = cursors[ a ]->current.first;
+        const KeyType& keyB = cursors[ b ]->current.first;
+        return comp( keyB, keyA ) || ( !comp( keyA, keyB ) && a > b );
+    };
+    std::priority_queue< size_t, std::vector< size_t >, decltype( later ) > heap( later );
+    for( size_t i = 0; i < cursors.size(); ++i )
+    {
+        heap.push( i );
+    }
+
+    size_t rows = 0;
+    KeyType lastKey = KeyType();
+    while( !heap.empty() )
+    {
+        size_t idx = heap.top();
+        heap.pop();
+
+        run_cursor& cursor = *cursors[ idx ];
+        if( rows == 0 || comp( lastKey, cursor.current.first ) )
+        {
+            sink( cursor.current );
+            lastKey = cursor.current.first;
+            ++rows;
+        }
+        if( read_pair( cursor.in, cursor.current ) )
+        {
+            heap.push( idx );
+        }
+    }
+    return rows;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Lays the columns out for every pair in the runs and merges the runs into them. Once the merge
+// knows how many keys are left, the header is rewritten with that row count.
+template< class KeyType, class ValueType, class KeyCompare >
+size_t soa_map_builder< KeyType, ValueType, KeyCompare >::write_snapshot()
+{
+    size_t bound = 0;
+    for( size_t i = 0; i < run_rows_.size(); ++i )
+    {
+        bound += run_rows_[ i ];
+    }
+
+    std::vector< size_t > sizes( fields::count + 1 );
+    sizes[ 0 ] = sizeof( KeyType );
+    fields::sizes( &sizes[ 1 ] );
+    std::vector< detail::snapshot_column > table( sizes.size() );
+
+    std::ofstream out( path_.c_str(), std::ios::binary | std::ios::trunc );
+    detail::write_snapshot_header( out, bound, sizes.data(), sizes.size(), table.data() );
+
+    std::vector< detail::snapshot_column_writer > columns;
+    for( size_t i = 0; i < table.size(); ++i )
+    {
+        columns.push_back( detail::snapshot_column_writer( out, table[ i ].offset ) );
+    }
+    auto sink = [&columns]( const pair_type& pair )
+    {
+        columns[ 0 ].write( reinterpret_cast< const char* >( &pair.first ), sizeof( KeyType ) );
+        fields::scatter( &columns[ 1 ], pair.second );
+    };
+    size_t rows = merge_runs( 0, runs_.size(), sink );
+    for( size_t i = 0; i < columns.size(); ++i )
+    {
+        columns[ i ].flush();
+    }
+
+    if( rows != bound )
+    {
+        uint64_t headerRows = rows;
+        out.seekp( offsetof( detail::snapshot_header, rows ) );
+        out.write( reinterpret_cast< const char* >( &headerRows ), sizeof( headerRows ) );
+    }
+    out.close();
+    if( !out )
+    {
+        throw std::runtime_error( "soa_map_builder: cannot write " + path_ );
+    }
+    return rows;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class KeyCompare >
+void soa_map_builder< KeyType, ValueType, KeyCompare >::remove_files( std::vector< std::string >& files )
+{
+    for( size_t i = 0; i < files.size(); ++i )
+    {
+        std::remove( files[ i ].c_str() );
+    }
+    files.clear();
+}
+
+}
+
+#endif // CCPPBRASIL_SOAMAPBUILDER_IMPL_H
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAMAPBUILDER_H
+#define CCPPBRASIL_SOAMAPBUILDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "soa_map.h"
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Snapshot columns of a value type: the value itself, or one per field of soa_columns.
+//-------------------------------------------------------------------------------------------------
+template< class ValueType >
+struct snapshot_fields
+{
+    static_assert( std::is_trivially_copyable< ValueType >::value, "soa_map_builder: values must be trivially copyable" );
+
+    static const size_t count = 1;
+
+    static void sizes( size_t* out )
+    {
+        out[ 0 ] = sizeof( ValueType );
+    }
+
+    // All the fields, one after the other.
+    static void write( std::ostream& out, const ValueType& value )
+    {
+        out.write( reinterpret_cast< const char* >( &value ), sizeof( value ) );
+    }
+
+    static void read( std::istream& in, ValueType& value )
+    {
+        in.read( reinterpret_cast< char* >( &value ), sizeof( value ) );
+    }
+
+    // Field i to columns[ i ].
+    template< class Column >
+    static void scatter( Column* columns, const ValueType& value )
+    {
+        columns[ 0 ].write( reinterpret_cast< const char* >( &value ), sizeof( value ) );
+    }
+};
+
+template< class... Ts >
+struct snapshot_fields< soa_columns< Ts... > >
+{
+    static_assert( all_trivially_copyable< Ts... >::value, "soa_map_builder: value fields must be trivially copyable" );
+
+    static const size_t count = sizeof...( Ts );
+
+    static void sizes( size_t* out )
+    {
+        const size_t fieldSizes[] = { sizeof( Ts )... };
+        std::copy( fieldSizes, fieldSizes + count, out );
+    }
+
+    static void write( std::ostream& out, const soa_columns< Ts... >& value )
+    {
+        write( out, value, make_index_sequence< sizeof...( Ts ) >() );
+    }
+
+    static void read( std::istream& in, soa_columns< Ts... >& value )
+    {
+        read( in, value, make_index_sequence< sizeof...( Ts ) >() );
+    }
+
+    template< class Column >
+    static void scatter( Column* columns, const soa_columns< Ts... >& value )
+    {
+        scatter( columns, value, make_index_sequence< sizeof...( Ts ) >() );
+    }
+
+private:
+    template< size_t... Is >
+    static void write( std::ostream& out, const soa_columns< Ts... >& value, index_sequence< Is... > )
+    {
+        CCPPBRASIL_SOA_EXPAND( out.write( reinterpret_cast< const char* >( &std::get< Is >( value ) ), sizeof( Ts ) ) )
+    }
+
+    template< size_t... Is >
+    static void read( std::istream& in, soa_columns< Ts... >& value, index_sequence< Is... > )
+    {
+        CCPPBRASIL_SOA_EXPAND( in.read( reinterpret_cast< char* >( &std::get< Is >( value ) ), sizeof( Ts ) ) )
+    }
+
+    template< class Column, size_t... Is >
+    static void scatter( Column* columns, const soa_columns< Ts... >& value, index_sequence< Is... > )
+    {
+        CCPPBRASIL_SOA_EXPAND( columns[ Is ].write( reinterpret_cast< const char* >( &std::get< Is >( value ) ), sizeof( Ts ) ) )
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+// Writes one column of a snapshot from its offset on, through a buffer of its own, so the columns
+// of a row go to one file without a seek per field.
+//-------------------------------------------------------------------------------------------------
+class snapshot_column_writer
+{
+public:
+    static const size_t buffer_size = 1024 * 1024;
+
+    snapshot_column_writer( std::ostream& out, uint64_t offset ) : out_( &out ), offset_( offset ) {}
+
+    void write( const char* data, size_t size )
+    {
+        if( buffer_.size() + size > buffer_size )
+        {
+            flush();
+        }
+        buffer_.insert( buffer_.end(), data, data + size );
+    }
+
+    void flush()
+    {
+        if( !buffer_.empty() )
+        {
+            out_->seekp( static_cast< std::streamoff >( offset_ ) );
+            out_->write( buffer_.data(), static_cast< std::streamsize >( buffer_.size() ) );
+            offset_ += buffer_.size();
+            buffer_.clear();
+        }
+    }
+
+private:
+    std::ostream* out_;
+    uint64_t offset_;
+    std::vector< char > buffer_;
+};
+
+} // namespace detail
+
+// Builds a soa_map snapshot file from an unsorted stream of pairs that may not fit in memory.
+//
+// Pairs are buffered up to two thirds of memoryLimit, leaving the rest to the sort; each full
+// buffer is sorted and spilled to a run file next to tempPrefix. finish() k-way merges the runs
+// straight into the columns of the snapshot, in the layout soa_map::open_mapped() reads; with
+// more than max_fan_in runs it first merges them max_fan_in at a time into longer runs, so it
+// never has more than max_fan_in files open. Memory stays within memoryLimit while inserting,
+// then max_fan_in stream buffers and a write buffer per column. As with soa_map::insert, the
+// first pair inserted for a key wins. Key and value fields must be trivially copyable.
+//
+// The column offsets are laid out for every pair in the runs; keys repeated across runs leave
+// unused, zero filled rows between a column and the next.
+template< class KeyType,
+          class ValueType,
+          class KeyCompare = std::less< KeyType > >
+class soa_map_builder
+{
+public:
+    static const size_t default_memory_limit = 256 * 1024 * 1024;
+    static const size_t max_fan_in = 64;
+
+    // Run files are named tempPrefix.run<n>; by default tempPrefix is path.
+    explicit soa_map_builder( const std::string& path, size_t memoryLimit = default_memory_limit,
+                              const std::string& tempPrefix = std::string() );
+    ~soa_map_builder();
+
+    void insert( const std::pair< KeyType, ValueType > &keyValuePair );
+
+    template< class InputIterator >
+    void insert( InputIterator first, InputIterator last );
+
+    // Merges everything inserted so far into the snapshot file, removes the run files and
+    // returns the number of keys written. The builder is empty afterwards.
+    size_t finish();
+
+private:
+    typedef std::pair< KeyType, ValueType > pair_type;
+    typedef detail::snapshot_fields< ValueType > fields;
+
+    struct run_cursor
+    {
+        std::ifstream in;
+        pair_type current;
+    };
+
+    soa_map_builder( const soa_map_builder& ) = delete;
+    soa_map_builder& operator=( const soa_map_builder& ) = delete;
+
+    void spill();
+    std::string next_run_name();
+    void write_pair( std::ostream& out, const pair_type& pair );
+    bool read_pair( std::istream& in, pair_type& pair );
+    void merge_pass();
+    template< class Sink >
+    size_t merge_runs( size_t first, size_t last, Sink& sink );
+    size_t write_snapshot();
+    void remove_files( std::vector< std::string >& files );
+
+    std::string path_;
+    std::string temp_prefix_;
+    size_t run_capacity_;
+    std::vector< pair_type > buffer_;
+    std::vector< std::string > runs_;
+    std::vector< size_t > run_rows_;
+    size_t run_count_;
+};
+
+}
+
+#include "soa_map_builder-impl.h"
+
+#endif // CCPPBRASIL_SOAMAPBUILDER_H
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAPARALLEL_H
+#define CCPPBRASIL_SOAPARALLEL_H
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+#include <vector>
+#include <boost/range/iterator_range.hpp>
+
+#include "soa_thread_pool.h"
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Fewest elements of size bytes that fill a whole number of cache lines: 64 / gcd( size, 64 ).
+inline size_t line_elements( size_t size )
+{
+    size_t a = size;
+    size_t b = cache_line_size;
+    while( b != 0 )
+    {
+        size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return cache_line_size / a;
+}
+
+//-------------------------------------------------------------------------------------------------
+// line_elements() of a row reference: a value, or one std::tuple field per column. Columns start
+// on a cache line, so a chunk of this many rows starts a new line in every column.
+template< class Reference >
+struct row_line_elements;
+
+template< class T >
+struct row_line_elements< T& >
+{
+    static size_t value() { return line_elements( sizeof( T ) ); }
+};
+
+template< class... Ts >
+struct row_line_elements< std::tuple< Ts&... > >
+{
+    static size_t value()
+    {
+        // Powers of two, so the largest is a multiple of the others.
+        size_t elements[] = { line_elements( sizeof( Ts ) )... };
+        return *std::max_element( elements, elements + sizeof...( Ts ) );
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+// Chunk size for a parallel loop over count elements, a multiple of unit, the line_elements() of
+// the columns: chunks of columns starting on a cache line never share a line. About 16 chunks per
+// participant, so stealing has something to balance.
+//-------------------------------------------------------------------------------------------------
+inline size_t parallel_grain( size_t count, size_t unit, const thread_pool& pool )
+{
+    size_t target = count / ( pool.concurrency() * 16 ) + 1;
+    return ( target + unit - 1 ) / unit * unit;
+}
+
+} // namespace detail
+
+//-------------------------------------------------------------------------------------------------
+// Calls function( element ) on every element of a column, e.g. soa_map::column< I >() or
+// soa_vector::column< I >().
+template< class T, class Function >
+void parallel_for_each( boost::iterator_range< T* > column, Function function, thread_pool& pool = default_thread_pool() )
+{
+    T* first = column.begin();
+    pool.parallel_for( column.size(), detail::parallel_grain( column.size(), detail::line_elements( sizeof( T ) ), pool ),
+                       [ first, &function ]( size_t begin, size_t end )
+                       {
+                           for( size_t i = begin; i < end; ++i )
+                           {
+                               function( first[ i ] );
+                           }
+                       } );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Calls function( value_reference ) on every value of a soa_map, chunked on the value columns. A
+// mapped map is detached once, before the workers start.
+template< class MapType, class Function >
+void parallel_for_each_value( MapType& map, Function function, thread_pool& pool = default_thread_pool() )
+{
+    map.detach();
+    size_t unit = detail::row_line_elements< typename MapType::value_reference >::value();
+    pool.parallel_for( map.size(), detail::parallel_grain( map.size(), unit, pool ),
+                       [ &map, &function ]( size_t begin, size_t end )
+                       {
+                           for( size_t i = begin; i < end; ++i )
+                           {
+                               function( map.atIndex( i ) );
+                           }
+                       } );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Reduces [0, count) with function( first, last ), which returns the result of one chunk, and
+// combines the chunk results in index order with op, starting from init. op must be associative.
+template< class U, class Function, class BinaryOp >
+U parallel_reduce_rows( size_t count, size_t grain, U init, Function function, BinaryOp op,
+                        thread_pool& pool = default_thread_pool() )
+{
+    grain = ( grain == 0 ) ? 1 : grain;
+    std::vector< U > partials( ( count + grain - 1 ) / grain, init );
+    pool.parallel_for( count, grain,
+                       [ grain, &partials, &function ]( size_t begin, size_t end )
+                       {
+                           for( size_t first = begin; first < end; first += grain )
+                           {
+                               partials[ first / grain ] = function( first, std::min( first + grain, end ) );
+                           }
+                       } );
+
+    U result = init;
+    for( size_t i = 0; i < partials.size(); ++i )
+    {
+        result = op( result, partials[ i ] );
+    }
+    return result;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Folds a column with op, starting from init. Each chunk is folded from its first element, so op
+// must be associative and U constructible from T.
+template< class T, class U, class BinaryOp >
+U parallel_reduce( boost::iterator_range< T* > column, U init, BinaryOp op, thread_pool& pool = default_thread_pool() )
+{
+    const T* first = column.begin();
+    return parallel_reduce_rows( column.size(), detail::parallel_grain( column.size(), detail::line_elements( sizeof( T ) ), pool ), init,
+                                 [ first, &op ]( size_t begin, size_t end )
+                                 {
+                                     U acc = U( first[ begin ] );
+                                     for( size_t i = begin + 1; i < end; ++i )
+                                     {
+                                         acc = op( acc, U( first[ i ] ) );
+                                     }
+                                     return acc;
+                                 },
+                                 op, pool );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Stable sort: chunks are stable sorted in parallel, then merged pairwise, each round of merges
+// in parallel, through a buffer of the same size.
+template< class RandomIterator, class Compare >
+void parallel_stable_sort( RandomIterator first, RandomIterator last, Compare comp, thread_pool& pool = default_thread_pool() )
+{
+    typedef typename std::iterator_traits< RandomIterator >::value_type value_type;
+
+    size_t count = static_cast< size_t >( last - first );
+    size_t grain = count / pool.concurrency() + 1;
+    if( pool.concurrency() == 1 || count < 2 * detail::cache_line_size )
+    {
+        std::stable_sort( first, last, comp );
+        return;
+    }
+
+    pool.parallel_for( count, grain,
+                       [ first, &comp ]( size_t begin, size_t end )
+                       {
+                           std::stable_sort( first + begin, first + end, comp );
+                       } );
+
+    std::vector< value_type > buffer( count );
+    bool inBuffer = false;
+    for( size_t width = grain; width < count; width *= 2 )
+    {
+        auto merge = [ & ]( size_t begin, size_t end )
+        {
+            for( size_t pair = begin; pair < end; ++pair )
+            {
+                size_t lo = pair * 2 * width;
+                size_t mid = std::min( lo + width, count );
+                size_t hi = std::min( lo + 2 * width, count );
+                if( inBuffer )
+                {
+                    std::merge( std::make_move_iterator( buffer.begin() + lo ), std::make_move_iterator( buffer.begin() + mid ),
+                                std::make_move_iterator( buffer.begin() + mid ), std::make_move_iterator( buffer.begin() + hi ),
+                                first + lo, comp );
+                }
+                else
+                {
+                    std::merge( std::make_move_iterator( first + lo ), std::make_move_iterator( first + mid ),
+                                std::make_move_iterator( first + mid ), std::make_move_iterator( first + hi ),
+                                buffer.begin() + lo, comp );
+                }
+            }
+        };
+        pool.parallel_for( ( count + 2 * width - 1 ) / ( 2 * width ), 1, merge );
+        inBuffer = !inBuffer;
+    }
+
+    if( inBuffer )
+    {
+        std::move( buffer.begin(), buffer.end(), first );
+    }
+}
+
+}
+
+#endif // CCPPBRASIL_SOAPARALLEL_H
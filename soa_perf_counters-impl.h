@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAPERFCOUNTERS_IMPL_H
+#define CCPPBRASIL_SOAPERFCOUNTERS_IMPL_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+inline perf_counters::perf_counters()
+{
+    for( size_t i = 0; i < event_count; ++i )
+    {
+        fds_[ i ] = -1;
+    }
+
+#ifdef __linux__
+    const uint32_t types[ event_count ] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE };
+    const uint64_t read_miss = ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+    const uint64_t configs[ event_count ] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_L1D | read_miss,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_DTLB | read_miss };
+
+    // Each event on its own rather than as a group: a group opens all or nothing, and the
+    // kernel multiplexes single events when there are more than the hardware counters.
+    for( size_t i = 0; i < event_count; ++i )
+    {
+        perf_event_attr attr;
+        std::memset( &attr, 0, sizeof( attr ) );
+        attr.size = sizeof( attr );
+        attr.type = types[ i ];
+        attr.config = configs[ i ];
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds_[ i ] = static_cast< int >( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+        if( fds_[ i ] < 0 )
+        {
+            error_ += ( error_.empty() ? "" : ", " ) + std::string( name( static_cast< perf_event >( i ) ) ) + ": "
+                    + std::strerror( errno );
+        }
+    }
+#else
+    error_ = "perf_counters need Linux perf_event_open";
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+inline perf_counters::~perf_counters()
+{
+#ifdef __linux__
+    for( size_t i = 0; i < event_count; ++i )
+    {
+        if( fds_[ i ] >= 0 )
+        {
+            close( fds_[ i ] );
+        }
+    }
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+inline bool perf_counters::available() const
+{
+    for( size_t i = 0; i < event_count; ++i )
+    {
+        if( fds_[ i ] >= 0 )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline bool perf_counters::available( perf_event event ) const
+{
+    return fds_[ static_cast< size_t >( event ) ] >= 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline const std::string& perf_counters::error() const
+{
+    return error_;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline const char* perf_counters::name( perf_event event )
+{
+    const char* names[ event_count ] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses" };
+    return names[ static_cast< size_t >( event ) ];
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void perf_counters::start()
+{
+#ifdef __linux__
+    for( size_t i = 0; i < event_count; ++i )
+    {
+        if( fds_[ i ] >= 0 )
+        {
+            ioctl( fds_[ i ], PERF_EVENT_IOC_RESET, 0 );
+            ioctl( fds_[ i ], PERF_EVENT_IOC_ENABLE, 0 );
+        }
+    }
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void perf_counters::stop( double values[ event_count ] )
+{
+#ifdef __linux__
+    for( size_t i = 0; i < event_count; ++i )
+    {
+        if( fds_[ i ] >= 0 )
+        {
+            ioctl( fds_[ i ], PERF_EVENT_IOC_DISABLE, 0 );
+        }
+    }
+#endif
+    for( size_t i = 0; i < event_count; ++i )
+    {
+        values[ i ] = std::numeric_limits< double >::quiet_NaN();
+#ifdef __linux__
+        // value, time enabled, time running
+        uint64_t data[ 3 ];
+        if( fds_[ i ] >= 0 && read( fds_[ i ], data, sizeof( data ) ) == sizeof( data ) && data[ 2 ] != 0 )
+        {
+            values[ i ] = static_cast< double >( data[ 0 ] ) * data[ 1 ] / data[ 2 ];
+        }
+#endif
+    }
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOAPERFCOUNTERS_IMPL_H
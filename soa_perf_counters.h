@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAPERFCOUNTERS_H
+#define CCPPBRASIL_SOAPERFCOUNTERS_H
+
+#include <cstddef>
+#include <string>
+
+namespace ccppbrasil {
+
+// Hardware events counted around the timed regions of a benchmark. l1d_misses and dtlb_misses
+// are data read misses; llc_misses is the generic cache-misses event, last level cache misses on
+// current x86 cores.
+enum class perf_event
+{
+    cycles,
+    instructions,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+    dtlb_misses
+};
+
+// Linux perf_event_open counters for the calling thread and the threads it starts and joins while
+// counting. Threads still running at stop(), e.g. the workers of a thread_pool, are not counted.
+// Kernel and hypervisor time are excluded, so perf_event_paranoid up to 2 is enough.
+//
+// The constructor opens every event it can and never throws: events the CPU, the kernel or the
+// permissions do not allow are left out and error() says why. Without perf_event_open, on other
+// systems or in most virtual machines, available() is false and the counters read nothing.
+//
+//     perf_counters counters;
+//     double values[ perf_counters::event_count ];
+//     counters.start();
+//     work();
+//     counters.stop( values );
+class perf_counters
+{
+public:
+    static const size_t event_count = 6;
+
+    perf_counters();
+    ~perf_counters();
+
+    perf_counters( const perf_counters& ) = delete;
+    perf_counters& operator=( const perf_counters& ) = delete;
+
+    // True when at least one event opened.
+    bool available() const;
+    bool available( perf_event event ) const;
+
+    // Why the events that are missing could not be opened, empty when all of them opened.
+    const std::string& error() const;
+
+    static const char* name( perf_event event );
+
+    // Resets and enables the events.
+    void start();
+
+    // Disables the events and reads the counts since start(), scaled up when the kernel
+    // multiplexed them. Events that did not open or never got a hardware counter read NaN.
+    void stop( double values[ event_count ] );
+
+private:
+    int fds_[ event_count ];
+    std::string error_;
+};
+
+}
+
+#include "soa_perf_counters-impl.h"
+
+#endif // CCPPBRASIL_SOAPERFCOUNTERS_H
@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOASEARCH_H
+#define CCPPBRASIL_SOASEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// _mm_prefetch comes with SSE, which MSVC has on every x86 target.
+#if defined( __SSE__ ) || defined( _M_X64 ) || defined( _M_IX86 )
+#define CCPPBRASIL_SOA_MM_PREFETCH
+#include <xmmintrin.h>
+#endif
+
+#include "soa_isa.h"
+
+namespace ccppbrasil {
+
+// Key column layouts selectable through soa_map::freeze().
+enum class soa_layout
+{
+    sorted,     // plain sorted column, std::lower_bound style search
+    eytzinger,  // extra copy of the keys in BFS order, searched with prefetching
+    compressed, // frame of reference blocks of bit packed deltas, for integer keys
+    learned     // piecewise linear model of the key positions, for arithmetic keys
+};
+
+namespace detail {
+
+const size_t cache_line_size = 64;
+
+//-------------------------------------------------------------------------------------------------
+// A hint only: a no-op where neither _mm_prefetch nor __builtin_prefetch exists.
+inline void prefetch( const void* ptr )
+{
+#if defined( CCPPBRASIL_SOA_MM_PREFETCH )
+    _mm_prefetch( static_cast< const char* >( ptr ), _MM_HINT_T0 );
+#elif defined( __GNUC__ )
+    __builtin_prefetch( ptr );
+#else
+    (void) ptr;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+inline unsigned count_trailing_zeros( uint64_t value )
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+#ifdef _WIN64
+    _BitScanForward64( &idx, value );
+#else
+    if( _BitScanForward( &idx, static_cast< unsigned long >( value ) ) == 0 )
+    {
+        _BitScanForward( &idx, static_cast< unsigned long >( value >> 32 ) );
+        idx += 32;
+    }
+#endif
+    return idx;
+#else
+    return __builtin_ctzll( value );
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+inline unsigned popcount( unsigned value )
+{
+#ifdef _MSC_VER
+    return __popcnt( value );
+#else
+    return __builtin_popcount( value );
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+// Linear scan kernels
+//
+// count_less( first, size, key ) counts the keys smaller than key. On a sorted window it is the
+// offset of the lower bound. Keys compared with std::less that fit a vector lane are compared
+// 2 to 8 at a time on the variant active_isa() picks; every other key/comparator pair uses the
+// scalar loop.
+//-------------------------------------------------------------------------------------------------
+enum class simd_key { none, int32, int64, float32, float64 };
+
+template< class KeyType >
+struct simd_key_of : std::integral_constant< simd_key,
+    std::is_same< KeyType, float >::value ? simd_key::float32 :
+    std::is_same< KeyType, double >::value ? simd_key::float64 :
+    !std::is_integral< KeyType >::value || std::is_same< KeyType, bool >::value ? simd_key::none :
+    sizeof( KeyType ) == 4 ? simd_key::int32 :
+    sizeof( KeyType ) == 8 ? simd_key::int64 : simd_key::none >
+{
+};
+
+template< class KeyType, class KeyCompare >
+struct simd_key_for : std::integral_constant< simd_key, simd_key::none >
+{
+};
+
+template< class KeyType >
+struct simd_key_for< KeyType, std::less< KeyType > > : simd_key_of< KeyType >
+{
+};
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class KeyCompare >
+size_t count_less_scalar( const KeyType* first, size_t size, const KeyType& key, KeyCompare comp )
+{
+    size_t count = 0;
+    for( size_t i = 0; i < size; ++i )
+    {
+        count += comp( first[ i ], key ) ? 1 : 0;
+    }
+    return count;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class KeyCompare >
+size_t count_less( const KeyType* first, size_t size, const KeyType& key, KeyCompare comp,
+                   std::integral_constant< simd_key, simd_key::none > )
+{
+    return count_less_scalar( first, size, key, comp );
+}
+
+#if defined( CCPPBRASIL_SOA_SSE2 )
+//-------------------------------------------------------------------------------------------------
+// Vector variants. Each one counts whole vectors from first[ i ] on, advances i past them and
+// leaves the tail to the next narrower variant or to the scalar loop.
+//
+// Integer lanes compare signed: unsigned keys get their sign bit flipped first, which maps the
+// unsigned order onto the signed one.
+template< class KeyType >
+size_t count_less_sse( const KeyType* first, size_t size, const KeyType& key, size_t& i,
+                       std::integral_constant< simd_key, simd_key::int32 > )
+{
+    size_t count = 0;
+    const int32_t bias = std::is_signed< KeyType >::value ? 0 : INT32_MIN;
+    const __m128i vbias = _mm_set1_epi32( bias );
+    const __m128i vkey = _mm_set1_epi32( static_cast< int32_t >( key ) ^ bias );
+    for( ; i + 4 <= size; i += 4 )
+    {
+        __m128i x = _mm_xor_si128( _mm_loadu_si128( reinterpret_cast< const __m128i* >( first + i ) ), vbias );
+        count += popcount( _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpgt_epi32( vkey, x ) ) ) );
+    }
+    return count;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType >
+CCPPBRASIL_SOA_TARGET_AVX2
+size_t count_less_avx2( const KeyType* first, size_t size, const KeyType& key, size_t& i,
+                        std::integral_constant< simd_key, simd_key::int32 > lanes )
+{
+    size_t count = 0;
+    const int32_t bias = std::is_signed< KeyType >::value ? 0 : INT32_MIN;
+    const __m256i vbias = _mm256_set1_epi32( bias );
+    const __m256i vkey = _mm256_set1_epi32( static_cast< int32_t >( key ) ^ bias );
+    for( ; i + 8 <= size; i += 8 )
+    {
+        __m256i x = _mm256_xor_si256( _mm256_loadu_si256( reinterpret_cast< const __m256i* >( first + i ) ), vbias );
+        count += popcount( _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpgt_epi32( vkey, x ) ) ) );
+    }
+    return count + count_less_sse( first, size, key, i, lanes );
+}
+
+//-------------------------------------------------------------------------------------------------
+// 64 bit lane compares need SSE4.2.
+template< class KeyType >
+CCPPBRASIL_SOA_TARGET_SSE42
+size_t count_less_sse( const KeyType* first, size_t size, const KeyType& key, size_t& i,
+                       std::integral_constant< simd_key, simd_key::int64 > )
+{
+    size_t count = 0;
+    const int64_t bias = std::is_signed< KeyType >::value ? 0 : INT64_MIN;
+    const __m128i vbias = _mm_set1_epi64x( bias );
+    const __m128i vkey = _mm_set1_epi64x( static_cast< int64_t >( key ) ^ bias );
+    for( ; i + 2 <= size; i += 2 )
+    {
+        __m128i x = _mm_xor_si128( _mm_loadu_si128( reinterpret_cast< const __m128i* >( first + i ) ), vbias );
+        count += popcount( _mm_movemask_pd( _mm_castsi128_pd( _mm_cmpgt_epi64( vkey, x ) ) ) );
+    }
+    return count;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType >
+CCPPBRASIL_SOA_TARGET_AVX2
+size_t count_less_avx2( const KeyType* first, size_t size, const KeyType& key, size_t& i,
+                        std::integral_constant< simd_key, simd_key::int64 > lanes )
+{
+    size_t count = 0;
+    const int64_t bias = std::is_signed< KeyType >::value ? 0 : INT64_MIN;
+    const __m256i vbias = _mm256_set1_epi64x( bias );
+    const __m256i vkey = _mm256_set1_epi64x( static_cast< int64_t >( key ) ^ bias );
+    for( ; i + 4 <= size; i += 4 )
+    {
+        __m256i x = _mm256_xor_si256( _mm256_loadu_si256( reinterpret_cast< const __m256i* >( first + i ) ), vbias );
+        count += popcount( _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( vkey, x ) ) ) );
+    }
+    return count + count_less_sse( first, size, key, i, lanes );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t count_less_sse( const float* first, size_t size, const float& key, size_t& i,
+                              std::integral_constant< simd_key, simd_key::float32 > )
+{
+    size_t count = 0;
+    const __m128 vkey = _mm_set1_ps( key );
+    for( ; i + 4 <= size; i += 4 )
+    {
+        count += popcount( _mm_movemask_ps( _mm_cmplt_ps( _mm_loadu_ps( first + i ), vkey ) ) );
+    }
+    return count;
+}
+
+//-------------------------------------------------------------------------------------------------
+CCPPBRASIL_SOA_TARGET_AVX2
+inline size_t count_less_avx2( const float* first, size_t size, const float& key, size_t& i,
+                               std::integral_constant< simd_key, simd_key::float32 > lanes )
+{
+    size_t count = 0;
+    const __m256 vkey = _mm256_set1_ps( key );
+    for( ; i + 8 <= size; i += 8 )
+    {
+        count += popcount( _mm256_movemask_ps( _mm256_cmp_ps( _mm256_loadu_ps( first + i ), vkey, _CMP_LT_OQ ) ) );
+    }
+    return count + count_less_sse( first, size, key, i, lanes );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t count_less_sse( const double* first, size_t size, const double& key, size_t& i,
+                              std::integral_constant< simd_key, simd_key::float64 > )
+{
+    size_t count = 0;
+    const __m128d vkey = _mm_set1_pd( key );
+    for( ; i + 2 <= size; i += 2 )
+    {
+        count += popcount( _mm_movemask_pd( _mm_cmplt_pd( _mm_loadu_pd( first + i ), vkey ) ) );
+    }
+    return count;
+}
+
+//-------------------------------------------------------------------------------------------------
+CCPPBRASIL_SOA_TARGET_AVX2
+inline size_t count_less_avx2( const double* first, size_t size, const double& key, size_t& i,
+                               std::integral_constant< simd_key, simd_key::float64 > lanes )
+{
+    size_t count = 0;
+    const __m256d vkey = _mm256_set1_pd( key );
+    for( ; i + 4 <= size; i += 4 )
+    {
+        count += popcount( _mm256_movemask_pd( _mm256_cmp_pd( _mm256_loadu_pd( first + i ), vkey, _CMP_LT_OQ ) ) );
+    }
+    return count + count_less_sse( first, size, key, i, lanes );
+}
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// The 128 bit variant needs SSE4.2 for 64 bit integer lanes, SSE2 otherwise.
+template< class KeyType, class KeyCompare, simd_key Lanes >
+size_t count_less( const KeyType* first, size_t size, const KeyType& key, KeyCompare comp,
+                   std::integral_constant< simd_key, Lanes > lanes )
+{
+    size_t count = 0;
+    size_t i = 0;
+#if defined( CCPPBRASIL_SOA_SSE2 )
+    const soa_isa isa = active_isa();
+    if( isa >= soa_isa::avx2 )
+    {
+        count = count_less_avx2( first, size, key, i, lanes );
+    }
+    else if( isa >= ( Lanes == simd_key::int64 ? soa_isa::sse42 : soa_isa::sse2 ) )
+    {
+        count = count_less_sse( first, size, key, i, lanes );
+    }
+#endif
+    return count + count_less_scalar( first + i, size - i, key, comp );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Control byte groups
+//
+// Open addressing tables keep one control byte per slot: ctrl_empty, ctrl_deleted, or 7 bits of
+// the hash of the key in a full slot. A group is ctrl_group_size bytes, aligned, and one vector
+// compare returns a bit per byte, so a probe checks a whole group of slots at once.
+//-------------------------------------------------------------------------------------------------
+const size_t ctrl_group_size = 16;
+const int8_t ctrl_empty = -128;
+const int8_t ctrl_deleted = -2;
+
+// Bit i set when byte i of the group equals value.
+inline unsigned match_group( const int8_t* group, int8_t value )
+{
+#if defined( CCPPBRASIL_SOA_SSE2 )
+    __m128i ctrl = _mm_load_si128( reinterpret_cast< const __m128i* >( group ) );
+    return static_cast< unsigned >( _mm_movemask_epi8( _mm_cmpeq_epi8( ctrl, _mm_set1_epi8( value ) ) ) );
+#else
+    unsigned mask = 0;
+    for( size_t i = 0; i < ctrl_group_size; ++i )
+    {
+        mask |= ( group[ i ] == value ? 1u : 0u ) << i;
+    }
+    return mask;
+#endif
+}
+
+// Bit i set when slot i of the group is empty or deleted: both have the sign bit set, full slots
+// do not.
+inline unsigned match_group_free( const int8_t* group )
+{
+#if defined( CCPPBRASIL_SOA_SSE2 )
+    return static_cast< unsigned >( _mm_movemask_epi8( _mm_load_si128( reinterpret_cast< const __m128i* >( group ) ) ) );
+#else
+    unsigned mask = 0;
+    for( size_t i = 0; i < ctrl_group_size; ++i )
+    {
+        mask |= ( group[ i ] < 0 ? 1u : 0u ) << i;
+    }
+    return mask;
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+// Branchless lower bound
+//
+// Halves the range with a conditional move instead of a branch, so there is no misprediction
+// per level, and prefetches both candidates of the next level. Once the range fits in a few
+// cache lines, the remaining keys are counted with the linear scan kernel picked for the key type.
+//-------------------------------------------------------------------------------------------------
+template< class KeyType >
+struct linear_search_window : std::integral_constant< size_t,
+    ( 4 * cache_line_size / sizeof( KeyType ) > 8 ) ? 4 * cache_line_size / sizeof( KeyType ) : 8 >
+{
+};
+
+// Start of the cache line holding base, clamped to first. The keys between it and base are all
+// smaller than the key base was reached for, so the linear scan can start there and, on a
+// column aligned to soa_column_alignment, read whole cache lines only.
+template< class KeyType >
+const KeyType* cache_line_start( const KeyType* first, const KeyType* base )
+{
+    if( cache_line_size % sizeof( KeyType ) != 0 )
+    {
+        return base;
+    }
+    size_t offset = ( reinterpret_cast< uintptr_t >( base ) % cache_line_size ) / sizeof( KeyType );
+    size_t before = static_cast< size_t >( base - first );
+    return base - ( offset < before ? offset : before );
+}
+
+template< class KeyType, class KeyCompare >
+size_t branchless_lower_bound( const KeyType* first, size_t size, const KeyType& key, KeyCompare comp )
+{
+    const KeyType* base = first;
+    while( size > linear_search_window< KeyType >::value )
+    {
+        size_t half = size / 2;
+        // Both possible next probes, so the load does not wait on the comparison.
+        prefetch( base + half / 2 );
+        prefetch( base + half + half / 2 );
+        base = comp( base[ half ], key ) ? base + half : base;
+        size -= half;
+    }
+    const KeyType* start = cache_line_start( first, base );
+    return ( start - first ) + count_less( start, size + ( base - start ), key, comp, simd_key_for< KeyType, KeyCompare >() );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Interleaved lower bound for a group of keys
+//
+// All searches over the same range take the same number of steps, so they advance level by level
+// together. Right after a key moves, its next probe is prefetched; the load then overlaps with the
+// steps of the other keys in the group.
+//-------------------------------------------------------------------------------------------------
+const size_t search_group_size = 16;
+
+template< class KeyType, class KeyCompare >
+void branchless_lower_bound_group( const KeyType* first, size_t size, const KeyType* keys, size_t count,
+                                   size_t* results, KeyCompare comp )
+{
+    const KeyType* base[ search_group_size ];
+    for( size_t g = 0; g < count; ++g )
+    {
+        base[ g ] = first;
+    }
+
+    while( size > linear_search_window< KeyType >::value )
+    {
+        size_t half = size / 2;
+        size_t next = ( size - half ) / 2;
+        for( size_t g = 0; g < count; ++g )
+        {
+            base[ g ] = comp( base[ g ][ half ], keys[ g ] ) ? base[ g ] + half : base[ g ];
+            prefetch( base[ g ] + next );
+        }
+        size -= half;
+    }
+
+    for( size_t g = 0; g < count; ++g )
+    {
+        const KeyType* start = cache_line_start( first, base[ g ] );
+        results[ g ] = ( start - first ) + count_less( start, size + ( base[ g ] - start ), keys[ g ], comp, simd_key_for< KeyType, KeyCompare >() );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Galloping (exponential) search
+//
+// For sorted query streams: the answer for a key is at or after the answer for the previous one,
+// so the search probes from, from + 1, from + 3, from + 7, ... until it passes the key and only
+// the last gap is binary searched. The cost grows with the log of the distance between hits
+// instead of the log of the column size.
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class KeyCompare >
+size_t gallop_lower_bound( const KeyType* first, size_t size, size_t from, const KeyType& key, KeyCompare comp )
+{
+    size_t lo = from;
+    size_t hi = from;
+    size_t step = 1;
+    while( hi < size && comp( first[ hi ], key ) )
+    {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if( hi > size )
+    {
+        hi = size;
+    }
+    return lo + branchless_lower_bound( first + lo, hi - lo, key, comp );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Writes the ( index in a, index in b ) pair of every key in both columns. Walks the shorter
+// column and gallops over the longer one.
+template< class KeyType, class KeyCompare, class OutputIterator >
+OutputIterator gallop_intersect( const KeyType* a, size_t sizeA, const KeyType* b, size_t sizeB,
+                                 OutputIterator out, KeyCompare comp )
+{
+    bool swapped = sizeB < sizeA;
+    const KeyType* probe = swapped ? b : a;
+    size_t probeSize = swapped ? sizeB : sizeA;
+    const KeyType* target = swapped ? a : b;
+    size_t targetSize = swapped ? sizeA : sizeB;
+
+    size_t pos = 0;
+    for( size_t i = 0; i < probeSize && pos < targetSize; ++i )
+    {
+        pos = gallop_lower_bound( target, targetSize, pos, probe[ i ], comp );
+        if( pos < targetSize && !comp( probe[ i ], target[ pos ] ) )
+        {
+            *out = swapped ? std::make_pair( pos, i ) : std::make_pair( i, pos );
+            ++out;
+            ++pos;
+        }
+    }
+    return out;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Eytzinger layout
+//
+// The sorted keys are stored as an implicit binary tree in BFS order, 1-based: the children of
+// node k are 2k and 2k+1. The top levels share a few cache lines, and the descendants of k a few
+// levels down are contiguous, so they can be prefetched while the current level is compared.
+// rank[k] holds the sorted position of node k, to map the result back to the sorted columns.
+//-------------------------------------------------------------------------------------------------
+template< class KeyType >
+size_t eytzinger_build( const KeyType* sorted, size_t size, KeyType* tree, size_t* rank,
+                        size_t idx = 0, size_t node = 1 )
+{
+    if( node <= size )
+    {
+        idx = eytzinger_build( sorted, size, tree, rank, idx, 2 * node );
+        tree[ node ] = sorted[ idx ];
+        rank[ node ] = idx;
+        ++idx;
+        idx = eytzinger_build( sorted, size, tree, rank, idx, 2 * node + 1 );
+    }
+    return idx;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Returns the node reached after the descent, or 0 if every key compared true. Going right on
+// comp( tree[k], key ) gives lower_bound, going right on !comp( key, tree[k] ) gives upper_bound.
+// The last left turn is the answer: it is recovered by dropping the trailing right turns (ones)
+// and the left turn itself from k.
+template< bool Upper, class KeyType, class KeyCompare >
+size_t eytzinger_search( const KeyType* tree, size_t size, const KeyType& key, KeyCompare comp )
+{
+    // Descendants four levels below, or fewer when a cache line holds less than 16 keys.
+    const size_t prefetch_stride = cache_line_size / sizeof( KeyType ) > 0 ? cache_line_size / sizeof( KeyType ) : 1;
+
+    size_t node = 1;
+    while( node <= size )
+    {
+        prefetch( tree + node * prefetch_stride );
+        bool right = Upper ? !comp( key, tree[ node ] ) : comp( tree[ node ], key );
+        node = 2 * node + ( right ? 1 : 0 );
+    }
+    node >>= count_trailing_zeros( ~static_cast< uint64_t >( node ) ) + 1;
+    return node;
+}
+
+} // namespace detail
+} // namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOASEARCH_H
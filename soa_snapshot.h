@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOASNAPSHOT_H
+#define CCPPBRASIL_SOASNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "soa_vector.h"
+
+namespace ccppbrasil {
+
+namespace detail {
+
+// Snapshot file layout, all integers in host byte order:
+//
+//     snapshot_header
+//     snapshot_column[ columns ]
+//     column 0 data, column 1 data, ...
+//
+// Every column starts on a soa_column_alignment boundary of the file, so a mapped column is as
+// aligned as one in a basic_soa_vector block.
+const char snapshot_magic[ 8 ] = { 'C', 'C', 'P', 'P', 'S', 'O', 'A', '\0' };
+const uint32_t snapshot_version = 1;
+const uint32_t snapshot_byte_order = 0x01020304;
+
+struct snapshot_header
+{
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t rows;
+    uint64_t columns;
+};
+
+struct snapshot_column
+{
+    uint64_t offset;
+    uint64_t element_size;
+};
+
+//-------------------------------------------------------------------------------------------------
+// Read only mapping of a whole file.
+//-------------------------------------------------------------------------------------------------
+class mapped_file
+{
+public:
+    explicit mapped_file( const std::string& path ) : data_( nullptr ), size_( 0 )
+    {
+#ifdef _WIN32
+        file_ = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+        if( file_ == INVALID_HANDLE_VALUE )
+        {
+            throw std::runtime_error( "soa_map::open_mapped: cannot open " + path );
+        }
+        LARGE_INTEGER size;
+        mapping_ = nullptr;
+        if( GetFileSizeEx( file_, &size ) && size.QuadPart > 0 )
+        {
+            mapping_ = CreateFileMappingA( file_, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        }
+        if( mapping_ != nullptr )
+        {
+            data_ = static_cast< const char* >( MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 ) );
+        }
+        if( data_ == nullptr )
+        {
+            close();
+            throw std::runtime_error( "soa_map::open_mapped: cannot map " + path );
+        }
+        size_ = static_cast< size_t >( size.QuadPart );
+#else
+        int fd = open( path.c_str(), O_RDONLY );
+        if( fd < 0 )
+        {
+            throw std::runtime_error( "soa_map::open_mapped: cannot open " + path );
+        }
+        struct stat info;
+        void* data = MAP_FAILED;
+        if( fstat( fd, &info ) == 0 && info.st_size > 0 )
+        {
+            data = mmap( nullptr, static_cast< size_t >( info.st_size ), PROT_READ, MAP_SHARED, fd, 0 );
+        }
+        ::close( fd );
+        if( data == MAP_FAILED )
+        {
+            throw std::runtime_error( "soa_map::open_mapped: cannot map " + path );
+        }
+        data_ = static_cast< const char* >( data );
+        size_ = static_cast< size_t >( info.st_size );
+#endif
+    }
+
+    ~mapped_file()
+    {
+        close();
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    mapped_file( const mapped_file& ) = delete;
+    mapped_file& operator=( const mapped_file& ) = delete;
+
+    void close()
+    {
+#ifdef _WIN32
+        if( data_ != nullptr )
+        {
+            UnmapViewOfFile( data_ );
+        }
+        if( mapping_ != nullptr )
+        {
+            CloseHandle( mapping_ );
+        }
+        CloseHandle( file_ );
+#else
+        if( data_ != nullptr )
+        {
+            munmap( const_cast< char* >( data_ ), size_ );
+        }
+#endif
+    }
+
+    const char* data_;
+    size_t size_;
+#ifdef _WIN32
+    HANDLE file_;
+    HANDLE mapping_;
+#endif
+};
+
+//-------------------------------------------------------------------------------------------------
+// Writes the header and column table of a snapshot with count columns of rows elements each, and
+// fills table with the column offsets. Returns the bytes written.
+inline size_t write_snapshot_header( std::ostream& out, uint64_t rows, const size_t* sizes, size_t count,
+                                     snapshot_column* table )
+{
+    snapshot_header header;
+    std::memcpy( header.magic, snapshot_magic, sizeof( header.magic ) );
+    header.version = snapshot_version;
+    header.byte_order = snapshot_byte_order;
+    header.rows = rows;
+    header.columns = count;
+
+    size_t written = sizeof( header ) + count * sizeof( snapshot_column );
+    uint64_t offset = written;
+    for( size_t i = 0; i < count; ++i )
+    {
+        offset = ( offset + soa_column_alignment - 1 ) / soa_column_alignment * soa_column_alignment;
+        table[ i ].offset = offset;
+        table[ i ].element_size = sizes[ i ];
+        offset += rows * sizes[ i ];
+    }
+
+    out.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+    out.write( reinterpret_cast< const char* >( table ), static_cast< std::streamsize >( count * sizeof( snapshot_column ) ) );
+    return written;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Zero fills out from written up to offset, the start of the next column.
+inline void write_snapshot_padding( std::ostream& out, uint64_t written, uint64_t offset )
+{
+    const char padding[ soa_column_alignment ] = {};
+    out.write( padding, static_cast< std::streamsize >( offset - written ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Writes columns, with front in place of column 0 when columns dropped it.
+template< class Allocator, class... Ts, size_t... Is >
+void write_snapshot( const std::string& path, const basic_soa_vector< Allocator, Ts... >& columns, index_sequence< Is... >,
+                     const typename basic_soa_vector< Allocator, Ts... >::template column_type< 0 >::type* front )
+{
+    const size_t sizes[] = { sizeof( Ts )... };
+    const char* data[] = { reinterpret_cast< const char* >( columns.template data< Is >() )... };
+    data[ 0 ] = reinterpret_cast< const char* >( front );
+
+    std::ofstream out( path.c_str(), std::ios::binary | std::ios::trunc );
+    snapshot_column table[ sizeof...( Ts ) ];
+    uint64_t written = write_snapshot_header( out, columns.size(), sizes, sizeof...( Ts ), table );
+    for( size_t i = 0; i < sizeof...( Ts ); ++i )
+    {
+        write_snapshot_padding( out, written, table[ i ].offset );
+        out.write( data[ i ], static_cast< std::streamsize >( columns.size() * sizes[ i ] ) );
+        written = table[ i ].offset + columns.size() * sizes[ i ];
+    }
+
+    out.close();
+    if( !out )
+    {
+        throw std::runtime_error( "soa_map::save: cannot write " + path );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Maps a snapshot and makes columns borrow its pages.
+template< class Allocator, class... Ts, size_t... Is >
+void open_snapshot( const std::string& path, basic_soa_vector< Allocator, Ts... >& columns, index_sequence< Is... > )
+{
+    std::shared_ptr< mapped_file > file = std::make_shared< mapped_file >( path );
+
+    snapshot_header header;
+    snapshot_column table[ sizeof...( Ts ) ];
+    if( file->size() < sizeof( header ) + sizeof( table ) )
+    {
+        throw std::runtime_error( "soa_map::open_mapped: truncated snapshot " + path );
+    }
+    std::memcpy( &header, file->data(), sizeof( header ) );
+    std::memcpy( table, file->data() + sizeof( header ), sizeof( table ) );
+
+    if( std::memcmp( header.magic, snapshot_magic, sizeof( header.magic ) ) != 0 ||
+        header.version != snapshot_version || header.byte_order != snapshot_byte_order )
+    {
+        throw std::runtime_error( "soa_map::open_mapped: not a snapshot of this version and byte order " + path );
+    }
+    const size_t sizes[] = { sizeof( Ts )... };
+    if( header.columns != sizeof...( Ts ) )
+    {
+        throw std::runtime_error( "soa_map::open_mapped: column count mismatch " + path );
+    }
+    for( size_t i = 0; i < sizeof...( Ts ); ++i )
+    {
+        if( table[ i ].element_size != sizes[ i ] || table[ i ].offset % soa_column_alignment != 0 ||
+            table[ i ].offset > file->size() || ( file->size() - table[ i ].offset ) / sizes[ i ] < header.rows )
+        {
+            throw std::runtime_error( "soa_map::open_mapped: column layout mismatch " + path );
+        }
+    }
+
+    columns.borrow( file, static_cast< size_t >( header.rows ),
+                    reinterpret_cast< const Ts* >( file->data() + table[ Is ].offset )... );
+}
+
+} // namespace detail
+
+}
+
+#endif // CCPPBRASIL_SOASNAPSHOT_H
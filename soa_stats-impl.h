@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOASTATS_IMPL_H
+#define CCPPBRASIL_SOASTATS_IMPL_H
+
+#include <algorithm>
+#include <limits>
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Index of the highest bit set, value > 0.
+inline unsigned highest_bit( uint64_t value )
+{
+    unsigned bit = 0;
+    for( unsigned shift = 32; shift > 0; shift /= 2 )
+    {
+        if( value >> shift )
+        {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+    return bit;
+}
+
+}
+
+//-------------------------------------------------------------------------------------------------
+// latency_histogram
+//-------------------------------------------------------------------------------------------------
+inline latency_histogram::latency_histogram() :
+    buckets_( bucket_count, 0 )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void latency_histogram::record( uint64_t ns, uint64_t count )
+{
+    buckets_[ bucket_index( ns ) ] += count;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void latency_histogram::merge( const latency_histogram& other )
+{
+    for( size_t i = 0; i < bucket_count; ++i )
+    {
+        buckets_[ i ] += other.buckets_[ i ];
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void latency_histogram::reset()
+{
+    std::fill( buckets_.begin(), buckets_.end(), 0 );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t latency_histogram::count() const
+{
+    uint64_t total = 0;
+    for( size_t i = 0; i < bucket_count; ++i )
+    {
+        total += buckets_[ i ];
+    }
+    return total;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t latency_histogram::min() const
+{
+    for( size_t i = 0; i < bucket_count; ++i )
+    {
+        if( buckets_[ i ] )
+        {
+            return bucket_lower( i );
+        }
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t latency_histogram::max() const
+{
+    for( size_t i = bucket_count; i > 0; --i )
+    {
+        if( buckets_[ i - 1 ] )
+        {
+            return bucket_upper( i - 1 );
+        }
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline double latency_histogram::mean() const
+{
+    uint64_t total = 0;
+    double sum = 0.;
+    for( size_t i = 0; i < bucket_count; ++i )
+    {
+        total += buckets_[ i ];
+        sum += buckets_[ i ] * ( ( bucket_lower( i ) + bucket_upper( i ) ) / 2. );
+    }
+    return total ? sum / total : 0.;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t latency_histogram::value_at_percentile( double percentile ) const
+{
+    uint64_t total = count();
+    if( !total )
+    {
+        return 0;
+    }
+    double wanted = std::max( 1., std::min( percentile, 100. ) / 100. * total );
+    uint64_t seen = 0;
+    for( size_t i = 0; i < bucket_count; ++i )
+    {
+        seen += buckets_[ i ];
+        if( seen >= wanted )
+        {
+            return bucket_upper( i );
+        }
+    }
+    return max();
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t latency_histogram::bucket( size_t index ) const
+{
+    return buckets_[ index ];
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t latency_histogram::bucket_index( uint64_t ns )
+{
+    if( ns < 16 )
+    {
+        return static_cast< size_t >( ns );
+    }
+    unsigned bit = detail::highest_bit( ns );
+    if( bit >= 40 )
+    {
+        return bucket_count - 1;
+    }
+    return ( bit - 3 ) * 16 + static_cast< size_t >( ( ns >> ( bit - 4 ) ) - 16 );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t latency_histogram::bucket_lower( size_t index )
+{
+    if( index < 16 )
+    {
+        return index;
+    }
+    unsigned bit = static_cast< unsigned >( index / 16 + 3 );
+    return ( 16 + index % 16 ) << ( bit - 4 );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t latency_histogram::bucket_upper( size_t index )
+{
+    if( index < 16 )
+    {
+        return index;
+    }
+    if( index == bucket_count - 1 )
+    {
+        return std::numeric_limits< uint64_t >::max();
+    }
+    unsigned bit = static_cast< unsigned >( index / 16 + 3 );
+    return bucket_lower( index ) + ( uint64_t( 1 ) << ( bit - 4 ) ) - 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+// soa_stats
+//-------------------------------------------------------------------------------------------------
+inline soa_stats::scope::scope( const soa_stats& stats, soa_stats_op op ) :
+    stats_( stats ),
+    op_( op ),
+    start_( std::chrono::steady_clock::now() )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_stats::scope::~scope()
+{
+    auto ns = std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start_ );
+    size_t index = latency_histogram::bucket_index( ns.count() > 0 ? static_cast< uint64_t >( ns.count() ) : 0 );
+    stats_.latency_[ static_cast< size_t >( op_ ) ][ index ].fetch_add( 1, std::memory_order_relaxed );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_stats::soa_stats()
+{
+    reset();
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_stats::soa_stats( const soa_stats& other )
+{
+    *this = other;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_stats& soa_stats::operator=( const soa_stats& other )
+{
+    for( size_t i = 0; i < counter_count; ++i )
+    {
+        counters_[ i ].store( other.counters_[ i ].load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    }
+    for( size_t op = 0; op < 3; ++op )
+    {
+        for( size_t i = 0; i < latency_histogram::bucket_count; ++i )
+        {
+            latency_[ op ][ i ].store( other.latency_[ op ][ i ].load( std::memory_order_relaxed ),
+                                       std::memory_order_relaxed );
+        }
+    }
+    return *this;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::found( bool hit ) const
+{
+    add( hit ? find_hits : find_misses, 1 );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::found( size_t hits, size_t misses ) const
+{
+    add( find_hits, hits );
+    add( find_misses, misses );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::inserted( size_t inserted, size_t existing ) const
+{
+    add( inserts, inserted );
+    add( insert_existing, existing );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::erased( size_t erased, size_t missing ) const
+{
+    add( erases, erased );
+    add( erase_misses, missing );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::shifted( size_t elements ) const
+{
+    add( shifted_elements, elements );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::reallocated( size_t elements ) const
+{
+    add( reallocations, 1 );
+    add( reallocated_elements, elements );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_stats_snapshot soa_stats::snapshot() const
+{
+    return read( false );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_stats_snapshot soa_stats::take()
+{
+    return read( true );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::reset()
+{
+    for( size_t i = 0; i < counter_count; ++i )
+    {
+        counters_[ i ].store( 0, std::memory_order_relaxed );
+    }
+    for( size_t op = 0; op < 3; ++op )
+    {
+        for( size_t i = 0; i < latency_histogram::bucket_count; ++i )
+        {
+            latency_[ op ][ i ].store( 0, std::memory_order_relaxed );
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void soa_stats::add( counter c, uint64_t value ) const
+{
+    if( value )
+    {
+        counters_[ c ].fetch_add( value, std::memory_order_relaxed );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline soa_stats_snapshot soa_stats::read( bool reset ) const
+{
+    uint64_t values[ counter_count ];
+    for( size_t i = 0; i < counter_count; ++i )
+    {
+        values[ i ] = reset ? counters_[ i ].exchange( 0, std::memory_order_relaxed )
+                            : counters_[ i ].load( std::memory_order_relaxed );
+    }
+    soa_stats_snapshot ret;
+    ret.finds = values[ find_hits ] + values[ find_misses ];
+    ret.find_hits = values[ find_hits ];
+    ret.find_misses = values[ find_misses ];
+    ret.inserts = values[ inserts ];
+    ret.insert_existing = values[ insert_existing ];
+    ret.erases = values[ erases ];
+    ret.erase_misses = values[ erase_misses ];
+    ret.shifted = values[ shifted_elements ];
+    ret.reallocations = values[ reallocations ];
+    ret.reallocated = values[ reallocated_elements ];
+
+    latency_histogram* histograms[ 3 ] = { &ret.insert_latency, &ret.erase_latency, &ret.find_latency };
+    for( size_t op = 0; op < 3; ++op )
+    {
+        for( size_t i = 0; i < latency_histogram::bucket_count; ++i )
+        {
+            uint64_t value = reset ? latency_[ op ][ i ].exchange( 0, std::memory_order_relaxed )
+                                   : latency_[ op ][ i ].load( std::memory_order_relaxed );
+            if( value )
+            {
+                histograms[ op ]->record( latency_histogram::bucket_lower( i ), value );
+            }
+        }
+    }
+    return ret;
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOASTATS_IMPL_H
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOASTATS_H
+#define CCPPBRASIL_SOASTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ccppbrasil {
+
+// Single key operations timed by soa_stats.
+enum class soa_stats_op
+{
+    insert, // insert( pair ), emplace
+    erase,  // erase( key )
+    find    // find, at, lower_bound, upper_bound
+};
+
+// Log-linear histogram of latencies in nanoseconds, the HdrHistogram layout: values under 16 get
+// a bucket each, every power of two above is split in 16 buckets, so a bucket is at most 1/16 of
+// its lower bound wide. Values from 2^40 ns, about 18 minutes, share the last bucket.
+class latency_histogram
+{
+public:
+    static const size_t bucket_count = 37 * 16;
+
+    latency_histogram();
+
+    void record( uint64_t ns, uint64_t count = 1 );
+    void merge( const latency_histogram& other );
+    void reset();
+
+    uint64_t count() const;
+
+    // From the bucket bounds: the lower bound of the first bucket used, the upper bound of the
+    // last one, the midpoints for the mean; 0 when empty.
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+
+    // Upper bound of the bucket holding the value at percentile (0 to 100), 0 when empty.
+    uint64_t value_at_percentile( double percentile ) const;
+
+    // The buckets, for exporting: bucket( i ) values from bucket_lower( i ) to bucket_upper( i ).
+    uint64_t bucket( size_t index ) const;
+    static size_t bucket_index( uint64_t ns );
+    static uint64_t bucket_lower( size_t index );
+    static uint64_t bucket_upper( size_t index );
+
+private:
+    std::vector< uint64_t > buckets_;
+};
+
+// Counters of a soa_map with the soa_stats policy. Batch inserts, erases and lookups add to the
+// counters but not to the latencies. A lookup hits when its key is in the map; for upper_bound,
+// when the key just before the bound is.
+struct soa_stats_snapshot
+{
+    uint64_t finds = 0;
+    uint64_t find_hits = 0;
+    uint64_t find_misses = 0;
+    uint64_t inserts = 0;         // keys inserted
+    uint64_t insert_existing = 0; // keys not inserted, already in the map or repeated in a batch
+    uint64_t erases = 0;          // keys erased
+    uint64_t erase_misses = 0;    // keys to erase not in the map
+    uint64_t shifted = 0;         // elements moved to open or close a gap for insert and erase
+    uint64_t reallocations = 0;   // growths of the column block
+    uint64_t reallocated = 0;     // elements moved to the new block by those growths
+    latency_histogram insert_latency;
+    latency_histogram erase_latency;
+    latency_histogram find_latency;
+};
+
+// Default stats policy of soa_map: keeps nothing. The hooks are empty inline functions and
+// soa_map derives from its policy, so the empty base adds no bytes either.
+struct soa_no_stats
+{
+    static const bool enabled = false;
+
+    class scope
+    {
+    public:
+        scope( const soa_no_stats&, soa_stats_op ) {}
+    };
+
+    void found( bool ) const {}
+    void found( size_t, size_t ) const {}
+    void inserted( size_t, size_t ) const {}
+    void erased( size_t, size_t ) const {}
+    void shifted( size_t ) const {}
+    void reallocated( size_t ) const {}
+
+    soa_stats_snapshot snapshot() const { return soa_stats_snapshot(); }
+    soa_stats_snapshot take() { return soa_stats_snapshot(); }
+    void reset() {}
+};
+
+// Stats policy that counts every soa_map operation and times the single key ones:
+//
+//     soa_map< size_t, size_t, std::less< size_t >, std::allocator< size_t >,
+//              std::allocator< size_t >, soa_stats > map;
+//     ...
+//     soa_stats_snapshot stats = map.stats().take();
+//
+// Updates are relaxed atomics, so lookups on a const map from several threads count safely.
+// Timing costs two steady_clock reads per operation. Copies of a map copy its counts; swap
+// leaves them with each map.
+class soa_stats
+{
+public:
+    static const bool enabled = true;
+
+    // Times one operation, from construction to destruction.
+    class scope
+    {
+    public:
+        scope( const soa_stats& stats, soa_stats_op op );
+        ~scope();
+
+    private:
+        const soa_stats& stats_;
+        soa_stats_op op_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    soa_stats();
+    soa_stats( const soa_stats& other );
+    soa_stats& operator=( const soa_stats& other );
+
+    void found( bool hit ) const;
+    void found( size_t hits, size_t misses ) const;
+    void inserted( size_t inserted, size_t existing ) const;
+    void erased( size_t erased, size_t missing ) const;
+    void shifted( size_t elements ) const;
+    void reallocated( size_t elements ) const;
+
+    soa_stats_snapshot snapshot() const;
+
+    // Snapshot and reset, counter by counter: every operation shows up in exactly one of two
+    // successive takes, even with other threads counting.
+    soa_stats_snapshot take();
+
+    // Not atomic as a whole: counts landing during a reset may survive it.
+    void reset();
+
+private:
+    enum counter
+    {
+        find_hits,
+        find_misses,
+        inserts,
+        insert_existing,
+        erases,
+        erase_misses,
+        shifted_elements,
+        reallocations,
+        reallocated_elements,
+        counter_count
+    };
+
+    void add( counter c, uint64_t value ) const;
+    soa_stats_snapshot read( bool reset ) const;
+
+    mutable std::atomic< uint64_t > counters_[ counter_count ];
+    mutable std::atomic< uint64_t > latency_[ 3 ][ latency_histogram::bucket_count ];
+};
+
+}
+
+#include "soa_stats-impl.h"
+
+#endif // CCPPBRASIL_SOASTATS_H
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOATHREADPOOL_IMPL_H
+#define CCPPBRASIL_SOATHREADPOOL_IMPL_H
+
+#include <algorithm>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// thread_pool
+//-------------------------------------------------------------------------------------------------
+inline thread_pool::thread_pool( size_t threads ) :
+    slots_( new range_slot[ threads + 1 ] ), grain_( 1 ), generation_( 0 ), running_( 0 ), stop_( false )
+{
+    for( size_t i = 0; i < threads + 1; ++i )
+    {
+        slots_[ i ].first = 0;
+        slots_[ i ].last = 0;
+    }
+    for( size_t i = 0; i < threads; ++i )
+    {
+        workers_.emplace_back( &thread_pool::worker, this, i + 1 );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for( size_t i = 0; i < workers_.size(); ++i )
+    {
+        workers_[ i ].join();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t thread_pool::concurrency() const
+{
+    return workers_.size() + 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline size_t thread_pool::default_threads()
+{
+    size_t hardware = std::thread::hardware_concurrency();
+    return ( hardware > 1 ) ? hardware - 1 : 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Another loop already running, on this thread or another one, makes this one run inline.
+template< class Function >
+void thread_pool::parallel_for( size_t count, size_t grain, Function function )
+{
+    if( count == 0 )
+    {
+        return;
+    }
+    grain = ( grain == 0 ) ? 1 : grain;
+
+    std::unique_lock< std::mutex > loop( loop_mutex_, std::try_to_lock );
+    if( !loop.owns_lock() || workers_.empty() || count <= grain )
+    {
+        for( size_t first = 0; first < count; first += grain )
+        {
+            function( first, std::min( first + grain, count ) );
+        }
+        return;
+    }
+
+    size_t participants = concurrency();
+    size_t chunks = ( count + grain - 1 ) / grain;
+    for( size_t i = 0; i < participants; ++i )
+    {
+        slots_[ i ].first = std::min( count, chunks * i / participants * grain );
+        slots_[ i ].last = std::min( count, chunks * ( i + 1 ) / participants * grain );
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        job_ = function;
+        grain_ = grain;
+        error_ = nullptr;
+        running_ = workers_.size();
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    run( 0 );
+
+    std::unique_lock< std::mutex > lock( mutex_ );
+    done_.wait( lock, [ this ]() { return running_ == 0; } );
+    job_ = nullptr;
+    if( error_ )
+    {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception( error );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline void thread_pool::worker( size_t idx )
+{
+    uint64_t seen = 0;
+    for( ;; )
+    {
+        {
+            std::unique_lock< std::mutex > lock( mutex_ );
+            wake_.wait( lock, [ this, seen ]() { return stop_ || generation_ != seen; } );
+            if( stop_ )
+            {
+                return;
+            }
+            seen = generation_;
+        }
+
+        run( idx );
+
+        std::lock_guard< std::mutex > lock( mutex_ );
+        if( --running_ == 0 )
+        {
+            done_.notify_one();
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Runs chunks of its own range, then of stolen ones, until every range is empty.
+inline void thread_pool::run( size_t idx )
+{
+    size_t first;
+    size_t last;
+    for( ;; )
+    {
+        if( !take( idx, first, last ) )
+        {
+            if( steal( idx ) )
+            {
+                continue;
+            }
+            return;
+        }
+
+        try
+        {
+            job_( first, last );
+        }
+        catch( ... )
+        {
+            std::lock_guard< std::mutex > lock( mutex_ );
+            if( !error_ )
+            {
+                error_ = std::current_exception();
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Next chunk from the front of the range of participant idx.
+inline bool thread_pool::take( size_t idx, size_t& first, size_t& last )
+{
+    range_slot& slot = slots_[ idx ];
+    std::lock_guard< std::mutex > lock( slot.mutex );
+    if( slot.first == slot.last )
+    {
+        return false;
+    }
+    first = slot.first;
+    last = std::min( first + grain_, slot.last );
+    slot.first = last;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Moves the back half of the largest range left, rounded to whole chunks, to participant idx.
+// A range in transit between two slots is never lost: the thief runs it.
+inline bool thread_pool::steal( size_t idx )
+{
+    size_t participants = concurrency();
+    for( ;; )
+    {
+        size_t victim = participants;
+        size_t largest = 0;
+        for( size_t i = 0; i < participants; ++i )
+        {
+            if( i == idx )
+            {
+                continue;
+            }
+            std::lock_guard< std::mutex > lock( slots_[ i ].mutex );
+            if( slots_[ i ].last - slots_[ i ].first > largest )
+            {
+                largest = slots_[ i ].last - slots_[ i ].first;
+                victim = i;
+            }
+        }
+        if( victim == participants )
+        {
+            return false;
+        }
+
+        size_t first;
+        size_t last;
+        {
+            range_slot& slot = slots_[ victim ];
+            std::lock_guard< std::mutex > lock( slot.mutex );
+            if( slot.first == slot.last )
+            {
+                continue;
+            }
+            size_t chunks = ( slot.last - slot.first + grain_ - 1 ) / grain_;
+            first = slot.first + chunks / 2 * grain_;
+            last = slot.last;
+            slot.last = first;
+        }
+
+        range_slot& own = slots_[ idx ];
+        std::lock_guard< std::mutex > lock( own.mutex );
+        own.first = first;
+        own.last = last;
+        return true;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline thread_pool& default_thread_pool()
+{
+    static thread_pool pool;
+    return pool;
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOATHREADPOOL_IMPL_H
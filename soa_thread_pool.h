@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOATHREADPOOL_H
+#define CCPPBRASIL_SOATHREADPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "soa_search.h"
+
+namespace ccppbrasil {
+
+// Fixed set of worker threads running parallel loops over index ranges, with work stealing.
+//
+// parallel_for( count, grain, function ) cuts [0, count) in one contiguous range per participant,
+// the workers and the calling thread. Each participant runs function( first, last ) on grain
+// sized chunks from the front of its own range; once it runs out, it steals the back half of the
+// fullest range of another participant, so skewed chunks balance out. Chunk bounds are multiples
+// of grain: with grain a whole number of cache lines of elements, chunks of a column aligned to
+// soa_column_alignment never share a line. One loop runs at a time; calling parallel_for from
+// inside function runs the inner loop on the calling thread alone.
+class thread_pool
+{
+public:
+    // threads workers besides the calling thread; by default one less than the hardware threads.
+    explicit thread_pool( size_t threads = default_threads() );
+    ~thread_pool();
+
+    // Workers plus the calling thread.
+    size_t concurrency() const;
+
+    // Runs function( first, last ) over [0, count) and returns when every chunk is done. The first
+    // exception thrown by function is rethrown here, after the other chunks have run.
+    template< class Function >
+    void parallel_for( size_t count, size_t grain, Function function );
+
+    static size_t default_threads();
+
+private:
+    // Range left to a participant. Two cache lines long, like the reader slots of
+    // concurrent_soa_map, so the owner and the thieves of one range do not share a line with the
+    // next one.
+    struct range_slot
+    {
+        std::mutex mutex;
+        size_t first;
+        size_t last;
+        char padding[ 2 * detail::cache_line_size ];
+    };
+
+    thread_pool( const thread_pool& ) = delete;
+    thread_pool& operator=( const thread_pool& ) = delete;
+
+    void worker( size_t idx );
+    void run( size_t idx );
+    bool take( size_t idx, size_t& first, size_t& last );
+    bool steal( size_t idx );
+
+    std::vector< std::thread > workers_;
+    std::unique_ptr< range_slot[] > slots_;
+
+    std::mutex loop_mutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::function< void( size_t, size_t ) > job_;
+    std::exception_ptr error_;
+    size_t grain_;
+    uint64_t generation_;
+    size_t running_;
+    bool stop_;
+};
+
+// Pool shared by the parallel algorithms when none is given.
+thread_pool& default_thread_pool();
+
+}
+
+#include "soa_thread_pool-impl.h"
+
+#endif // CCPPBRASIL_SOATHREADPOOL_H
@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAUNORDEREDMAP_IMPL_H
+#define CCPPBRASIL_SOAUNORDEREDMAP_IMPL_H
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace ccppbrasil {
+
+//-------------------------------------------------------------------------------------------------
+// soa_unordered_iterator
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::soa_unordered_iterator( map_type& obj, size_t slot ) :
+    soa_map_( &obj ), slot_( slot )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+const KeyType& soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::key() const
+{
+    return soa_map_->slots_.template data< 1 >()[ slot_ ];
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+ValueType& soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::value() const
+{
+    return soa_map_->slots_.template data< 2 >()[ slot_ ];
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::slot() const
+{
+    return slot_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::ref_type
+soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::dereference() const
+{
+    return ref_type( key(), value() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+bool soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::equal( const soa_unordered_iterator& other ) const
+{
+    return slot_ == other.slot_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+void soa_unordered_iterator<KeyType, ValueType, Hash, KeyEqual >::increment()
+{
+    slot_ = soa_map_->next_full( slot_ + 1 );
+}
+
+//-------------------------------------------------------------------------------------------------
+// soa_unordered_map
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+void soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::reserve( size_t capacity )
+{
+    size_t slots = detail::ctrl_group_size;
+    while( slots / 8 * 7 < capacity )
+    {
+        slots *= 2;
+    }
+    if( slots > this->capacity() )
+    {
+        rehash( slots );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::size() const
+{
+    return size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+bool soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::empty() const
+{
+    return size_ == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+void soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::clear()
+{
+    slot_container_type().swap( slots_ );
+    size_ = 0;
+    deleted_ = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+bool soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::insert( const std::pair< KeyType, ValueType > &keyValuePair )
+{
+    return emplace( KeyType( keyValuePair.first ), ValueType( keyValuePair.second ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+bool soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::emplace( KeyType && refKey, ValueType && value )
+{
+    KeyType key( std::forward<KeyType>( refKey ) );
+    size_t hash = hash_of( key );
+    if( find_slot( key, hash ) != capacity() )
+    {
+        return false;
+    }
+
+    size_t slot = prepare_insert( hash );
+    slots_.template data< 1 >()[ slot ] = std::move( key );
+    slots_.template data< 2 >()[ slot ] = std::forward<ValueType>( value );
+    ++size_;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::iterator
+soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::erase( const KeyType &key )
+{
+    size_t slot = find_slot( key, hash_of( key ) );
+    if( slot == capacity() )
+    {
+        return end();
+    }
+
+    // Probes only go past groups without an empty slot, so in a group that still has one no probe
+    // depends on this slot being taken.
+    int8_t* ctrl = slots_.template data< 0 >();
+    if( detail::match_group( ctrl + slot - slot % detail::ctrl_group_size, detail::ctrl_empty ) != 0 )
+    {
+        ctrl[ slot ] = detail::ctrl_empty;
+    }
+    else
+    {
+        ctrl[ slot ] = detail::ctrl_deleted;
+        ++deleted_;
+    }
+    slots_.template data< 1 >()[ slot ] = KeyType();
+    slots_.template data< 2 >()[ slot ] = ValueType();
+    --size_;
+    return iterator( *this, next_full( slot + 1 ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+void soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::swap( soa_unordered_map &other )
+{
+    slots_.swap( other.slots_ );
+    std::swap( size_, other.size_ );
+    std::swap( deleted_, other.deleted_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+ValueType& soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::at( const KeyType & key )
+{
+    size_t slot = find_slot( key, hash_of( key ) );
+
+    if( slot != capacity() )
+    {
+        return slots_.template data< 2 >()[ slot ];
+    }
+    throw std::out_of_range( "" );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+const ValueType& soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::at( const KeyType & key ) const
+{
+    return const_cast< soa_unordered_map* >( this )->at( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+ValueType& soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::operator[]( const KeyType &key )
+{
+    size_t hash = hash_of( key );
+    size_t slot = find_slot( key, hash );
+
+    if( slot == capacity() )
+    {
+        slot = prepare_insert( hash );
+        slots_.template data< 1 >()[ slot ] = key;
+        ++size_;
+    }
+    return slots_.template data< 2 >()[ slot ];
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::iterator
+soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::begin()
+{
+    return iterator( *this, next_full( 0 ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::const_iterator
+soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::begin() const
+{
+    return const_cast< soa_unordered_map* >( this )->begin();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::iterator
+soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::end()
+{
+    return iterator( *this, capacity() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::const_iterator
+soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::end() const
+{
+    return const_cast< soa_unordered_map* >( this )->end();
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::iterator
+soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::find( const KeyType &key )
+{
+    return iterator( *this, find_slot( key, hash_of( key ) ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+typename soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::const_iterator
+soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::find( const KeyType &key ) const
+{
+    return const_cast< soa_unordered_map* >( this )->find( key );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Hash with its bits mixed: std::hash of an integer is often the integer itself, and both the
+// group index and the control byte must depend on every bit of it.
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::hash_of( const KeyType &key )
+{
+    uint64_t hash = static_cast< uint64_t >( Hash()( key ) );
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return static_cast< size_t >( hash );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::capacity() const
+{
+    return slots_.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+// The slot holding key, or capacity() when it is missing. The low 7 bits of the hash are the
+// control byte, the others pick the first group.
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::find_slot( const KeyType &key, size_t hash ) const
+{
+    if( capacity() == 0 )
+    {
+        return 0;
+    }
+
+    const int8_t* ctrl = slots_.template data< 0 >();
+    const KeyType* keys = slots_.template data< 1 >();
+    const int8_t h2 = static_cast< int8_t >( hash & 0x7F );
+    const size_t groupMask = capacity() / detail::ctrl_group_size - 1;
+    size_t group = ( hash >> 7 ) & groupMask;
+    for( size_t step = 1; ; ++step )
+    {
+        const int8_t* groupCtrl = ctrl + group * detail::ctrl_group_size;
+        for( unsigned match = detail::match_group( groupCtrl, h2 ); match != 0; match &= match - 1 )
+        {
+            size_t slot = group * detail::ctrl_group_size + detail::count_trailing_zeros( match );
+            if( KeyEqual()( keys[ slot ], key ) )
+            {
+                return slot;
+            }
+        }
+        if( detail::match_group( groupCtrl, detail::ctrl_empty ) != 0 )
+        {
+            return capacity();
+        }
+        group = ( group + step ) & groupMask;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// First empty or deleted slot of the probe sequence of hash. The load limit keeps one at least.
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::free_slot( size_t hash ) const
+{
+    const int8_t* ctrl = slots_.template data< 0 >();
+    const size_t groupMask = capacity() / detail::ctrl_group_size - 1;
+    size_t group = ( hash >> 7 ) & groupMask;
+    for( size_t step = 1; ; ++step )
+    {
+        unsigned match = detail::match_group_free( ctrl + group * detail::ctrl_group_size );
+        if( match != 0 )
+        {
+            return group * detail::ctrl_group_size + detail::count_trailing_zeros( match );
+        }
+        group = ( group + step ) & groupMask;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Claims a slot for a new key of the given hash, growing the table first when it is at the load
+// limit. A table full of tombstones is rehashed at the same size instead.
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::prepare_insert( size_t hash )
+{
+    if( size_ + deleted_ + 1 > capacity() / 8 * 7 )
+    {
+        if( capacity() == 0 )
+        {
+            rehash( detail::ctrl_group_size );
+        }
+        else
+        {
+            rehash( ( size_ + 1 > capacity() / 16 * 7 ) ? capacity() * 2 : capacity() );
+        }
+    }
+
+    size_t slot = free_slot( hash );
+    int8_t* ctrl = slots_.template data< 0 >();
+    if( ctrl[ slot ] == detail::ctrl_deleted )
+    {
+        --deleted_;
+    }
+    ctrl[ slot ] = static_cast< int8_t >( hash & 0x7F );
+    return slot;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+size_t soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::next_full( size_t slot ) const
+{
+    const int8_t* ctrl = slots_.template data< 0 >();
+    while( slot < capacity() && ctrl[ slot ] < 0 )
+    {
+        ++slot;
+    }
+    return slot;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Moves every element to a new table of capacity slots, a power of two, dropping the tombstones.
+template< class KeyType, class ValueType, class Hash, class KeyEqual >
+void soa_unordered_map<KeyType, ValueType, Hash, KeyEqual >::rehash( size_t capacity )
+{
+    slot_container_type old;
+    old.swap( slots_ );
+    slots_.resize( capacity );
+    std::fill( slots_.template data< 0 >(), slots_.template data< 0 >() + capacity, detail::ctrl_empty );
+    deleted_ = 0;
+
+    const int8_t* ctrl = old.template data< 0 >();
+    KeyType* keys = old.template data< 1 >();
+    ValueType* values = old.template data< 2 >();
+    for( size_t i = 0; i < old.size(); ++i )
+    {
+        if( ctrl[ i ] >= 0 )
+        {
+            size_t hash = hash_of( keys[ i ] );
+            size_t slot = free_slot( hash );
+            slots_.template data< 0 >()[ slot ] = static_cast< int8_t >( hash & 0x7F );
+            slots_.template data< 1 >()[ slot ] = std::move( keys[ i ] );
+            slots_.template data< 2 >()[ slot ] = std::move( values[ i ] );
+        }
+    }
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOAUNORDEREDMAP_IMPL_H
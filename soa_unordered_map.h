@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAUNORDEREDMAP_H
+#define CCPPBRASIL_SOAUNORDEREDMAP_H
+
+#include <cstdint>
+#include <functional>
+#include <boost/iterator/iterator_facade.hpp>
+
+#include "soa_search.h"
+#include "soa_vector.h"
+
+namespace ccppbrasil {
+
+template< class KeyType,
+          class ValueType,
+          class Hash = std::hash< KeyType >,
+          class KeyEqual = std::equal_to< KeyType > >
+class soa_unordered_map;
+
+template< class KeyType,
+          class ValueType,
+          class Hash,
+          class KeyEqual >
+class soa_unordered_iterator : public boost::iterator_facade< soa_unordered_iterator< KeyType, ValueType, Hash, KeyEqual >,
+                                                              std::pair< const KeyType, ValueType >,
+                                                              boost::forward_traversal_tag,
+                                                              std::pair< const KeyType&, ValueType& > >
+{
+public:
+    typedef soa_unordered_map< KeyType, ValueType, Hash, KeyEqual > map_type;
+    typedef std::pair< const KeyType&, ValueType& > ref_type;
+
+    soa_unordered_iterator( map_type& obj, size_t slot );
+
+    const KeyType& key() const;
+    ValueType& value() const;
+
+    size_t slot() const;
+
+private:
+    friend class boost::iterator_core_access;
+
+    ref_type dereference() const;
+    bool equal( const soa_unordered_iterator& other ) const;
+    void increment();
+
+    map_type* soa_map_;
+    size_t slot_;
+};
+
+// Unordered map for exact match lookups, an open addressing hash table of struct of arrays slots.
+//
+// Control bytes, keys and values are three columns of one soa_vector. The control byte of a full
+// slot holds 7 bits of the key hash, so a probe compares a whole group of control bytes with one
+// vector compare and only reads the keys whose byte matched; values are read on a hit only.
+// Groups are probed triangularly, which visits every group of a power of two table, and a probe
+// stops at the first group with an empty slot. Erased slots become tombstones unless their group
+// still has an empty slot. The table grows at 7/8 load, tombstones included. Keys and values must
+// be default constructible. Iterators are invalidated by inserts.
+template< class KeyType,
+          class ValueType,
+          class Hash,
+          class KeyEqual >
+class soa_unordered_map
+{
+public:
+    typedef soa_unordered_iterator< KeyType, ValueType, Hash, KeyEqual >        iterator;
+    typedef const soa_unordered_iterator< KeyType, ValueType, Hash, KeyEqual >  const_iterator;
+
+    void reserve( size_t capacity );
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    bool insert( const std::pair< KeyType, ValueType > &keyValuePair );
+
+    bool emplace( KeyType && moveKey, ValueType && value );
+
+    // Returns the element after the erased one, in iteration order.
+    iterator erase( const KeyType &key );
+
+    void swap( soa_unordered_map &other );
+
+    ValueType& at( const KeyType & key );
+    const ValueType& at( const KeyType & key ) const;
+
+    ValueType& operator[]( const KeyType &key );
+
+    iterator begin();
+    const_iterator begin() const;
+
+    iterator end();
+    const_iterator end() const;
+
+    iterator find( const KeyType &key );
+    const_iterator find( const KeyType &key ) const;
+
+private:
+    typedef soa_vector< int8_t, KeyType, ValueType > slot_container_type;
+
+    friend class soa_unordered_iterator< KeyType, ValueType, Hash, KeyEqual >;
+
+    static size_t hash_of( const KeyType &key );
+    size_t capacity() const;
+    size_t find_slot( const KeyType &key, size_t hash ) const;
+    size_t free_slot( size_t hash ) const;
+    size_t prepare_insert( size_t hash );
+    size_t next_full( size_t slot ) const;
+    void rehash( size_t capacity );
+
+    slot_container_type slots_;
+    size_t size_ = 0;
+    size_t deleted_ = 0;
+};
+
+}
+
+#include "soa_unordered_map-impl.h"
+
+#endif // CCPPBRASIL_SOAUNORDEREDMAP_H
@@ -0,0 +1,760 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAVECTOR_IMPL_H
+#define CCPPBRASIL_SOAVECTOR_IMPL_H
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <new>
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+template< class... Ts >
+struct all_trivially_copyable : std::true_type
+{
+};
+
+template< class T, class... Ts >
+struct all_trivially_copyable< T, Ts... > :
+    std::integral_constant< bool, std::is_trivially_copyable< T >::value && all_trivially_copyable< Ts... >::value >
+{
+};
+
+//-------------------------------------------------------------------------------------------------
+template< class... Ts >
+struct all_nothrow_move_constructible : std::true_type
+{
+};
+
+template< class T, class... Ts >
+struct all_nothrow_move_constructible< T, Ts... > :
+    std::integral_constant< bool, std::is_nothrow_move_constructible< T >::value && all_nothrow_move_constructible< Ts... >::value >
+{
+};
+
+//-------------------------------------------------------------------------------------------------
+inline size_t align_up( size_t value, size_t alignment )
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Does nothing for trivially destructible columns, a dropped column 0 among them.
+template< class T >
+void destroy_range( T* column, size_t first, size_t last )
+{
+    if( !std::is_trivially_destructible< T >::value )
+    {
+        for( size_t i = first; i < last; ++i )
+        {
+            column[ i ].~T();
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T >
+void default_construct_range( T* column, size_t first, size_t last )
+{
+    for( size_t i = first; i < last; ++i )
+    {
+        ::new( static_cast< void* >( column + i ) ) T();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Moves the size elements of src to dst, leaving dst[ gap ] unconstructed; gap == size leaves no
+// hole. With Copy, copies instead when T can be copied, so a throw leaves src untouched; the
+// elements constructed in dst are destroyed then.
+template< bool Copy, class T >
+void relocate_range( T* src, size_t size, size_t gap, T* dst )
+{
+    typedef typename std::conditional< Copy && std::is_copy_constructible< T >::value,
+                                       const T*, std::move_iterator< T* > >::type iterator;
+    std::uninitialized_copy( iterator( src ), iterator( src + gap ), dst );
+    try
+    {
+        std::uninitialized_copy( iterator( src + gap ), iterator( src + size ), dst + gap + 1 );
+    }
+    catch( ... )
+    {
+        destroy_range( dst, 0, gap );
+        throw;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Opens a hole at idx in a column of size elements with room for one more, and stores value there.
+template< class T, class U >
+void shift_insert_one( T* column, size_t idx, size_t size, U&& value )
+{
+    T tmp( std::forward< U >( value ) );
+    if( idx == size )
+    {
+        ::new( static_cast< void* >( column + size ) ) T( std::move( tmp ) );
+        return;
+    }
+    ::new( static_cast< void* >( column + size ) ) T( std::move( column[ size - 1 ] ) );
+    std::move_backward( column + idx, column + size - 1, column + size );
+    column[ idx ] = std::move( tmp );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class T >
+void shift_erase_range( T* column, size_t first, size_t last, size_t size )
+{
+    std::move( column + last, column + size, column + first );
+    destroy_range( column, size - ( last - first ), size );
+}
+
+} // namespace detail
+
+//-------------------------------------------------------------------------------------------------
+// basic_soa_vector
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+basic_soa_vector< Allocator, Ts... >::basic_soa_vector() :
+    allocator_(), block_(), size_( 0 ), capacity_( 0 ), front_dropped_( false )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+basic_soa_vector< Allocator, Ts... >::basic_soa_vector( const Allocator& allocator ) :
+    allocator_( allocator ), block_(), size_( 0 ), capacity_( 0 ), front_dropped_( false )
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+basic_soa_vector< Allocator, Ts... >::basic_soa_vector( const basic_soa_vector& other ) :
+    allocator_( std::allocator_traits< byte_allocator_type >::select_on_container_copy_construction( other.allocator_ ) ),
+    block_(), size_( 0 ), capacity_( 0 ), front_dropped_( other.front_dropped_ )
+{
+    if( other.borrowed_ )
+    {
+        borrowed_ = other.borrowed_;
+        block_ = other.block_;
+        size_ = other.size_;
+        return;
+    }
+    block_ = allocate( other.size_, !other.front_dropped_ );
+    capacity_ = other.size_;
+    other.copy_to( block_.columns, sequence() );
+    size_ = other.size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+basic_soa_vector< Allocator, Ts... >::basic_soa_vector( basic_soa_vector&& other ) :
+    allocator_( std::move( other.allocator_ ) ), borrowed_( std::move( other.borrowed_ ) ), block_( other.block_ ),
+    size_( other.size_ ), capacity_( other.capacity_ ), front_dropped_( other.front_dropped_ )
+{
+    other.block_ = block();
+    other.size_ = 0;
+    other.capacity_ = 0;
+    other.front_dropped_ = false;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+basic_soa_vector< Allocator, Ts... >::~basic_soa_vector()
+{
+    if( !borrowed_ )
+    {
+        destroy( 0, size_, sequence() );
+        deallocate( block_ );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+basic_soa_vector< Allocator, Ts... >& basic_soa_vector< Allocator, Ts... >::operator=( basic_soa_vector other )
+{
+    swap( other );
+    return *this;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::swap( basic_soa_vector& other )
+{
+    std::swap( allocator_, other.allocator_ );
+    borrowed_.swap( other.borrowed_ );
+    std::swap( block_, other.block_ );
+    std::swap( size_, other.size_ );
+    std::swap( capacity_, other.capacity_ );
+    std::swap( front_dropped_, other.front_dropped_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+typename basic_soa_vector< Allocator, Ts... >::allocator_type basic_soa_vector< Allocator, Ts... >::get_allocator() const
+{
+    return allocator_type( allocator_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+size_t basic_soa_vector< Allocator, Ts... >::size() const
+{
+    return size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+size_t basic_soa_vector< Allocator, Ts... >::capacity() const
+{
+    return capacity_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+bool basic_soa_vector< Allocator, Ts... >::empty() const
+{
+    return size_ == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::reserve( size_t capacity )
+{
+    assert( !borrowed_ && !front_dropped_ );
+    if( capacity > capacity_ )
+    {
+        block mem = allocate( capacity );
+        try
+        {
+            relocate_to( mem.columns, size_, sequence() );
+        }
+        catch( ... )
+        {
+            deallocate( mem );
+            throw;
+        }
+        destroy( 0, size_, sequence() );
+        deallocate( block_ );
+        block_ = mem;
+        capacity_ = capacity;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::resize( size_t size )
+{
+    assert( !borrowed_ && !front_dropped_ );
+    if( size > size_ )
+    {
+        reserve( size );
+        default_construct( size_, size, sequence() );
+    }
+    else
+    {
+        destroy( size, size_, sequence() );
+    }
+    size_ = size;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::clear()
+{
+    if( borrowed_ )
+    {
+        borrowed_.reset();
+        block_ = block();
+        size_ = 0;
+    }
+    destroy( 0, size_, sequence() );
+    size_ = 0;
+    if( front_dropped_ )
+    {
+        deallocate( block_ );
+        capacity_ = 0;
+        front_dropped_ = false;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::push_back( const Ts&... values )
+{
+    emplace_back( values... );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< class... Us >
+void basic_soa_vector< Allocator, Ts... >::emplace_back( Us&&... values )
+{
+    static_assert( sizeof...( Us ) == sizeof...( Ts ), "basic_soa_vector: one value per column" );
+    assert( !borrowed_ && !front_dropped_ );
+    if( size_ == capacity_ )
+    {
+        grow_emplace( size_, std::forward< Us >( values )... );
+        return;
+    }
+    construct( block_.columns, size_, sequence(), std::forward< Us >( values )... );
+    ++size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< class... Us >
+void basic_soa_vector< Allocator, Ts... >::emplace( size_t idx, Us&&... values )
+{
+    static_assert( sizeof...( Us ) == sizeof...( Ts ), "basic_soa_vector: one value per column" );
+    assert( !borrowed_ && !front_dropped_ );
+    if( size_ == capacity_ )
+    {
+        grow_emplace( idx, std::forward< Us >( values )... );
+        return;
+    }
+    shift_insert( idx, sequence(), std::forward< Us >( values )... );
+    ++size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::pop_back()
+{
+    assert( !borrowed_ && !front_dropped_ );
+    destroy( size_ - 1, size_, sequence() );
+    --size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::erase( size_t first, size_t last )
+{
+    assert( !borrowed_ && !front_dropped_ );
+    if( first != last )
+    {
+        shift_erase( first, last, sequence() );
+        size_ -= last - first;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< class... Us >
+void basic_soa_vector< Allocator, Ts... >::assign( size_t idx, Us&&... values )
+{
+    static_assert( sizeof...( Us ) == sizeof...( Ts ), "basic_soa_vector: one value per column" );
+    assert( !borrowed_ && !front_dropped_ );
+    assign_row( idx, sequence(), std::forward< Us >( values )... );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::move_rows( size_t first, size_t last, size_t dst )
+{
+    assert( !borrowed_ && !front_dropped_ );
+    move_rows( first, last, dst, sequence() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::append_columns( size_t count, Ts*... columns )
+{
+    assert( !borrowed_ && !front_dropped_ );
+    assert( size_ + count <= capacity_ );
+    append_columns( count, sequence(), columns... );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+typename basic_soa_vector< Allocator, Ts... >::reference basic_soa_vector< Allocator, Ts... >::operator[]( size_t idx )
+{
+    assert( !borrowed_ && !front_dropped_ );
+    return row( idx, sequence() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+typename basic_soa_vector< Allocator, Ts... >::const_reference basic_soa_vector< Allocator, Ts... >::operator[]( size_t idx ) const
+{
+    assert( !front_dropped_ );
+    return row( idx, sequence() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t I >
+typename basic_soa_vector< Allocator, Ts... >::template column_type< I >::type* basic_soa_vector< Allocator, Ts... >::data()
+{
+    assert( !borrowed_ );
+    return std::get< I >( block_.columns );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t I >
+const typename basic_soa_vector< Allocator, Ts... >::template column_type< I >::type* basic_soa_vector< Allocator, Ts... >::data() const
+{
+    return std::get< I >( block_.columns );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t I >
+boost::iterator_range< typename basic_soa_vector< Allocator, Ts... >::template column_type< I >::type* >
+basic_soa_vector< Allocator, Ts... >::column()
+{
+    return boost::make_iterator_range( data< I >(), data< I >() + size_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t I >
+boost::iterator_range< const typename basic_soa_vector< Allocator, Ts... >::template column_type< I >::type* >
+basic_soa_vector< Allocator, Ts... >::column() const
+{
+    return boost::make_iterator_range( data< I >(), data< I >() + size_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::borrow( std::shared_ptr< const void > owner, size_t size, const Ts*... columns )
+{
+    static_assert( detail::all_trivially_copyable< Ts... >::value, "basic_soa_vector: only trivially copyable columns can be borrowed" );
+    basic_soa_vector empty( allocator_ );
+    swap( empty );
+    borrowed_ = std::move( owner );
+    block_.columns = column_pointers( const_cast< Ts* >( columns )... );
+    size_ = size;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+bool basic_soa_vector< Allocator, Ts... >::borrowed() const
+{
+    return borrowed_ != nullptr;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::detach()
+{
+    if( borrowed_ )
+    {
+        block mem = allocate( size_ );
+        copy_to( mem.columns, sequence() );
+        block_ = mem;
+        capacity_ = size_;
+        borrowed_.reset();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::drop_front()
+{
+    static_assert( std::is_trivially_copyable< typename column_type< 0 >::type >::value,
+                   "basic_soa_vector: only a trivially copyable column 0 can be dropped" );
+    assert( !borrowed_ && !front_dropped_ );
+    block mem = allocate( size_, false );
+    try
+    {
+        relocate_to( mem.columns, size_, sequence() );
+    }
+    catch( ... )
+    {
+        deallocate( mem );
+        throw;
+    }
+    destroy( 0, size_, sequence() );
+    deallocate( block_ );
+    block_ = mem;
+    capacity_ = size_;
+    front_dropped_ = true;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::restore_front( const typename column_type< 0 >::type* values )
+{
+    assert( front_dropped_ );
+    block mem = allocate( size_ );
+    std::uninitialized_copy( values, values + size_, std::get< 0 >( mem.columns ) );
+    try
+    {
+        relocate_to( mem.columns, size_, sequence() );
+    }
+    catch( ... )
+    {
+        deallocate( mem );
+        throw;
+    }
+    destroy( 0, size_, sequence() );
+    deallocate( block_ );
+    block_ = mem;
+    capacity_ = size_;
+    front_dropped_ = false;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+bool basic_soa_vector< Allocator, Ts... >::front_dropped() const
+{
+    return front_dropped_;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+typename basic_soa_vector< Allocator, Ts... >::block basic_soa_vector< Allocator, Ts... >::allocate( size_t capacity, bool front )
+{
+    if( capacity == 0 )
+    {
+        return block();
+    }
+    return allocate( capacity, front, sequence() );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Lays the columns out one after the other, each rounded up to soa_column_alignment. The block
+// gets soa_column_alignment - 1 spare bytes to align its start. Without front, column 0 takes no
+// room and is null.
+template< class Allocator, class... Ts >
+template< size_t... Is >
+typename basic_soa_vector< Allocator, Ts... >::block basic_soa_vector< Allocator, Ts... >::allocate( size_t capacity, bool front, detail::index_sequence< Is... > )
+{
+    size_t offsets[ sizeof...( Ts ) ];
+    size_t bytes = 0;
+    CCPPBRASIL_SOA_EXPAND( ( offsets[ Is ] = bytes,
+                             bytes = detail::align_up( bytes + ( Is != 0 || front ? capacity * sizeof( Ts ) : 0 ), soa_column_alignment ) ) )
+
+    block mem;
+    mem.bytes = bytes + soa_column_alignment - 1;
+    mem.raw = std::allocator_traits< byte_allocator_type >::allocate( allocator_, mem.bytes );
+
+    char* base = reinterpret_cast< char* >( detail::align_up( reinterpret_cast< size_t >( mem.raw ), soa_column_alignment ) );
+    mem.columns = column_pointers( Is != 0 || front ? reinterpret_cast< Ts* >( base + offsets[ Is ] ) : nullptr... );
+    return mem;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+void basic_soa_vector< Allocator, Ts... >::deallocate( block& mem )
+{
+    if( mem.raw != nullptr )
+    {
+        std::allocator_traits< byte_allocator_type >::deallocate( allocator_, mem.raw, mem.bytes );
+        mem = block();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+size_t basic_soa_vector< Allocator, Ts... >::grown_capacity() const
+{
+    return std::max( 2 * capacity_, size_t( 16 ) );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Inserts a row before idx into a new, larger block. The row is built before the old rows move,
+// since values may refer to them, e.g. v.emplace_back( v[ 0 ] ).
+template< class Allocator, class... Ts >
+template< class... Us >
+void basic_soa_vector< Allocator, Ts... >::grow_emplace( size_t idx, Us&&... values )
+{
+    size_t capacity = grown_capacity();
+    block mem = allocate( capacity );
+    try
+    {
+        construct( mem.columns, idx, sequence(), std::forward< Us >( values )... );
+        try
+        {
+            relocate_to( mem.columns, idx, sequence() );
+        }
+        catch( ... )
+        {
+            destroy( mem.columns, idx, idx + 1, sequence() );
+            throw;
+        }
+    }
+    catch( ... )
+    {
+        deallocate( mem );
+        throw;
+    }
+    destroy( 0, size_, sequence() );
+    deallocate( block_ );
+    block_ = mem;
+    capacity_ = capacity;
+    ++size_;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Every column is relocated with a hole at gap; if one throws, the columns done are destroyed and
+// the rows stay where they were. Rows span the columns, so the columns are all copied as soon as
+// one of them has a throwing move: a column moved before the throw could not be restored. A
+// dropped column 0, null on either side, is left to drop_front() and restore_front().
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::relocate_to( column_pointers& dst, size_t gap, detail::index_sequence< Is... > )
+{
+    const bool copy = !detail::all_nothrow_move_constructible< Ts... >::value;
+    size_t done = 0;
+    try
+    {
+        CCPPBRASIL_SOA_EXPAND( ( std::get< Is >( block_.columns ) != nullptr && std::get< Is >( dst ) != nullptr
+                                 ? detail::relocate_range< copy >( std::get< Is >( block_.columns ), size_, gap, std::get< Is >( dst ) ) : void(),
+                                 ++done ) )
+    }
+    catch( ... )
+    {
+        CCPPBRASIL_SOA_EXPAND( ( Is < done ? ( detail::destroy_range( std::get< Is >( dst ), 0, gap ),
+                                               detail::destroy_range( std::get< Is >( dst ), gap + 1, size_ + 1 ) ) : void() ) )
+        throw;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::copy_to( column_pointers& dst, detail::index_sequence< Is... > ) const
+{
+    CCPPBRASIL_SOA_EXPAND( std::get< Is >( dst ) != nullptr
+                           ? ( std::uninitialized_copy( std::get< Is >( block_.columns ), std::get< Is >( block_.columns ) + size_,
+                                                        std::get< Is >( dst ) ), void() ) : void() )
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::destroy( size_t first, size_t last, detail::index_sequence< Is... > )
+{
+    destroy( block_.columns, first, last, detail::index_sequence< Is... >() );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::destroy( column_pointers& columns, size_t first, size_t last, detail::index_sequence< Is... > )
+{
+    CCPPBRASIL_SOA_EXPAND( detail::destroy_range( std::get< Is >( columns ), first, last ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::default_construct( size_t first, size_t last, detail::index_sequence< Is... > )
+{
+    CCPPBRASIL_SOA_EXPAND( detail::default_construct_range( std::get< Is >( block_.columns ), first, last ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is, class... Us >
+void basic_soa_vector< Allocator, Ts... >::construct( column_pointers& columns, size_t idx, detail::index_sequence< Is... >, Us&&... values )
+{
+    size_t done = 0;
+    try
+    {
+        CCPPBRASIL_SOA_EXPAND( ( ::new( static_cast< void* >( std::get< Is >( columns ) + idx ) ) Ts( std::forward< Us >( values ) ), ++done ) )
+    }
+    catch( ... )
+    {
+        CCPPBRASIL_SOA_EXPAND( ( Is < done ? detail::destroy_range( std::get< Is >( columns ), idx, idx + 1 ) : void() ) )
+        throw;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is, class... Us >
+void basic_soa_vector< Allocator, Ts... >::shift_insert( size_t idx, detail::index_sequence< Is... >, Us&&... values )
+{
+    CCPPBRASIL_SOA_EXPAND( detail::shift_insert_one( std::get< Is >( block_.columns ), idx, size_, std::forward< Us >( values ) ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::shift_erase( size_t first, size_t last, detail::index_sequence< Is... > )
+{
+    CCPPBRASIL_SOA_EXPAND( detail::shift_erase_range( std::get< Is >( block_.columns ), first, last, size_ ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is, class... Us >
+void basic_soa_vector< Allocator, Ts... >::assign_row( size_t idx, detail::index_sequence< Is... >, Us&&... values )
+{
+    CCPPBRASIL_SOA_EXPAND( std::get< Is >( block_.columns )[ idx ] = std::forward< Us >( values ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::move_rows( size_t first, size_t last, size_t dst, detail::index_sequence< Is... > )
+{
+    CCPPBRASIL_SOA_EXPAND( std::move( std::get< Is >( block_.columns ) + first, std::get< Is >( block_.columns ) + last,
+                                      std::get< Is >( block_.columns ) + dst ) )
+}
+
+//-------------------------------------------------------------------------------------------------
+// uninitialized_copy cleans up the column it fails in; the columns done before it are destroyed
+// here.
+template< class Allocator, class... Ts >
+template< size_t... Is >
+void basic_soa_vector< Allocator, Ts... >::append_columns( size_t count, detail::index_sequence< Is... >, Ts*... columns )
+{
+    size_t done = 0;
+    try
+    {
+        CCPPBRASIL_SOA_EXPAND( ( std::uninitialized_copy( std::make_move_iterator( columns ), std::make_move_iterator( columns + count ),
+                                                          std::get< Is >( block_.columns ) + size_ ), ++done ) )
+    }
+    catch( ... )
+    {
+        CCPPBRASIL_SOA_EXPAND( ( Is < done ? detail::destroy_range( std::get< Is >( block_.columns ), size_, size_ + count ) : void() ) )
+        throw;
+    }
+    size_ += count;
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+typename basic_soa_vector< Allocator, Ts... >::reference basic_soa_vector< Allocator, Ts... >::row( size_t idx, detail::index_sequence< Is... > )
+{
+    return reference( std::get< Is >( block_.columns )[ idx ]... );
+}
+
+//-------------------------------------------------------------------------------------------------
+template< class Allocator, class... Ts >
+template< size_t... Is >
+typename basic_soa_vector< Allocator, Ts... >::const_reference basic_soa_vector< Allocator, Ts... >::row( size_t idx, detail::index_sequence< Is... > ) const
+{
+    return const_reference( std::get< Is >( block_.columns )[ idx ]... );
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOAVECTOR_IMPL_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAVECTOR_H
+#define CCPPBRASIL_SOAVECTOR_H
+
+#include <tuple>
+#include <memory>
+#include <type_traits>
+#include <boost/range/iterator_range.hpp>
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+template< size_t... Is >
+struct index_sequence
+{
+};
+
+template< size_t N, size_t... Is >
+struct make_index_sequence : make_index_sequence< N - 1, N - 1, Is... >
+{
+};
+
+template< size_t... Is >
+struct make_index_sequence< 0, Is... > : index_sequence< Is... >
+{
+};
+
+// Expands a pack expression for its side effects, in order.
+#define CCPPBRASIL_SOA_EXPAND( expr ) { int expand_[] = { 0, ( ( expr ), 0 )... }; (void) expand_; }
+
+} // namespace detail
+
+// Columns start on this boundary: a cache line, and the widest vector load.
+const size_t soa_column_alignment = 64;
+
+// Struct of arrays vector: one column per type, all of them in a single allocation.
+//
+// The columns share the capacity and each starts on a soa_column_alignment boundary of the block,
+// so growing costs one allocation whatever the number of columns, and aligned vector loads are
+// safe on any column. Rows are read and written through a std::tuple of references.
+template< class Allocator, class... Ts >
+class basic_soa_vector
+{
+public:
+    typedef Allocator allocator_type;
+    typedef std::tuple< Ts&... > reference;
+    typedef std::tuple< const Ts&... > const_reference;
+
+    template< size_t I >
+    struct column_type
+    {
+        typedef typename std::tuple_element< I, std::tuple< Ts... > >::type type;
+    };
+
+    basic_soa_vector();
+    explicit basic_soa_vector( const Allocator& allocator );
+    basic_soa_vector( const basic_soa_vector& other );
+    basic_soa_vector( basic_soa_vector&& other );
+    ~basic_soa_vector();
+
+    basic_soa_vector& operator=( basic_soa_vector other );
+
+    void swap( basic_soa_vector& other );
+    allocator_type get_allocator() const;
+
+    size_t size() const;
+    size_t capacity() const;
+    bool empty() const;
+
+    void reserve( size_t capacity );
+    void resize( size_t size );
+    void clear();
+
+    void push_back( const Ts&... values );
+
+    // One argument per column.
+    template< class... Us >
+    void emplace_back( Us&&... values );
+
+    // Inserts a row before idx, shifting the rows after it in every column.
+    template< class... Us >
+    void emplace( size_t idx, Us&&... values );
+
+    void pop_back();
+
+    // Erases the rows [first, last).
+    void erase( size_t first, size_t last );
+
+    // Assigns one argument per column to the row idx.
+    template< class... Us >
+    void assign( size_t idx, Us&&... values );
+
+    // Moves the rows [first, last) to dst, dst <= first, like std::move on every column.
+    void move_rows( size_t first, size_t last, size_t dst );
+
+    // Appends count rows moved from one array per column, a whole column at a time. Needs
+    // capacity() >= size() + count; if a move throws, the vector is left as it was.
+    void append_columns( size_t count, Ts*... columns );
+
+    // Reads size rows from columns owned by someone else, e.g. a memory mapped file, instead of
+    // a block of our own; owner is kept alive meanwhile. Borrowed rows are read-only: only the
+    // const members, clear() and swap() may be used until detach() copies them into a block of
+    // our own. Nothing detaches implicitly, so reading stays on the borrowed memory and the
+    // accessors stay free of checks. Trivially copyable columns only.
+    void borrow( std::shared_ptr< const void > owner, size_t size, const Ts*... columns );
+    bool borrowed() const;
+
+    // Copies borrowed rows into a block of our own; does nothing otherwise.
+    void detach();
+
+    // Frees column 0 for an owner that keeps it in another form, e.g. soa_map's compressed keys:
+    // the other columns move to a block of size() rows without it and data< 0 >() is null. The
+    // other columns stay writable, but no row may be added or removed until restore_front()
+    // copies column 0 back; clear() forgets it. Column 0 must be trivially copyable.
+    void drop_front();
+    void restore_front( const typename column_type< 0 >::type* values );
+    bool front_dropped() const;
+
+    reference operator[]( size_t idx );
+    const_reference operator[]( size_t idx ) const;
+
+    template< size_t I >
+    typename column_type< I >::type* data();
+    template< size_t I >
+    const typename column_type< I >::type* data() const;
+
+    template< size_t I >
+    boost::iterator_range< typename column_type< I >::type* > column();
+    template< size_t I >
+    boost::iterator_range< const typename column_type< I >::type* > column() const;
+
+private:
+    typedef typename std::allocator_traits< Allocator >::template rebind_alloc< char > byte_allocator_type;
+    typedef std::tuple< Ts*... > column_pointers;
+    typedef detail::make_index_sequence< sizeof...( Ts ) > sequence;
+
+    struct block
+    {
+        char* raw;
+        size_t bytes;
+        column_pointers columns;
+    };
+
+    block allocate( size_t capacity, bool front = true );
+    void deallocate( block& mem );
+    size_t grown_capacity() const;
+    template< class... Us >
+    void grow_emplace( size_t idx, Us&&... values );
+
+    template< size_t... Is >
+    block allocate( size_t capacity, bool front, detail::index_sequence< Is... > );
+    template< size_t... Is >
+    void relocate_to( column_pointers& dst, size_t gap, detail::index_sequence< Is... > );
+    template< size_t... Is >
+    void copy_to( column_pointers& dst, detail::index_sequence< Is... > ) const;
+    template< size_t... Is >
+    void destroy( size_t first, size_t last, detail::index_sequence< Is... > );
+    template< size_t... Is >
+    static void destroy( column_pointers& columns, size_t first, size_t last, detail::index_sequence< Is... > );
+    template< size_t... Is >
+    void default_construct( size_t first, size_t last, detail::index_sequence< Is... > );
+    template< size_t... Is, class... Us >
+    static void construct( column_pointers& columns, size_t idx, detail::index_sequence< Is... >, Us&&... values );
+    template< size_t... Is, class... Us >
+    void shift_insert( size_t idx, detail::index_sequence< Is... >, Us&&... values );
+    template< size_t... Is >
+    void shift_erase( size_t first, size_t last, detail::index_sequence< Is... > );
+    template< size_t... Is, class... Us >
+    void assign_row( size_t idx, detail::index_sequence< Is... >, Us&&... values );
+    template< size_t... Is >
+    void move_rows( size_t first, size_t last, size_t dst, detail::index_sequence< Is... > );
+    template< size_t... Is >
+    void append_columns( size_t count, detail::index_sequence< Is... >, Ts*... columns );
+    template< size_t... Is >
+    reference row( size_t idx, detail::index_sequence< Is... > );
+    template< size_t... Is >
+    const_reference row( size_t idx, detail::index_sequence< Is... > ) const;
+
+    byte_allocator_type allocator_;
+    std::shared_ptr< const void > borrowed_;
+    block block_;
+    size_t size_;
+    size_t capacity_;
+    bool front_dropped_;
+};
+
+template< class... Ts >
+using soa_vector = basic_soa_vector< std::allocator< char >, Ts... >;
+
+}
+
+#include "soa_vector-impl.h"
+
+#endif // CCPPBRASIL_SOAVECTOR_H
@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAWORKLOAD_IMPL_H
+#define CCPPBRASIL_SOAWORKLOAD_IMPL_H
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace ccppbrasil {
+
+namespace detail {
+
+//-------------------------------------------------------------------------------------------------
+// Uniform in [0, 1) from the top 53 bits.
+inline double uniform01( std::mt19937_64& rng )
+{
+    return static_cast< double >( rng() >> 11 ) * ( 1. / 9007199254740992. );
+}
+
+//-------------------------------------------------------------------------------------------------
+// FNV-1a over the bytes of value, from the least significant.
+inline uint64_t fnv1a64( uint64_t value )
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for( int i = 0; i < 8; ++i )
+    {
+        hash ^= ( value >> ( i * 8 ) ) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//-------------------------------------------------------------------------------------------------
+inline double zeta( uint64_t n, double theta )
+{
+    double sum = 0.;
+    for( uint64_t i = 1; i <= n; ++i )
+    {
+        sum += 1. / std::pow( static_cast< double >( i ), theta );
+    }
+    return sum;
+}
+
+} // namespace detail
+
+//-------------------------------------------------------------------------------------------------
+inline const char* distribution_name( key_distribution distribution )
+{
+    const char* names[] = { "uniform", "zipfian", "clustered", "time_series" };
+    return names[ static_cast< int >( distribution ) ];
+}
+
+//-------------------------------------------------------------------------------------------------
+// workload_mix
+//-------------------------------------------------------------------------------------------------
+inline workload_mix workload_mix::ycsb( char workload )
+{
+    workload_mix mix = { 0., 0., 0., 0., 0 };
+    switch( workload )
+    {
+    case 'a':
+        mix.find = 0.5;
+        mix.update = 0.5;
+        break;
+    case 'b':
+        mix.find = 0.95;
+        mix.update = 0.05;
+        break;
+    case 'c':
+        mix.find = 1.;
+        break;
+    case 'd':
+        mix.find = 0.95;
+        mix.insert = 0.05;
+        break;
+    case 'e':
+        mix.scan = 0.95;
+        mix.insert = 0.05;
+        mix.max_scan_length = 100;
+        break;
+    default:
+        throw std::invalid_argument( "workload_mix::ycsb: unknown workload " + std::string( 1, workload ) );
+    }
+    return mix;
+}
+
+//-------------------------------------------------------------------------------------------------
+// zipfian_generator
+//-------------------------------------------------------------------------------------------------
+inline zipfian_generator::zipfian_generator( uint64_t n, double theta ) :
+    n_( std::max< uint64_t >( n, 1 ) ), theta_( theta ), alpha_( 1. / ( 1. - theta ) ),
+    zetan_( detail::zeta( n_, theta ) )
+{
+    eta_ = ( 1. - std::pow( 2. / n_, 1. - theta_ ) ) / ( 1. - detail::zeta( 2, theta_ ) / zetan_ );
+}
+
+//-------------------------------------------------------------------------------------------------
+inline uint64_t zipfian_generator::operator()( std::mt19937_64& rng ) const
+{
+    double u = detail::uniform01( rng );
+    double uz = u * zetan_;
+    if( uz < 1. )
+    {
+        return 0;
+    }
+    if( uz < 1. + std::pow( 0.5, theta_ ) )
+    {
+        return std::min< uint64_t >( 1, n_ - 1 );
+    }
+    uint64_t rank = static_cast< uint64_t >( n_ * std::pow( eta_ * u - eta_ + 1., alpha_ ) );
+    return std::min( rank, n_ - 1 );
+}
+
+//-------------------------------------------------------------------------------------------------
+// key_generator
+//-------------------------------------------------------------------------------------------------
+// Only the skewed distributions pay for the zeta sum of the Zipfian ranks.
+inline key_generator::key_generator( key_distribution distribution, size_t records, uint64_t seed ) :
+    distribution_( distribution ), records_( records ), rng_( seed ),
+    zipfian_( ( distribution == key_distribution::zipfian || distribution == key_distribution::time_series ) ? records : 1 ),
+    clock_( uint64_t( 1 ) << 40 )
+{
+    // Clusters of about 256 keys at random multiples of 2^32, each growing upwards.
+    if( distribution_ == key_distribution::clustered )
+    {
+        clusters_.resize( std::max< size_t >( records_ / 256, 1 ) );
+        for( size_t i = 0; i < clusters_.size(); ++i )
+        {
+            clusters_[ i ] = rng_() & 0xffffffff00000000ULL;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+inline std::vector< uint64_t > key_generator::load()
+{
+    std::vector< uint64_t > keys;
+    keys.reserve( records_ );
+    for( size_t i = 0; i < records_; ++i )
+    {
+        if( distribution_ == key_distribution::clustered )
+        {
+            keys.push_back( clusters_[ i % clusters_.size() ]++ );
+        }
+        else
+        {
+            keys.push_back( fresh() );
+        }
+    }
+    return keys;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Timestamps are about 1000 apart; 1% of them arrive late, up to 100000 behind the clock.
+inline uint64_t key_generator::fresh()
+{
+    switch( distribution_ )
+    {
+    case key_distribution::clustered:
+        return clusters_[ rng_() % clusters_.size() ]++;
+    case key_distribution::time_series:
+        clock_ += 1 + static_cast< uint64_t >( -std::log( 1. - detail::uniform01( rng_ ) ) * 1000. );
+        if( rng_() % 100 == 0 )
+        {
+            return clock_ - rng_() % 100000;
+        }
+        return clock_;
+    default:
+        return rng_();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// The Zipfian keys scramble among the loaded ones, so the hot keys stay put as keys are inserted;
+// the time series ranks count back from the latest key.
+inline size_t key_generator::pick( size_t count )
+{
+    switch( distribution_ )
+    {
+    case key_distribution::zipfian:
+        return static_cast< size_t >( detail::fnv1a64( zipfian_( rng_ ) ) % std::min( count, records_ ) );
+    case key_distribution::time_series:
+        return count - 1 - static_cast< size_t >( zipfian_( rng_ ) % count );
+    default:
+        return static_cast< size_t >( rng_() % count );
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// make_workload
+//-------------------------------------------------------------------------------------------------
+inline workload make_workload( key_distribution distribution, const workload_mix& mix, size_t records, size_t operations,
+                               uint64_t seed )
+{
+    if( mix.find < 0. || mix.update < 0. || mix.insert < 0. || mix.scan < 0. ||
+        std::fabs( mix.find + mix.update + mix.insert + mix.scan - 1. ) > 1e-9 )
+    {
+        throw std::invalid_argument( "make_workload: operation fractions must sum to 1" );
+    }
+    if( mix.scan > 0. && mix.max_scan_length == 0 )
+    {
+        throw std::invalid_argument( "make_workload: scans need a max_scan_length" );
+    }
+    if( records == 0 && mix.insert != 1. )
+    {
+        throw std::invalid_argument( "make_workload: reads need records to read" );
+    }
+
+    // Rounding that leaves the coin past every fraction lands on the last operation in use.
+    const double fractions[ 4 ] = { mix.find, mix.update, mix.insert, mix.scan };
+    const workload_op ops[ 4 ] = { workload_op::find, workload_op::update, workload_op::insert, workload_op::scan };
+    size_t last = 3;
+    while( fractions[ last ] == 0. )
+    {
+        --last;
+    }
+
+    key_generator generator( distribution, records, seed );
+    std::mt19937_64 rng( seed ^ 0x9e3779b97f4a7c15ULL );
+
+    workload result;
+    result.load_keys = generator.load();
+    std::vector< uint64_t > keys( result.load_keys );
+    result.steps.reserve( operations );
+    for( size_t i = 0; i < operations; ++i )
+    {
+        double coin = detail::uniform01( rng );
+        size_t op = 0;
+        while( op < last && !( coin < fractions[ op ] ) )
+        {
+            coin -= fractions[ op ];
+            ++op;
+        }
+
+        workload_step step = { ops[ op ], 0, 0 };
+        if( step.op == workload_op::insert )
+        {
+            step.key = generator.fresh();
+            keys.push_back( step.key );
+        }
+        else
+        {
+            step.key = keys[ generator.pick( keys.size() ) ];
+        }
+        if( step.op == workload_op::scan )
+        {
+            step.length = 1 + static_cast< uint32_t >( rng() % mix.max_scan_length );
+        }
+        result.steps.push_back( step );
+    }
+    return result;
+}
+
+} //namespace ccppbrasil
+
+#endif // CCPPBRASIL_SOAWORKLOAD_IMPL_H
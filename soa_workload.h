@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2015 André Tupinambá (andrelrt@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CCPPBRASIL_SOAWORKLOAD_H
+#define CCPPBRASIL_SOAWORKLOAD_H
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace ccppbrasil {
+
+// Shape of the keys a workload loads, inserts and reads:
+//   uniform      random 64 bit keys, read uniformly
+//   zipfian      random 64 bit keys, read with a Zipfian skew (theta 0.99); the hot keys are
+//                spread over the key space, as YCSB's scrambled Zipfian
+//   clustered    dense runs of consecutive keys far apart from each other, read uniformly
+//   time_series  increasing timestamps with some late arrivals, the recent ones read the most
+enum class key_distribution
+{
+    uniform,
+    zipfian,
+    clustered,
+    time_series
+};
+
+const char* distribution_name( key_distribution distribution );
+
+enum class workload_op
+{
+    find,   // find an existing key
+    update, // assign the value of an existing key
+    insert, // insert a new key
+    scan    // lower_bound an existing key and walk length rows
+};
+
+struct workload_step
+{
+    workload_op op;
+    uint64_t key;
+    uint32_t length;
+};
+
+// Fractions of each operation, summing to 1. Scans walk 1 to max_scan_length rows.
+struct workload_mix
+{
+    double find;
+    double update;
+    double insert;
+    double scan;
+    uint32_t max_scan_length;
+
+    // YCSB core workloads: 'a' 50% find 50% update, 'b' 95% find 5% update, 'c' find only,
+    // 'd' 95% find 5% insert, 'e' 95% scan 5% insert. Throws std::invalid_argument otherwise.
+    static workload_mix ycsb( char workload );
+};
+
+// Zipfian ranks in [0, n), rank 0 the most frequent, with the method of Gray et al., "Quickly
+// Generating Billion-Record Synthetic Databases", as YCSB. The constructor is O(n).
+class zipfian_generator
+{
+public:
+    explicit zipfian_generator( uint64_t n, double theta = 0.99 );
+
+    uint64_t operator()( std::mt19937_64& rng ) const;
+
+private:
+    uint64_t n_;
+    double theta_;
+    double alpha_;
+    double zetan_;
+    double eta_;
+};
+
+// Draws the keys of a distribution. Only the raw std::mt19937_64 output is used, never the
+// standard distributions, so a seed gives the same keys with every standard library.
+class key_generator
+{
+public:
+    key_generator( key_distribution distribution, size_t records, uint64_t seed );
+
+    // The records keys to load, in insertion order.
+    std::vector< uint64_t > load();
+
+    // A key to insert.
+    uint64_t fresh();
+
+    // Index of the key to read among the count keys loaded or inserted so far, in that order.
+    size_t pick( size_t count );
+
+private:
+    key_distribution distribution_;
+    size_t records_;
+    std::mt19937_64 rng_;
+    zipfian_generator zipfian_;
+    uint64_t clock_;
+    std::vector< uint64_t > clusters_;
+};
+
+// Keys to load and operations to replay, made up front so that drawing them stays out of the
+// timed region.
+struct workload
+{
+    std::vector< uint64_t > load_keys;
+    std::vector< workload_step > steps;
+};
+
+// The same seed replays the same workload. Throws std::invalid_argument when the fractions of
+// mix do not sum to 1.
+workload make_workload( key_distribution distribution, const workload_mix& mix, size_t records, size_t operations,
+                        uint64_t seed );
+
+}
+
+#include "soa_workload-impl.h"
+
+#endif // CCPPBRASIL_SOAWORKLOAD_H